@@ -39,6 +39,34 @@
 
 #define BLOCK_SIZE 10240
 
+/* How much of an image is read at most to find its size in the headers */
+#define IMAGE_HEADER_MAX_SIZE (256 * 1024)
+
+typedef enum {
+	IMAGE_SIZE_FOUND,
+	IMAGE_SIZE_NEED_MORE,
+	IMAGE_SIZE_UNKNOWN
+} ImageSizeResult;
+
+typedef struct {
+	gint width;
+	gint height; /* 0 when not found in the headers */
+} ComicsPageSize;
+
+/* Pages decoded ahead of time around the last rendered one, enough for
+ * the next spread in dual page mode.
+ */
+#define PREFETCH_PAGES_BEHIND 1
+#define PREFETCH_PAGES_AHEAD  2
+#define MAX_DECODE_THREADS    4
+
+typedef struct {
+	gint       page;
+	gdouble    scale;
+	GdkPixbuf *pixbuf;
+	gboolean   done;
+} ComicsDecodedPage;
+
 typedef struct _ComicsDocumentClass ComicsDocumentClass;
 
 struct _ComicsDocumentClass
@@ -53,7 +81,13 @@ struct _ComicsDocument
 	gchar         *archive_path;
 	gchar         *archive_uri;
 	GPtrArray     *page_names; /* elem: char * */
-	GHashTable    *page_positions; /* key: char *, value: uint + 1 */
+	ComicsPageSize *page_sizes; /* Same order as page_names */
+
+	/* Prefetched pages, decoded by a thread pool */
+	GThreadPool   *decode_pool;
+	GMutex         decode_mutex;
+	GCond          decode_cond;
+	GHashTable    *decoded_pages; /* key: page index, value: ComicsDecodedPage */
 };
 
 static void       comics_document_document_thumbnails_iface_init (EvDocumentThumbnailsInterface *iface);
@@ -151,34 +185,173 @@ is_apple_double (const char *name)
 	return ret;
 }
 
-static gboolean
-archive_reopen_if_needed (ComicsDocument  *comics_document,
-			  const char      *page_wanted,
-			  GError         **error)
-{
-	const char *current_page;
-	guint current_page_idx, page_wanted_idx;
-
-	if (ev_archive_at_entry (comics_document->archive)) {
-		current_page = ev_archive_get_entry_pathname (comics_document->archive);
-		if (current_page) {
-			current_page_idx = GPOINTER_TO_UINT (g_hash_table_lookup (comics_document->page_positions, current_page));
-			page_wanted_idx = GPOINTER_TO_UINT (g_hash_table_lookup (comics_document->page_positions, page_wanted));
-
-			if (current_page_idx != 0 &&
-			    page_wanted_idx != 0 &&
-			    page_wanted_idx > current_page_idx)
-				return TRUE;
+#define READ_UINT16_BE(p) (((guint) (p)[0] << 8) | (p)[1])
+#define READ_UINT16_LE(p) (((guint) (p)[1] << 8) | (p)[0])
+#define READ_UINT24_LE(p) (((guint) (p)[2] << 16) | ((guint) (p)[1] << 8) | (p)[0])
+#define READ_UINT32_BE(p) (((guint) (p)[0] << 24) | ((guint) (p)[1] << 16) | \
+			   ((guint) (p)[2] << 8) | (p)[3])
+
+static ImageSizeResult
+parse_jpeg_size (const guchar *data,
+		 gsize         len,
+		 gint         *width,
+		 gint         *height)
+{
+	gsize pos = 2;
+
+	while (TRUE) {
+		guchar marker;
+		guint  segment_len;
+
+		if (pos + 2 > len)
+			return IMAGE_SIZE_NEED_MORE;
+		if (data[pos] != 0xff)
+			return IMAGE_SIZE_UNKNOWN;
+
+		marker = data[pos + 1];
+		if (marker == 0xff) {
+			/* Fill byte */
+			pos++;
+			continue;
+		}
+		pos += 2;
+
+		/* Markers without a payload */
+		if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8))
+			continue;
+		/* End of image or start of scan before any frame header */
+		if (marker == 0xd9 || marker == 0xda)
+			return IMAGE_SIZE_UNKNOWN;
+
+		if (pos + 2 > len)
+			return IMAGE_SIZE_NEED_MORE;
+		segment_len = READ_UINT16_BE (data + pos);
+		if (segment_len < 2)
+			return IMAGE_SIZE_UNKNOWN;
+
+		/* Start of frame, except DHT, JPG and DAC */
+		if (marker >= 0xc0 && marker <= 0xcf &&
+		    marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+			if (pos + 7 > len)
+				return IMAGE_SIZE_NEED_MORE;
+			*height = READ_UINT16_BE (data + pos + 3);
+			*width = READ_UINT16_BE (data + pos + 5);
+			return IMAGE_SIZE_FOUND;
 		}
 
-		ev_archive_reset (comics_document->archive);
+		pos += segment_len;
+	}
+}
+
+static ImageSizeResult
+parse_webp_size (const guchar *data,
+		 gsize         len,
+		 gint         *width,
+		 gint         *height)
+{
+	if (len < 30)
+		return IMAGE_SIZE_NEED_MORE;
+
+	if (memcmp (data + 12, "VP8 ", 4) == 0) {
+		/* Lossy: frame tag, then the key frame start code */
+		if (data[23] != 0x9d || data[24] != 0x01 || data[25] != 0x2a)
+			return IMAGE_SIZE_UNKNOWN;
+		*width = READ_UINT16_LE (data + 26) & 0x3fff;
+		*height = READ_UINT16_LE (data + 28) & 0x3fff;
+	} else if (memcmp (data + 12, "VP8L", 4) == 0) {
+		/* Lossless: 14 bits each for width - 1 and height - 1 */
+		if (data[20] != 0x2f)
+			return IMAGE_SIZE_UNKNOWN;
+		*width = 1 + (((data[22] & 0x3f) << 8) | data[21]);
+		*height = 1 + (((data[24] & 0x0f) << 10) | (data[23] << 2) | (data[22] >> 6));
+	} else if (memcmp (data + 12, "VP8X", 4) == 0) {
+		/* Extended: canvas size */
+		*width = 1 + READ_UINT24_LE (data + 24);
+		*height = 1 + READ_UINT24_LE (data + 27);
+	} else {
+		return IMAGE_SIZE_UNKNOWN;
+	}
+
+	return IMAGE_SIZE_FOUND;
+}
+
+/* Reads the size of a JPEG, PNG, GIF or WebP image from its headers,
+ * which is what gdk-pixbuf reports in GdkPixbufLoader::size-prepared.
+ */
+static ImageSizeResult
+parse_image_size (const guchar *data,
+		  gsize         len,
+		  gint         *width,
+		  gint         *height)
+{
+	ImageSizeResult result;
+
+	if (len < 12)
+		return IMAGE_SIZE_NEED_MORE;
+
+	if (data[0] == 0xff && data[1] == 0xd8) {
+		result = parse_jpeg_size (data, len, width, height);
+	} else if (memcmp (data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+		if (len < 24)
+			return IMAGE_SIZE_NEED_MORE;
+		if (memcmp (data + 12, "IHDR", 4) != 0)
+			return IMAGE_SIZE_UNKNOWN;
+		*width = READ_UINT32_BE (data + 16);
+		*height = READ_UINT32_BE (data + 20);
+		result = IMAGE_SIZE_FOUND;
+	} else if (memcmp (data, "GIF87a", 6) == 0 || memcmp (data, "GIF89a", 6) == 0) {
+		*width = READ_UINT16_LE (data + 6);
+		*height = READ_UINT16_LE (data + 8);
+		result = IMAGE_SIZE_FOUND;
+	} else if (memcmp (data, "RIFF", 4) == 0 && memcmp (data + 8, "WEBP", 4) == 0) {
+		result = parse_webp_size (data, len, width, height);
+	} else {
+		result = IMAGE_SIZE_UNKNOWN;
 	}
 
-	return ev_archive_open_filename (comics_document->archive, comics_document->archive_path, error);
+	if (result == IMAGE_SIZE_FOUND && (*width <= 0 || *height <= 0))
+		result = IMAGE_SIZE_UNKNOWN;
+
+	return result;
+}
+
+/* Reads the beginning of the current entry until its size is found */
+static void
+comics_document_read_image_size (ComicsDocument *comics_document,
+				 ComicsPageSize *size)
+{
+	ImageSizeResult result = IMAGE_SIZE_NEED_MORE;
+	guchar *buf;
+	gsize len = 0;
+	gsize alloc = 4096;
+
+	buf = g_malloc (alloc);
+	while (result == IMAGE_SIZE_NEED_MORE) {
+		gssize read;
+
+		if (len == alloc) {
+			if (alloc >= IMAGE_HEADER_MAX_SIZE)
+				break;
+			alloc *= 2;
+			buf = g_realloc (buf, alloc);
+		}
+
+		read = ev_archive_read_data (comics_document->archive, buf + len, alloc - len, NULL);
+		if (read <= 0)
+			break;
+		len += read;
+
+		result = parse_image_size (buf, len, &size->width, &size->height);
+	}
+	g_free (buf);
+
+	if (result != IMAGE_SIZE_FOUND)
+		size->width = size->height = 0;
 }
 
 static GPtrArray *
 comics_document_list (ComicsDocument  *comics_document,
+		      GHashTable      *page_sizes,
 		      GError         **error)
 {
 	GPtrArray *array = NULL;
@@ -244,6 +417,14 @@ comics_document_list (ComicsDocument  *comics_document,
 
 		g_debug ("Adding '%s' to the list of files in the comics", name);
 		g_ptr_array_add (array, g_strdup (name));
+
+		/* Collect page sizes in the same pass */
+		if (!g_hash_table_contains (page_sizes, name)) {
+			ComicsPageSize *size = g_new0 (ComicsPageSize, 1);
+
+			comics_document_read_image_size (comics_document, size);
+			g_hash_table_insert (page_sizes, g_strdup (name), size);
+		}
 	}
 
 out:
@@ -280,18 +461,6 @@ out:
 	return array;
 }
 
-static GHashTable *
-save_positions (GPtrArray *page_names)
-{
-	guint i;
-	GHashTable *ht;
-
-	ht = g_hash_table_new (g_str_hash, g_str_equal);
-	for (i = 0; i < page_names->len; i++)
-		g_hash_table_insert (ht, page_names->pdata[i], GUINT_TO_POINTER(i + 1));
-	return ht;
-}
-
 /* This function chooses the archive decompression support
  * book based on its mime type. */
 static gboolean
@@ -355,8 +524,10 @@ comics_document_load (EvDocument *document,
 		      GError    **error)
 {
 	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
+	GHashTable *page_sizes;
 	gchar *mime_type;
 	GFile *file;
+	guint i;
 
 	file = g_file_new_for_uri (uri);
 	comics_document->archive_path = g_file_get_path (file);
@@ -384,16 +555,26 @@ comics_document_load (EvDocument *document,
 	g_free (mime_type);
 
 	/* Get list of files in archive */
-	comics_document->page_names = comics_document_list (comics_document, error);
-	if (!comics_document->page_names)
+	page_sizes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	comics_document->page_names = comics_document_list (comics_document, page_sizes, error);
+	if (!comics_document->page_names) {
+		g_hash_table_destroy (page_sizes);
 		return FALSE;
-
-	/* Keep an index */
-	comics_document->page_positions = save_positions (comics_document->page_names);
+	}
 
         /* Now sort the pages */
         g_ptr_array_sort (comics_document->page_names, sort_page_names);
 
+	comics_document->page_sizes = g_new0 (ComicsPageSize, comics_document->page_names->len);
+	for (i = 0; i < comics_document->page_names->len; i++) {
+		ComicsPageSize *size;
+
+		size = g_hash_table_lookup (page_sizes, g_ptr_array_index (comics_document->page_names, i));
+		if (size)
+			comics_document->page_sizes[i] = *size;
+	}
+	g_hash_table_destroy (page_sizes);
+
 	return TRUE;
 }
 
@@ -445,13 +626,27 @@ comics_document_get_page_size (EvDocument *document,
 	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
 	const char *page_path;
 	PixbufInfo info;
+	GBytes *bytes;
+	const guchar *data;
+	gsize size;
 	GError *error = NULL;
 
+	if (comics_document->page_sizes[page->index].width > 0) {
+		if (width)
+			*width = comics_document->page_sizes[page->index].width;
+		if (height)
+			*height = comics_document->page_sizes[page->index].height;
+		return;
+	}
+
+	/* Not found in the image headers, let gdk-pixbuf find out */
 	page_path = g_ptr_array_index (comics_document->page_names, page->index);
 
-	if (!archive_reopen_if_needed (comics_document, page_path, &error)) {
-		g_warning ("Fatal error opening archive: %s", error->message);
-		g_error_free (error);
+	bytes = ev_archive_read_entry (comics_document->archive, page_path, &error);
+	if (!bytes) {
+		g_warning ("Fatal error reading '%s' in archive: %s", page_path,
+			   error ? error->message : "not found");
+		g_clear_error (&error);
 		return;
 	}
 
@@ -461,48 +656,23 @@ comics_document_get_page_size (EvDocument *document,
 			  G_CALLBACK (get_page_size_prepared_cb),
 			  &info);
 
-	while (1) {
-		const char *name;
-		GError *error = NULL;
+	data = g_bytes_get_data (bytes, &size);
+	while (size > 0 && !info.got_info) {
+		gsize len = MIN (BLOCK_SIZE, size);
 
-		if (!ev_archive_read_next_header (comics_document->archive, &error)) {
-			if (error != NULL) {
-				g_warning ("Fatal error handling archive (%s): %s", G_STRFUNC, error->message);
-				g_error_free (error);
-			}
-			break;
-		}
-
-		name = ev_archive_get_entry_pathname (comics_document->archive);
-		if (g_strcmp0 (name, page_path) == 0) {
-			char buf[BLOCK_SIZE];
-			gssize read;
-			gint64 left;
-
-			left = ev_archive_get_entry_size (comics_document->archive);
-			read = ev_archive_read_data (comics_document->archive, buf,
-						     MIN(BLOCK_SIZE, left), &error);
-			while (read > 0 && !info.got_info) {
-				if (!gdk_pixbuf_loader_write (loader, (guchar *) buf, read, &error)) {
-					read = -1;
-					break;
-				}
-				left -= read;
-				read = ev_archive_read_data (comics_document->archive, buf,
-							     MIN(BLOCK_SIZE, left), &error);
-			}
-			if (read < 0) {
-				g_warning ("Fatal error reading '%s' in archive: %s", name, error->message);
-				g_error_free (error);
-			}
+		if (!gdk_pixbuf_loader_write (loader, data, len, NULL))
 			break;
-		}
+		data += len;
+		size -= len;
 	}
+	g_bytes_unref (bytes);
 
 	gdk_pixbuf_loader_close (loader, NULL);
 	g_object_unref (loader);
 
 	if (info.got_info) {
+		comics_document->page_sizes[page->index].width = info.width;
+		comics_document->page_sizes[page->index].height = info.height;
 		if (width)
 			*width = info.width;
 		if (height)
@@ -514,99 +684,221 @@ static void
 render_pixbuf_size_prepared_cb (GdkPixbufLoader *loader,
 				gint             width,
 				gint             height,
-				EvRenderContext *rc)
+				gdouble         *scale)
 {
-	// int scaled_width, scaled_height;
-    double scale = rc->scale;
-    int w = (width  * scale + 0.5);
-    int h = (height * scale + 0.5);
+	int w = (width  * *scale + 0.5);
+	int h = (height * *scale + 0.5);
 
-	// ev_render_context_compute_scaled_size (rc, width, height, &scaled_width, &scaled_height);
+	/* Lets loaders such as the JPEG one decode at the target size */
 	gdk_pixbuf_loader_set_size (loader, w, h);
 }
 
+/* Decodes a page at the given scale, without rotation. This is called from
+ * the decode threads too, so it must only use the archive and the page names.
+ */
 static GdkPixbuf *
-comics_document_render_pixbuf (EvDocument      *document,
-			       EvRenderContext *rc)
+comics_document_decode_page (ComicsDocument *comics_document,
+			     gint            page,
+			     gdouble         scale)
 {
 	GdkPixbufLoader *loader;
-	GdkPixbuf *tmp_pixbuf;
-	GdkPixbuf *rotated_pixbuf = NULL;
-	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
+	GdkPixbuf *pixbuf;
 	const char *page_path;
+	GBytes *bytes;
 	GError *error = NULL;
 
-	page_path = g_ptr_array_index (comics_document->page_names, rc->page->index);
+	page_path = g_ptr_array_index (comics_document->page_names, page);
 
-	if (!archive_reopen_if_needed (comics_document, page_path, &error)) {
-		g_warning ("Fatal error opening archive: %s", error->message);
-		g_error_free (error);
+	bytes = ev_archive_read_entry (comics_document->archive, page_path, &error);
+	if (!bytes) {
+		g_warning ("Fatal error reading '%s' in archive: %s", page_path,
+			   error ? error->message : "not found");
+		g_clear_error (&error);
 		return NULL;
 	}
 
 	loader = gdk_pixbuf_loader_new ();
 	g_signal_connect (loader, "size-prepared",
 			  G_CALLBACK (render_pixbuf_size_prepared_cb),
-			  rc);
+			  &scale);
 
-	while (1) {
-		const char *name;
+	if (g_bytes_get_size (bytes) == 0)
+		g_warning ("Read an empty file from the archive");
+	else
+		gdk_pixbuf_loader_write_bytes (loader, bytes, NULL);
+	gdk_pixbuf_loader_close (loader, NULL);
+	g_bytes_unref (bytes);
 
-		if (!ev_archive_read_next_header (comics_document->archive, &error)) {
-			if (error != NULL) {
-				g_warning ("Fatal error handling archive (%s): %s", G_STRFUNC, error->message);
-				g_error_free (error);
-			}
-			break;
-		}
+	pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+	if (pixbuf)
+		g_object_ref (pixbuf);
+	g_object_unref (loader);
 
-		name = ev_archive_get_entry_pathname (comics_document->archive);
-		if (g_strcmp0 (name, page_path) == 0) {
-			size_t size = ev_archive_get_entry_size (comics_document->archive);
-			char *buf;
-			ssize_t read;
-
-			buf = g_malloc (size);
-			read = ev_archive_read_data (comics_document->archive, buf, size, &error);
-			if (read <= 0) {
-				if (read < 0) {
-					g_warning ("Fatal error reading '%s' in archive: %s", name, error->message);
-					g_error_free (error);
-				} else {
-					g_warning ("Read an empty file from the archive");
-				}
-			} else {
-				gdk_pixbuf_loader_write (loader, (guchar *) buf, size, NULL);
-			}
-			g_free (buf);
-			gdk_pixbuf_loader_close (loader, NULL);
-			break;
-		}
+	return pixbuf;
+}
+
+static void
+comics_decoded_page_free (ComicsDecodedPage *decoded)
+{
+	g_clear_object (&decoded->pixbuf);
+	g_slice_free (ComicsDecodedPage, decoded);
+}
+
+static void
+comics_document_decode_thread (ComicsDecodedPage *decoded,
+			       ComicsDocument    *comics_document)
+{
+	GdkPixbuf *pixbuf;
+
+	pixbuf = comics_document_decode_page (comics_document, decoded->page, decoded->scale);
+
+	g_mutex_lock (&comics_document->decode_mutex);
+	decoded->pixbuf = pixbuf;
+	decoded->done = TRUE;
+	g_cond_broadcast (&comics_document->decode_cond);
+	g_mutex_unlock (&comics_document->decode_mutex);
+}
+
+/* Returns the page if it was prefetched, waiting for it if it's still
+ * being decoded.
+ */
+static GdkPixbuf *
+comics_document_get_decoded_page (ComicsDocument *comics_document,
+				  gint            page,
+				  gdouble         scale)
+{
+	ComicsDecodedPage *decoded;
+	GdkPixbuf *pixbuf = NULL;
+
+	g_mutex_lock (&comics_document->decode_mutex);
+	decoded = g_hash_table_lookup (comics_document->decoded_pages, GINT_TO_POINTER (page));
+	if (decoded && decoded->scale == scale) {
+		while (!decoded->done)
+			g_cond_wait (&comics_document->decode_cond, &comics_document->decode_mutex);
+		if (decoded->pixbuf)
+			pixbuf = g_object_ref (decoded->pixbuf);
+	}
+	g_mutex_unlock (&comics_document->decode_mutex);
+
+	return pixbuf;
+}
+
+static gboolean
+decoded_page_is_stale (gpointer key,
+		       gpointer value,
+		       gpointer user_data)
+{
+	ComicsDecodedPage *decoded = value;
+	ComicsDecodedPage *current = user_data;
+
+	/* Pages still being decoded are owned by the decode threads */
+	if (!decoded->done)
+		return FALSE;
+
+	return decoded->scale != current->scale ||
+		decoded->page < current->page - PREFETCH_PAGES_BEHIND ||
+		decoded->page > current->page + PREFETCH_PAGES_AHEAD;
+}
+
+/* Starts decoding the pages around @page at @scale, so that turning
+ * pages, one or two at a time, doesn't have to wait for the decoder.
+ * @pixbuf, the page just rendered, is kept as well, so that rendering
+ * it again, e.g. when it's scrolled back into view, doesn't decode it
+ * again.
+ */
+static void
+comics_document_prefetch (ComicsDocument *comics_document,
+			  gint            page,
+			  gdouble         scale,
+			  GdkPixbuf      *pixbuf)
+{
+	ComicsDecodedPage current;
+	gint n_pages = comics_document->page_names->len;
+	gint i;
+
+	current.page = page;
+	current.scale = scale;
+
+	g_mutex_lock (&comics_document->decode_mutex);
+	g_hash_table_foreach_remove (comics_document->decoded_pages,
+				     decoded_page_is_stale, &current);
+
+	if (pixbuf && !g_hash_table_contains (comics_document->decoded_pages, GINT_TO_POINTER (page))) {
+		ComicsDecodedPage *decoded;
+
+		decoded = g_slice_new0 (ComicsDecodedPage);
+		decoded->page = page;
+		decoded->scale = scale;
+		decoded->pixbuf = g_object_ref (pixbuf);
+		decoded->done = TRUE;
+		g_hash_table_insert (comics_document->decoded_pages, GINT_TO_POINTER (page), decoded);
 	}
 
-	tmp_pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
-	if (tmp_pixbuf) {
-		if ((rc->rotation % 360) == 0)
-			rotated_pixbuf = g_object_ref (tmp_pixbuf);
-		else
-			rotated_pixbuf = gdk_pixbuf_rotate_simple (tmp_pixbuf,
-								   360 - rc->rotation);
+	for (i = page - PREFETCH_PAGES_BEHIND; i <= page + PREFETCH_PAGES_AHEAD; i++) {
+		ComicsDecodedPage *decoded;
+
+		if (i < 0 || i >= n_pages || i == page ||
+		    g_hash_table_contains (comics_document->decoded_pages, GINT_TO_POINTER (i)))
+			continue;
+
+		decoded = g_slice_new0 (ComicsDecodedPage);
+		decoded->page = i;
+		decoded->scale = scale;
+		g_hash_table_insert (comics_document->decoded_pages, GINT_TO_POINTER (i), decoded);
+		g_thread_pool_push (comics_document->decode_pool, decoded, NULL);
 	}
-	g_object_unref (loader);
+	g_mutex_unlock (&comics_document->decode_mutex);
+}
+
+static GdkPixbuf *
+rotate_pixbuf (GdkPixbuf *pixbuf,
+	       gint       rotation)
+{
+	GdkPixbuf *rotated_pixbuf;
+
+	if ((rotation % 360) == 0)
+		return pixbuf;
+
+	rotated_pixbuf = gdk_pixbuf_rotate_simple (pixbuf, 360 - rotation);
+	g_object_unref (pixbuf);
 
 	return rotated_pixbuf;
 }
 
+static GdkPixbuf *
+comics_document_render_pixbuf (EvDocument      *document,
+			       EvRenderContext *rc)
+{
+	ComicsDocument *comics_document = COMICS_DOCUMENT (document);
+	GdkPixbuf *pixbuf;
+
+	pixbuf = comics_document_decode_page (comics_document, rc->page->index, rc->scale);
+	if (!pixbuf)
+		return NULL;
+
+	return rotate_pixbuf (pixbuf, rc->rotation);
+}
+
 static cairo_surface_t *
 comics_document_render (EvDocument      *document,
 			EvRenderContext *rc)
 {
+	ComicsDocument  *comics_document = COMICS_DOCUMENT (document);
 	GdkPixbuf       *pixbuf;
 	cairo_surface_t *surface;
 
-	pixbuf = comics_document_render_pixbuf (document, rc);
+	pixbuf = comics_document_get_decoded_page (comics_document, rc->page->index, rc->scale);
+	if (!pixbuf)
+		pixbuf = comics_document_decode_page (comics_document, rc->page->index, rc->scale);
+
+	/* Thumbnails go through comics_document_render_pixbuf(), so only
+	 * pages rendered for the view trigger a prefetch.
+	 */
+	comics_document_prefetch (comics_document, rc->page->index, rc->scale, pixbuf);
+
 	if (!pixbuf)
 		return NULL;
+	pixbuf = rotate_pixbuf (pixbuf, rc->rotation);
 	surface = ev_document_misc_surface_from_pixbuf (pixbuf);
 	g_clear_object (&pixbuf);
 
@@ -623,7 +915,13 @@ comics_document_finalize (GObject *object)
                 g_ptr_array_free (comics_document->page_names, TRUE);
 	}
 
-	g_clear_pointer (&comics_document->page_positions, g_hash_table_destroy);
+	/* Drop the pending pages and wait for those being decoded */
+	g_thread_pool_free (comics_document->decode_pool, TRUE, TRUE);
+	g_hash_table_destroy (comics_document->decoded_pages);
+	g_mutex_clear (&comics_document->decode_mutex);
+	g_cond_clear (&comics_document->decode_cond);
+
+	g_free (comics_document->page_sizes);
 	g_clear_object (&comics_document->archive);
 	g_free (comics_document->archive_path);
 	g_free (comics_document->archive_uri);
@@ -650,6 +948,17 @@ static void
 comics_document_init (ComicsDocument *comics_document)
 {
 	comics_document->archive = ev_archive_new ();
+
+	g_mutex_init (&comics_document->decode_mutex);
+	g_cond_init (&comics_document->decode_cond);
+	comics_document->decoded_pages =
+		g_hash_table_new_full (NULL, NULL, NULL,
+				       (GDestroyNotify) comics_decoded_page_free);
+	comics_document->decode_pool =
+		g_thread_pool_new ((GFunc) comics_document_decode_thread,
+				   comics_document,
+				   CLAMP (g_get_num_processors (), 1, MAX_DECODE_THREADS),
+				   FALSE, NULL);
 }
 
 static GdkPixbuf *
@@ -20,19 +20,45 @@
 #include "config.h"
 #include "ev-archive.h"
 
+#include <stdio.h>
 #include <archive.h>
 #include <archive_entry.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 
 #define BUFFER_SIZE (64 * 1024)
 
+/* Upper bound for the decompressed entries kept around for archives
+ * that can't be seeked into, such as solid RAR and 7z ones.
+ */
+#define CACHE_MAX_SIZE (64 * 1024 * 1024)
+
 struct _EvArchive {
 	GObject parent_instance;
 	EvArchiveType type;
+	char *path;
 
 	/* libarchive */
 	struct archive *libar;
 	struct archive_entry *libar_entry;
+	guint n_headers; /* Headers read since the last reset */
+
+	/* Entries in archive order, filled in by the first full pass */
+	GPtrArray *entries;
+	GHashTable *entry_positions; /* key: char *, value: uint + 1 */
+	gboolean entries_complete;
+
+	/* Header offsets, for formats whose entries can be read on their own */
+	GHashTable *offsets; /* key: char *, value: gint64 * */
+	gboolean offsets_indexed;
+
+	/* Decompressed entries, most recently used first */
+	GHashTable *cache; /* key: char *, value: GBytes */
+	GQueue cache_lru;
+	gsize cache_size;
+
+	/* Protects the state used by ev_archive_read_entry() */
+	GMutex mutex;
 };
 
 G_DEFINE_TYPE(EvArchive, ev_archive, G_TYPE_OBJECT);
@@ -53,6 +79,14 @@ ev_archive_finalize (GObject *object)
 		break;
 	}
 
+	g_ptr_array_free (archive->entries, TRUE);
+	g_hash_table_destroy (archive->entry_positions);
+	g_hash_table_destroy (archive->offsets);
+	g_hash_table_destroy (archive->cache);
+	g_queue_clear (&archive->cache_lru);
+	g_free (archive->path);
+	g_mutex_clear (&archive->mutex);
+
 	G_OBJECT_CLASS (ev_archive_parent_class)->finalize (object);
 }
 
@@ -143,6 +177,10 @@ ev_archive_open_filename (EvArchive   *archive,
 				     "Error opening archive: %s", archive_error_string (archive->libar));
 			return FALSE;
 		}
+		if (g_strcmp0 (archive->path, path) != 0) {
+			g_free (archive->path);
+			archive->path = g_strdup (path);
+		}
 		return TRUE;
 	}
 
@@ -161,6 +199,9 @@ libarchive_read_next_header (EvArchive *archive,
 			if (r != ARCHIVE_EOF)
 				g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
 					     "Error reading archive: %s", archive_error_string (archive->libar));
+			else if (archive->n_headers == archive->entries->len)
+				archive->entries_complete = TRUE;
+			archive->libar_entry = NULL;
 			return FALSE;
 		}
 
@@ -172,6 +213,19 @@ libarchive_read_next_header (EvArchive *archive,
 
 		g_debug ("At header for file '%s'", archive_entry_pathname (archive->libar_entry));
 
+		/* Remember the order of the entries during the first pass */
+		if (!archive->entries_complete &&
+		    archive->n_headers == archive->entries->len) {
+			const char *name = archive_entry_pathname (archive->libar_entry);
+			char *pathname = g_strdup (name ? name : "");
+
+			g_ptr_array_add (archive->entries, pathname);
+			if (!g_hash_table_contains (archive->entry_positions, pathname))
+				g_hash_table_insert (archive->entry_positions, pathname,
+						     GUINT_TO_POINTER (archive->entries->len));
+		}
+		archive->n_headers++;
+
 		break;
 	}
 
@@ -311,13 +365,285 @@ ev_archive_reset (EvArchive *archive)
 		g_clear_pointer (&archive->libar, archive_free);
 		libarchive_set_archive_type (archive, archive->type);
 		archive->libar_entry = NULL;
+		archive->n_headers = 0;
 		break;
 	default:
 		g_assert_not_reached ();
 	}
 }
 
+static struct archive *
+libarchive_open_at (EvArchive *archive,
+		    gint64     offset,
+		    FILE     **file)
+{
+	struct archive *libar;
+
+	*file = g_fopen (archive->path, "rb");
+	if (!*file)
+		return NULL;
+
+	if (fseeko (*file, offset, SEEK_SET) != 0) {
+		fclose (*file);
+		return NULL;
+	}
+
+	/* Without a seek callback libarchive reads the archive as a
+	 * stream, starting at the header found at @offset.
+	 */
+	libar = archive_read_new ();
+	if (archive->type == EV_ARCHIVE_TYPE_ZIP)
+		archive_read_support_format_zip_streamable (libar);
+	else
+		archive_read_support_format_tar (libar);
+
+	if (archive_read_open_FILE (libar, *file) != ARCHIVE_OK) {
+		archive_read_free (libar);
+		fclose (*file);
+		return NULL;
+	}
+
+	return libar;
+}
+
+static void
+libarchive_index_offsets (EvArchive *archive)
+{
+	struct archive       *libar;
+	struct archive_entry *entry;
+	FILE                 *file;
+
+	archive->offsets_indexed = TRUE;
+
+	libar = libarchive_open_at (archive, 0, &file);
+	if (!libar)
+		return;
+
+	while (archive_read_next_header (libar, &entry) == ARCHIVE_OK) {
+		const char *name = archive_entry_pathname (entry);
+		gint64     *offset;
+
+		if (archive_entry_filetype (entry) != AE_IFREG || !name ||
+		    g_hash_table_contains (archive->offsets, name))
+			continue;
+
+		offset = g_new (gint64, 1);
+		*offset = archive_read_header_position (libar);
+		g_hash_table_insert (archive->offsets, g_strdup (name), offset);
+	}
+
+	archive_read_free (libar);
+	fclose (file);
+}
+
+static GBytes *
+libarchive_read_data_all (struct archive        *libar,
+			  struct archive_entry  *entry,
+			  GError               **error)
+{
+	GByteArray *data;
+	gint64      size = -1;
+
+	if (archive_entry_size_is_set (entry))
+		size = archive_entry_size (entry);
+	data = g_byte_array_sized_new (size > 0 ? size + 1 : BUFFER_SIZE);
+
+	while (TRUE) {
+		guint  len = data->len;
+		gssize r;
+
+		g_byte_array_set_size (data, len + BUFFER_SIZE);
+		r = archive_read_data (libar, data->data + len, BUFFER_SIZE);
+		if (r < 0) {
+			g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     "Failed to decompress data: %s", archive_error_string (libar));
+			g_byte_array_free (data, TRUE);
+			return NULL;
+		}
+		g_byte_array_set_size (data, len + r);
+		if (r == 0)
+			break;
+	}
+
+	return g_byte_array_free_to_bytes (data);
+}
+
+static GBytes *
+libarchive_read_entry_at (EvArchive   *archive,
+			  const char  *pathname,
+			  gint64       offset,
+			  GError     **error)
+{
+	struct archive       *libar;
+	struct archive_entry *entry;
+	GBytes               *bytes = NULL;
+	FILE                 *file;
+
+	libar = libarchive_open_at (archive, offset, &file);
+	if (!libar)
+		return NULL;
+
+	if (archive_read_next_header (libar, &entry) == ARCHIVE_OK &&
+	    g_strcmp0 (archive_entry_pathname (entry), pathname) == 0)
+		bytes = libarchive_read_data_all (libar, entry, error);
+
+	archive_read_free (libar);
+	fclose (file);
+
+	return bytes;
+}
+
+static GBytes *
+libarchive_read_entry_sequential (EvArchive   *archive,
+				  const char  *pathname,
+				  GError     **error)
+{
+	guint wanted, current = 0;
+
+	wanted = GPOINTER_TO_UINT (g_hash_table_lookup (archive->entry_positions, pathname));
+	if (archive->libar_entry) {
+		const char *name = archive_entry_pathname (archive->libar_entry);
+
+		current = GPOINTER_TO_UINT (g_hash_table_lookup (archive->entry_positions, name));
+	}
+
+	/* Only move forward from the current entry, whose data may have
+	 * been consumed already.
+	 */
+	if (current == 0 || wanted == 0 || wanted <= current) {
+		ev_archive_reset (archive);
+		if (!ev_archive_open_filename (archive, archive->path, error))
+			return NULL;
+	}
+
+	while (libarchive_read_next_header (archive, error)) {
+		if (g_strcmp0 (archive_entry_pathname (archive->libar_entry), pathname) == 0)
+			return libarchive_read_data_all (archive->libar, archive->libar_entry, error);
+	}
+
+	if (error && !*error)
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			     "Entry '%s' not found in archive", pathname);
+
+	return NULL;
+}
+
+static void
+ev_archive_cache_insert (EvArchive  *archive,
+			 const char *pathname,
+			 GBytes     *bytes)
+{
+	gsize size = g_bytes_get_size (bytes);
+	char *key;
+
+	if (size > CACHE_MAX_SIZE / 4)
+		return;
+
+	while (archive->cache_size + size > CACHE_MAX_SIZE &&
+	       !g_queue_is_empty (&archive->cache_lru)) {
+		char   *oldest = g_queue_pop_tail (&archive->cache_lru);
+		GBytes *old_bytes = g_hash_table_lookup (archive->cache, oldest);
+
+		archive->cache_size -= g_bytes_get_size (old_bytes);
+		g_hash_table_remove (archive->cache, oldest);
+	}
+
+	key = g_strdup (pathname);
+	g_hash_table_insert (archive->cache, key, g_bytes_ref (bytes));
+	g_queue_push_head (&archive->cache_lru, key);
+	archive->cache_size += size;
+}
+
+static GBytes *
+ev_archive_cache_lookup (EvArchive  *archive,
+			 const char *pathname)
+{
+	GBytes *bytes;
+	GList  *link;
+
+	bytes = g_hash_table_lookup (archive->cache, pathname);
+	if (!bytes)
+		return NULL;
+
+	link = g_queue_find_custom (&archive->cache_lru, pathname, (GCompareFunc) strcmp);
+	g_queue_unlink (&archive->cache_lru, link);
+	g_queue_push_head_link (&archive->cache_lru, link);
+
+	return g_bytes_ref (bytes);
+}
+
+/**
+ * ev_archive_read_entry:
+ * @archive: an #EvArchive
+ * @pathname: the path of a regular file in the archive
+ * @error: return location for an error, or %NULL
+ *
+ * Reads the whole contents of an entry, regardless of the position of the
+ * streaming API. Zip and tar entries are read directly from the offset of
+ * their header, indexed on first use. Other formats are decompressed
+ * sequentially, and the entries read that way are kept in a bounded cache
+ * so that going back doesn't decompress the archive from the start again.
+ *
+ * The archive must have been opened with ev_archive_open_filename() once.
+ * This function may then be called from several threads at the same time,
+ * as long as the streaming API isn't used concurrently. Zip and tar
+ * entries are read with independent handles, in parallel.
+ *
+ * Returns: (transfer full): the contents of the entry, or %NULL
+ */
+GBytes *
+ev_archive_read_entry (EvArchive   *archive,
+		       const char  *pathname,
+		       GError     **error)
+{
+	GBytes *bytes;
+	gint64  offset = -1;
+
+	g_return_val_if_fail (EV_IS_ARCHIVE (archive), NULL);
+	g_return_val_if_fail (archive->type != EV_ARCHIVE_TYPE_NONE, NULL);
+	g_return_val_if_fail (archive->path != NULL, NULL);
+	g_return_val_if_fail (pathname != NULL, NULL);
+
+	if (archive->type == EV_ARCHIVE_TYPE_ZIP ||
+	    archive->type == EV_ARCHIVE_TYPE_TAR) {
+		gint64 *entry_offset;
+
+		g_mutex_lock (&archive->mutex);
+		if (!archive->offsets_indexed)
+			libarchive_index_offsets (archive);
+
+		entry_offset = g_hash_table_lookup (archive->offsets, pathname);
+		if (entry_offset)
+			offset = *entry_offset;
+		g_mutex_unlock (&archive->mutex);
+
+		if (offset >= 0) {
+			bytes = libarchive_read_entry_at (archive, pathname, offset, error);
+			if (bytes || (error && *error))
+				return bytes;
+		}
+	}
+
+	g_mutex_lock (&archive->mutex);
+	bytes = ev_archive_cache_lookup (archive, pathname);
+	if (!bytes) {
+		bytes = libarchive_read_entry_sequential (archive, pathname, error);
+		if (bytes)
+			ev_archive_cache_insert (archive, pathname, bytes);
+	}
+	g_mutex_unlock (&archive->mutex);
+
+	return bytes;
+}
+
 static void
 ev_archive_init (EvArchive *archive)
 {
+	archive->entries = g_ptr_array_new_with_free_func (g_free);
+	archive->entry_positions = g_hash_table_new (g_str_hash, g_str_equal);
+	archive->offsets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	archive->cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						(GDestroyNotify) g_bytes_unref);
+	g_queue_init (&archive->cache_lru);
+	g_mutex_init (&archive->mutex);
 }
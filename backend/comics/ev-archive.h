@@ -52,5 +52,8 @@ gssize         ev_archive_read_data          (EvArchive     *archive,
 					      gsize          count,
 					      GError       **error);
 void           ev_archive_reset              (EvArchive     *archive);
+GBytes        *ev_archive_read_entry         (EvArchive     *archive,
+					      const char    *pathname,
+					      GError       **error);
 
 G_END_DECLS
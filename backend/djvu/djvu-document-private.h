@@ -35,6 +35,15 @@ struct _DjvuDocument {
 
 	gchar            *uri;
 
+	/* Decoded pages, most recently used first */
+	GQueue            page_cache;
+
+	/* Parsed page text, most recently used first */
+	GQueue            text_cache;
+	GHashTable       *text_cache_links; /* key: page index, value: GList * */
+	guint             n_text_structures;
+	gsize             text_search_size;
+
         /* PS exporter */
         gchar		 *ps_filename;
         GString 	 *opts;
@@ -313,6 +313,74 @@ djvu_document_get_page_size (EvDocument   *document,
 				width, height, NULL);
 }
 
+/* Decoded pages are kept so that rendering the same pages at another
+ * scale or rotation doesn't decode them again.
+ */
+#define DJVU_PAGE_CACHE_SIZE 4
+
+typedef struct {
+	gint          index;
+	ddjvu_page_t *d_page;
+} DjvuCachedPage;
+
+static void
+djvu_cached_page_free (DjvuCachedPage *cached)
+{
+	ddjvu_page_release (cached->d_page);
+	g_slice_free (DjvuCachedPage, cached);
+}
+
+static gboolean
+djvu_wait_for_page (DjvuDocument *djvu_document,
+		    ddjvu_page_t *d_page)
+{
+	ddjvu_status_t status;
+
+	/* Sleep until the decoder posts a message, then process it */
+	while ((status = ddjvu_page_decoding_status (d_page)) < DDJVU_JOB_OK)
+		djvu_handle_events (djvu_document, TRUE, NULL);
+
+	return status == DDJVU_JOB_OK;
+}
+
+static ddjvu_page_t *
+djvu_document_get_page (DjvuDocument *djvu_document,
+			gint          index)
+{
+	DjvuCachedPage *cached;
+	ddjvu_page_t   *d_page;
+	GList          *l;
+
+	for (l = djvu_document->page_cache.head; l; l = l->next) {
+		cached = l->data;
+		if (cached->index == index) {
+			g_queue_unlink (&djvu_document->page_cache, l);
+			g_queue_push_head_link (&djvu_document->page_cache, l);
+
+			return cached->d_page;
+		}
+	}
+
+	d_page = ddjvu_page_create_by_pageno (djvu_document->d_document, index);
+	if (!d_page)
+		return NULL;
+
+	if (!djvu_wait_for_page (djvu_document, d_page)) {
+		ddjvu_page_release (d_page);
+		return NULL;
+	}
+
+	cached = g_slice_new (DjvuCachedPage);
+	cached->index = index;
+	cached->d_page = d_page;
+	g_queue_push_head (&djvu_document->page_cache, cached);
+
+	if (g_queue_get_length (&djvu_document->page_cache) > DJVU_PAGE_CACHE_SIZE)
+		djvu_cached_page_free (g_queue_pop_tail (&djvu_document->page_cache));
+
+	return d_page;
+}
+
 static cairo_surface_t *
 djvu_document_render (EvDocument      *document, 
 		      EvRenderContext *rc)
@@ -325,13 +393,10 @@ djvu_document_render (EvDocument      *document,
 	ddjvu_rect_t prect;
 	ddjvu_page_t *d_page;
 	ddjvu_page_rotation_t rotation;
-	gint buffer_modified;
+	gint buffer_modified = FALSE;
 	double page_width, page_height, tmp;
 
-	d_page = ddjvu_page_create_by_pageno (djvu_document->d_document, rc->page->index);
-	
-	while (!ddjvu_page_decoding_done (d_page))
-		djvu_handle_events(djvu_document, TRUE, NULL);
+	d_page = djvu_document_get_page (djvu_document, rc->page->index);
 
 	document_get_page_size (djvu_document, rc->page->index, &page_width, &page_height, NULL);
 
@@ -373,14 +438,16 @@ djvu_document_render (EvDocument      *document,
 	prect.h = page_height;
 	rrect = prect;
 
-	ddjvu_page_set_rotation (d_page, rotation);
-	
-	buffer_modified = ddjvu_page_render (d_page, DDJVU_RENDER_COLOR,
-					     &prect,
-					     &rrect,
-					     djvu_document->d_format,
-					     rowstride,
-					     pixels);
+	if (d_page) {
+		ddjvu_page_set_rotation (d_page, rotation);
+
+		buffer_modified = ddjvu_page_render (d_page, DDJVU_RENDER_COLOR,
+						     &prect,
+						     &rrect,
+						     djvu_document->d_format,
+						     rowstride,
+						     pixels);
+	}
 
 	if (!buffer_modified) {
 		cairo_t *cr = cairo_create (surface);
@@ -400,6 +467,12 @@ djvu_document_finalize (GObject *object)
 {
 	DjvuDocument *djvu_document = DJVU_DOCUMENT (object);
 
+	while (!g_queue_is_empty (&djvu_document->page_cache))
+		djvu_cached_page_free (g_queue_pop_head (&djvu_document->page_cache));
+	while (!g_queue_is_empty (&djvu_document->text_cache))
+		djvu_cached_text_free (djvu_document, g_queue_pop_head (&djvu_document->text_cache));
+	g_hash_table_destroy (djvu_document->text_cache_links);
+
 	if (djvu_document->d_document)
 	    ddjvu_document_release (djvu_document->d_document);
 	    
@@ -432,27 +505,156 @@ djvu_document_class_init (DjvuDocumentClass *klass)
 	ev_document_class->render = djvu_document_render;
 }
 
-static gchar *
-djvu_text_copy (DjvuDocument *djvu_document,
-		gint           page,
-		EvRectangle  *rectangle)
+/* The text of a page is parsed once and kept for search, selection and
+ * copy. The s-expressions of the last few pages are kept for selection;
+ * older pages only keep their search index, up to a total size.
+ */
+#define DJVU_TEXT_STRUCTURE_CACHE_SIZE  16
+#define DJVU_TEXT_SEARCH_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
+typedef struct {
+	gint          index;
+	miniexp_t     page_text; /* miniexp_nil when not kept, or no text */
+	DjvuTextPage *tpage;     /* NULL when the page has no text */
+	gsize         search_size;
+} DjvuCachedText;
+
+static miniexp_t
+djvu_document_get_page_text (DjvuDocument *djvu_document,
+			     gint          page)
 {
 	miniexp_t page_text;
-	gchar    *text = NULL;
 
-	while ((page_text =
-		ddjvu_document_get_pagetext (djvu_document->d_document,
-					     page, "char")) == miniexp_dummy)
+	while ((page_text = ddjvu_document_get_pagetext (djvu_document->d_document,
+							 page, "char")) == miniexp_dummy)
 		djvu_handle_events (djvu_document, TRUE, NULL);
 
-	if (page_text != miniexp_nil) {
-		DjvuTextPage *page = djvu_text_page_new (page_text);
-		
-		text = djvu_text_page_copy (page, rectangle);
-		djvu_text_page_free (page);
-		ddjvu_miniexp_release (djvu_document->d_document, page_text);
+	return page_text;
+}
+
+static void
+djvu_cached_text_release_structure (DjvuDocument   *djvu_document,
+				    DjvuCachedText *cached)
+{
+	if (cached->page_text == miniexp_nil)
+		return;
+
+	ddjvu_miniexp_release (djvu_document->d_document, cached->page_text);
+	cached->page_text = miniexp_nil;
+	cached->tpage->text_structure = miniexp_nil;
+	djvu_document->n_text_structures--;
+}
+
+static void
+djvu_cached_text_free (DjvuDocument   *djvu_document,
+		       DjvuCachedText *cached)
+{
+	djvu_cached_text_release_structure (djvu_document, cached);
+	djvu_document->text_search_size -= cached->search_size;
+	if (cached->tpage)
+		djvu_text_page_free (cached->tpage);
+	g_slice_free (DjvuCachedText, cached);
+}
+
+static void
+djvu_document_remove_cached_text (DjvuDocument *djvu_document,
+				  GList        *link)
+{
+	DjvuCachedText *cached = link->data;
+
+	g_hash_table_remove (djvu_document->text_cache_links, GINT_TO_POINTER (cached->index));
+	g_queue_delete_link (&djvu_document->text_cache, link);
+	djvu_cached_text_free (djvu_document, cached);
+}
+
+static void
+djvu_document_trim_text_cache (DjvuDocument *djvu_document)
+{
+	GList *l, *prev;
+
+	for (l = djvu_document->text_cache.tail;
+	     l && djvu_document->n_text_structures > DJVU_TEXT_STRUCTURE_CACHE_SIZE;
+	     l = prev) {
+		DjvuCachedText *cached = l->data;
+
+		prev = l->prev;
+		if (cached->page_text == miniexp_nil)
+			continue;
+
+		/* Keep the search index of the page, if there's one */
+		if (cached->tpage->search_prepared)
+			djvu_cached_text_release_structure (djvu_document, cached);
+		else
+			djvu_document_remove_cached_text (djvu_document, l);
 	}
 
+	while (djvu_document->text_search_size > DJVU_TEXT_SEARCH_CACHE_MAX_SIZE &&
+	       djvu_document->text_cache.length > 1)
+		djvu_document_remove_cached_text (djvu_document, djvu_document->text_cache.tail);
+}
+
+/* Returns the cached text of @page, parsing it if needed. With
+ * @need_structure the s-expressions are available in tpage->text_structure,
+ * as needed by selection, copy and djvu_text_page_prepare_search().
+ */
+static DjvuCachedText *
+djvu_document_get_text (DjvuDocument *djvu_document,
+			gint          page,
+			gboolean      need_structure)
+{
+	DjvuCachedText *cached;
+	GList          *link;
+
+	link = g_hash_table_lookup (djvu_document->text_cache_links, GINT_TO_POINTER (page));
+	if (link) {
+		cached = link->data;
+		g_queue_unlink (&djvu_document->text_cache, link);
+		g_queue_push_head_link (&djvu_document->text_cache, link);
+
+		if (!need_structure || !cached->tpage || cached->page_text != miniexp_nil)
+			return cached;
+
+		cached->page_text = djvu_document_get_page_text (djvu_document, page);
+		if (cached->page_text == miniexp_nil) {
+			/* Text went away, treat the page as not cached */
+			djvu_document_remove_cached_text (djvu_document, link);
+			return djvu_document_get_text (djvu_document, page, need_structure);
+		}
+		cached->tpage->text_structure = cached->page_text;
+		djvu_document->n_text_structures++;
+		djvu_document_trim_text_cache (djvu_document);
+
+		return cached;
+	}
+
+	cached = g_slice_new0 (DjvuCachedText);
+	cached->index = page;
+	cached->page_text = djvu_document_get_page_text (djvu_document, page);
+	if (cached->page_text != miniexp_nil) {
+		cached->tpage = djvu_text_page_new (cached->page_text);
+		djvu_document->n_text_structures++;
+	}
+
+	g_queue_push_head (&djvu_document->text_cache, cached);
+	g_hash_table_insert (djvu_document->text_cache_links, GINT_TO_POINTER (page),
+			     djvu_document->text_cache.head);
+	djvu_document_trim_text_cache (djvu_document);
+
+	return cached;
+}
+
+static gchar *
+djvu_text_copy (DjvuDocument *djvu_document,
+		gint           page,
+		EvRectangle  *rectangle)
+{
+	DjvuCachedText *cached;
+	gchar          *text = NULL;
+
+	cached = djvu_document_get_text (djvu_document, page, TRUE);
+	if (cached->tpage)
+		text = djvu_text_page_copy (cached->tpage, rectangle);
+
 	return text;
 }
 
@@ -475,22 +677,16 @@ djvu_selection_get_selection_rects (DjvuDocument    *djvu_document,
 				    gdouble          height,
 				    gdouble          dpi)
 {
-	miniexp_t   page_text;
-	EvRectangle rectangle;
-	GList      *rects = NULL;
+	DjvuCachedText *cached;
+	EvRectangle     rectangle;
+	GList          *rects = NULL;
 
 	djvu_convert_to_doc_rect (&rectangle, points, height, dpi);
 
-	while ((page_text = ddjvu_document_get_pagetext (djvu_document->d_document,
-							 page, "char")) == miniexp_dummy)
-		djvu_handle_events (djvu_document, TRUE, NULL);
-
-	if (page_text != miniexp_nil) {
-		DjvuTextPage *tpage = djvu_text_page_new (page_text);
-
-		rects = djvu_text_page_get_selection_region (tpage, &rectangle);
-		djvu_text_page_free (tpage);
-		ddjvu_miniexp_release (djvu_document->d_document, page_text);
+	cached = djvu_document_get_text (djvu_document, page, TRUE);
+	if (cached->tpage) {
+		rects = djvu_text_page_get_selection_region (cached->tpage, &rectangle);
+		cached->tpage->results = NULL;
 	}
 
 	return rects;
@@ -729,6 +925,9 @@ djvu_document_init (DjvuDocument *djvu_document)
 	djvu_document->opts = g_string_new ("");
 	
 	djvu_document->d_document = NULL;
+	g_queue_init (&djvu_document->page_cache);
+	g_queue_init (&djvu_document->text_cache);
+	djvu_document->text_cache_links = g_hash_table_new (NULL, NULL);
 }
 
 static GList *
@@ -738,27 +937,34 @@ djvu_document_find_find_text (EvDocumentFind   *document,
 			      gboolean          case_sensitive)
 {
         DjvuDocument *djvu_document = DJVU_DOCUMENT (document);
-	miniexp_t page_text;
+	DjvuCachedText *cached;
+	DjvuTextPage *tpage;
 	gdouble width, height, dpi;
 	GList *matches = NULL, *l;
 
 	g_return_val_if_fail (text != NULL, NULL);
 
-	while ((page_text = ddjvu_document_get_pagetext (djvu_document->d_document,
-							 page->index,
-							 "char")) == miniexp_dummy)
-		djvu_handle_events (djvu_document, TRUE, NULL);
+	cached = djvu_document_get_text (djvu_document, page->index, FALSE);
+	tpage = cached->tpage;
+	if (tpage) {
+		if (!tpage->search_prepared ||
+		    tpage->search_case_sensitive != case_sensitive) {
+			cached = djvu_document_get_text (djvu_document, page->index, TRUE);
+			tpage = cached->tpage;
+			djvu_text_page_prepare_search (tpage, case_sensitive);
+
+			djvu_document->text_search_size -= cached->search_size;
+			cached->search_size = djvu_text_page_get_search_size (tpage);
+			djvu_document->text_search_size += cached->search_size;
+		}
 
-	if (page_text != miniexp_nil) {
-		DjvuTextPage *tpage = djvu_text_page_new (page_text);
-		
-		djvu_text_page_prepare_search (tpage, case_sensitive);
 		if (tpage->links->len > 0) {
 			djvu_text_page_search (tpage, text, case_sensitive);
 			matches = tpage->results;
+			tpage->results = NULL;
 		}
-		djvu_text_page_free (tpage);
-		ddjvu_miniexp_release (djvu_document->d_document, page_text);
+
+		djvu_document_trim_text_cache (djvu_document);
 	}
 
 	if (!matches)
@@ -214,6 +214,7 @@ GList *
 djvu_text_page_get_selection_region (DjvuTextPage *page,
                                      EvRectangle  *rectangle)
 {
+	page->results = NULL;
 	page->start = miniexp_nil;
 	page->end = miniexp_nil;
 
@@ -232,6 +233,7 @@ djvu_text_page_copy (DjvuTextPage *page,
 {
 	char* text;
 	
+	page->text = NULL;
 	page->start = miniexp_nil;
 	page->end = miniexp_nil;
 	djvu_text_page_limits (page, page->text_structure, rectangle);
@@ -248,129 +250,65 @@ djvu_text_page_copy (DjvuTextPage *page,
 /**
  * djvu_text_page_position:
  * @page: #DjvuTextPage instance
- * @position: index in the page text
+ * @position: index in the search text
  * 
- * Returns the closest s-expression that contains the given position in 
- * the page text.
+ * Returns the index of the link that contains the given position in 
+ * the search text.
  * 
- * Returns: closest s-expression
+ * Returns: index in page->links
  */
-static miniexp_t
+static guint
 djvu_text_page_position (DjvuTextPage *page, 
 			 int           position)
 {
 	GArray *links = page->links;
-	int low = 0;
-	int hi = links->len - 1;
-	int mid = 0;
-
-	g_return_val_if_fail (hi >= 0, miniexp_nil);
-
-	/* Shamelessly copied from GNU classpath */
-	while (low <= hi) {
-		mid = (low + hi) >> 1;
-		DjvuTextLink *link =
-		    &g_array_index (links, DjvuTextLink, mid);
-		if (link->position == position)
-			break;
-		else if (link->position > position)
-			hi = --mid;
-		else
-			low = mid + 1;
-	}
+	guint low = 0;
+	guint hi = links->len;
 
-	return g_array_index (page->links, DjvuTextLink, mid).pair;
-}
+	/* First link starting after the position */
+	while (low < hi) {
+		guint mid = low + (hi - low) / 2;
 
-/**
- * djvu_text_page_sexpr_process:
- * @page: #DjvuTextPage instance
- * @p: s-expression to append
- * @start: first s-expression in the selection
- * @end: last s-expression in the selection
- * 
- * Appends the rectangle defined by @p to the internal bounding box rectangle.
- * 
- * Returns: whether the end was not reached in this s-expression
- */
-static gboolean
-djvu_text_page_sexpr_process (DjvuTextPage *page, 
-                              miniexp_t     p,
-                              miniexp_t     start, 
-                              miniexp_t     end)
-{
-	if (page->bounding_box || p == start) {
-		EvRectangle *new_rectangle = ev_rectangle_new ();
-		new_rectangle->x1 = miniexp_to_int (miniexp_nth (1, p));
-		new_rectangle->y1 = miniexp_to_int (miniexp_nth (2, p));
-		new_rectangle->x2 = miniexp_to_int (miniexp_nth (3, p));
-		new_rectangle->y2 = miniexp_to_int (miniexp_nth (4, p));
-		if (page->bounding_box) {
-			djvu_text_page_union (page->bounding_box,
-					      new_rectangle);
-			g_free (new_rectangle);
-		} else
-			page->bounding_box = new_rectangle;
-		if (p == end)
-			return FALSE;
+		if (g_array_index (links, DjvuTextLink, mid).position <= position)
+			low = mid + 1;
+		else
+			hi = mid;
 	}
-	return TRUE;
-}
-
-/**
- * djvu_text_page_sexpr:
- * @page: #DjvuTextPage instance
- * @p: tree to append
- * @start: first s-expression in the selection
- * @end: last s-expression in the selection
- * 
- * Walks the tree in @p and extends the rectangle with 
- * djvu_text_page_process() for all s-expressions between @start and @end.
- * 
- * Returns: whether the end was not reached in this subtree
- */
-static gboolean
-djvu_text_page_sexpr (DjvuTextPage *page, 
-		      miniexp_t p,
-		      miniexp_t start, 
-		      miniexp_t end)
-{
-	g_return_val_if_fail (miniexp_consp (p) && miniexp_symbolp
-			      (miniexp_car (p)), FALSE);
 
-	miniexp_t deeper = miniexp_cddr (miniexp_cdddr (p));
-	while (deeper != miniexp_nil) {
-		miniexp_t str = miniexp_car (deeper);
-		if (miniexp_stringp (str)) {
-			if (!djvu_text_page_sexpr_process
-			    (page, p, start, end))
-				return FALSE;
-		} else {
-			if (!djvu_text_page_sexpr
-			    (page, str, start, end))
-				return FALSE;
-		}
-		deeper = miniexp_cdr (deeper);
-	}
-	return TRUE;
+	return low > 0 ? low - 1 : 0;
 }
 
 /**
  * djvu_text_page_box:
  * @page: #DjvuTextPage instance
- * @start: first s-expression in the selection
- * @end: last s-expression in the selection
+ * @start: index of the first link in the selection
+ * @end: index of the last link in the selection
  * 
- * Builds a rectangle that contains all s-expressions in the given range.
+ * Builds a rectangle that contains all links in the given range.
  */
 static EvRectangle *
 djvu_text_page_box (DjvuTextPage *page,
-		    miniexp_t     start, 
-		    miniexp_t     end)
+		    guint         start, 
+		    guint         end)
 {
-	page->bounding_box = NULL;
-	djvu_text_page_sexpr (page, page->text_structure, start, end);
-	return page->bounding_box;
+	EvRectangle *box = ev_rectangle_new ();
+	guint i;
+
+	for (i = start; i <= end; i++) {
+		DjvuTextLink *link = &g_array_index (page->links, DjvuTextLink, i);
+		EvRectangle   link_box;
+
+		link_box.x1 = link->x1;
+		link_box.y1 = link->y1;
+		link_box.x2 = link->x2;
+		link_box.y2 = link->y2;
+		if (i == start)
+			*box = link_box;
+		else
+			djvu_text_page_union (box, &link_box);
+	}
+
+	return box;
 }
 
 /**
@@ -380,7 +318,8 @@ djvu_text_page_box (DjvuTextPage *page,
  * @case_sensitive: do not ignore case
  * @delimit: insert spaces because of higher (sentence/paragraph/...) break
  * 
- * Appends the tree in @p to the internal text string. 
+ * Appends the tree in @p to the search text, recording the position
+ * and bounding box of every string in page->links.
  */
 static void
 djvu_text_page_append_text (DjvuTextPage *page,
@@ -400,26 +339,25 @@ djvu_text_page_append_text (DjvuTextPage *page,
 		miniexp_t data = miniexp_car (deeper);
 		if (miniexp_stringp (data)) {
 			DjvuTextLink link;
-			link.position = page->text == NULL ? 0 :
-			    strlen (page->text);
-			link.pair = p;
+
+			if (delimit && page->search_text->len > 0)
+				g_string_append_c (page->search_text, ' ');
+
+			link.position = page->search_text->len;
+			link.x1 = miniexp_to_int (miniexp_nth (1, p));
+			link.y1 = miniexp_to_int (miniexp_nth (2, p));
+			link.x2 = miniexp_to_int (miniexp_nth (3, p));
+			link.y2 = miniexp_to_int (miniexp_nth (4, p));
 			g_array_append_val (page->links, link);
 
 			token_text = (char *) miniexp_to_str (data);
-			if (!case_sensitive)
+			if (!case_sensitive) {
 				token_text = g_utf8_casefold (token_text, -1);
-			if (page->text == NULL)
-				page->text = g_strdup (token_text);
-			else {
-				char *new_text =
-				    g_strjoin (delimit ? " " : NULL,
-					       page->text, token_text,
-					       NULL);
-				g_free (page->text);
-				page->text = new_text;
-			}
-			if (!case_sensitive)
+				g_string_append (page->search_text, token_text);
 				g_free (token_text);
+			} else {
+				g_string_append (page->search_text, token_text);
+			}
 		} else
 			djvu_text_page_append_text (page, data, 
 						    case_sensitive, delimit);
@@ -434,35 +372,44 @@ djvu_text_page_append_text (DjvuTextPage *page,
  * @text: text to search
  * @case_sensitive: do not ignore case
  * 
- * Searches the page for the given text. The results list has to be 
- * externally freed afterwards.
+ * Searches the page for the given text. The page must have been prepared
+ * with djvu_text_page_prepare_search() for the same @case_sensitive. The
+ * results list has to be externally freed afterwards.
  */
 void 
 djvu_text_page_search (DjvuTextPage *page, 
 		       const char   *text,
 		       gboolean      case_sensitive)
 {
-	char *haystack = page->text;
+	char *haystack;
 	char *search_text;
 	int search_len;
 	EvRectangle *result;
+
+	page->results = NULL;
 	if (page->links->len == 0)
 		return;
 
-	search_len = strlen (text);
+	g_return_if_fail (page->search_prepared &&
+			  page->search_case_sensitive == case_sensitive);
 
 	if (case_sensitive)
 		search_text = g_strdup (text);
 	else
-		search_text = g_utf8_casefold (text, search_len);
+		search_text = g_utf8_casefold (text, -1);
+	search_len = strlen (search_text);
+	if (search_len == 0) {
+		g_free (search_text);
+		return;
+	}
 
+	haystack = page->search_text->str;
 	while ((haystack = strstr (haystack, search_text)) != NULL) {
-		int start_p = haystack - page->text;
-		miniexp_t start = djvu_text_page_position (page, start_p);
+		int start_p = haystack - page->search_text->str;
+		guint start = djvu_text_page_position (page, start_p);
 		int end_p = start_p + search_len - 1;
-		miniexp_t end = djvu_text_page_position (page, end_p);
+		guint end = djvu_text_page_position (page, end_p);
 		result = djvu_text_page_box (page, start, end);
-		g_assert (result);
 		page->results = g_list_prepend (page->results, result);
 		haystack = haystack + search_len;
 	}
@@ -478,13 +425,37 @@ djvu_text_page_search (DjvuTextPage *page,
  * @case_sensitive: do not ignore case
  * 
  * Indexes the page text and prepares the page for subsequent searches.
+ * Nothing is done if the page is already prepared for @case_sensitive;
+ * once prepared, searching doesn't need page->text_structure anymore.
  */
 void
 djvu_text_page_prepare_search (DjvuTextPage *page,
 	       		       gboolean      case_sensitive)
 {
+	if (page->search_prepared &&
+	    page->search_case_sensitive == case_sensitive)
+		return;
+
+	g_string_truncate (page->search_text, 0);
+	g_array_set_size (page->links, 0);
 	djvu_text_page_append_text (page, page->text_structure, 
-				    case_sensitive, FALSE);	
+				    case_sensitive, FALSE);
+
+	page->search_prepared = TRUE;
+	page->search_case_sensitive = case_sensitive;
+}
+
+/**
+ * djvu_text_page_get_search_size:
+ * @page: #DjvuTextPage instance
+ * 
+ * Returns: the approximate number of bytes used by the search index
+ */
+gsize
+djvu_text_page_get_search_size (DjvuTextPage *page)
+{
+	return page->search_text->allocated_len +
+		page->links->len * sizeof (DjvuTextLink);
 }
 
 /**
@@ -502,6 +473,7 @@ djvu_text_page_new (miniexp_t text)
 
 	page = g_new0 (DjvuTextPage, 1);
 	page->links = g_array_new (FALSE, FALSE, sizeof (DjvuTextLink));
+	page->search_text = g_string_new (NULL);
 	page->char_symbol = miniexp_symbol ("char");
 	page->word_symbol = miniexp_symbol ("word");
 	page->text_structure = text;
@@ -518,6 +490,7 @@ void
 djvu_text_page_free (DjvuTextPage *page)
 {
 	g_free (page->text);
+	g_string_free (page->search_text, TRUE);
 	g_array_free (page->links, TRUE);
 	g_free (page);
 }
@@ -31,11 +31,13 @@ typedef struct _DjvuTextLink DjvuTextLink;
 
 struct _DjvuTextPage {
 	char *text;
+	GString *search_text;
+	gboolean search_prepared;
+	gboolean search_case_sensitive;
 	GArray *links;
 	GList *results;
 	miniexp_t char_symbol;
 	miniexp_t word_symbol;
-	EvRectangle *bounding_box;
 	miniexp_t text_structure;
 	miniexp_t start;
 	miniexp_t end;
@@ -43,7 +45,7 @@ struct _DjvuTextPage {
 
 struct _DjvuTextLink {
 	int position;
-	miniexp_t pair;
+	int x1, y1, x2, y2;
 };
 
 typedef enum {
@@ -60,6 +62,7 @@ void          djvu_text_page_prepare_search       (DjvuTextPage *page,
 void                   djvu_text_page_search           (DjvuTextPage *page,
                                                         const char    *text,
                                                         gboolean       case_sensitive);
+gsize                  djvu_text_page_get_search_size  (DjvuTextPage *page);
 DjvuTextPage*          djvu_text_page_new              (miniexp_t     text);
 void                   djvu_text_page_free             (DjvuTextPage *page);
 
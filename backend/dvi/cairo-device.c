@@ -37,8 +37,77 @@ typedef struct {
 	Ulong fg;
 	Ulong bg;
 
+	/* Pixels of the page being rendered. Glyphs are blended here
+	 * directly, cairo is only used for rules, boxes and PS specials.
+	 */
+	guchar *data;
+	gint    stride;
 } DviCairoDevice;
 
+static void
+dvi_cairo_begin_drawing (DviCairoDevice *cairo_device)
+{
+	cairo_surface_mark_dirty (cairo_get_target (cairo_device->cr));
+}
+
+static void
+dvi_cairo_end_drawing (DviCairoDevice *cairo_device)
+{
+	cairo_surface_flush (cairo_get_target (cairo_device->cr));
+}
+
+/* Composites a glyph image (premultiplied ARGB) over the page */
+static void
+dvi_cairo_blend_glyph (DviCairoDevice  *cairo_device,
+		       cairo_surface_t *image,
+		       int              x,
+		       int              y,
+		       int              w,
+		       int              h)
+{
+	guchar *src_row, *dest_row;
+	gint    src_stride;
+	int     i, j;
+
+	cairo_surface_flush (image);
+	src_row = cairo_image_surface_get_data (image);
+	src_stride = cairo_image_surface_get_stride (image);
+	w = MIN (w, cairo_image_surface_get_width (image));
+	h = MIN (h, cairo_image_surface_get_height (image));
+	dest_row = cairo_device->data + y * cairo_device->stride + x * 4;
+
+	for (i = 0; i < h; i++) {
+		guint32 *src = (guint32 *) src_row;
+		guint32 *dest = (guint32 *) dest_row;
+
+		for (j = 0; j < w; j++) {
+			guint32 s = src[j];
+			guint32 d, ia, rb, ag;
+
+			if (s == 0)
+				continue;
+
+			ia = 0xff - (s >> 24);
+			if (ia == 0) {
+				dest[j] = s;
+				continue;
+			}
+
+			/* d * ia / 255 for two channels at a time */
+			d = dest[j];
+			rb = (d & 0x00ff00ff) * ia + 0x00800080;
+			rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+			ag = ((d >> 8) & 0x00ff00ff) * ia + 0x00800080;
+			ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+
+			dest[j] = (rb | ag) + s;
+		}
+
+		src_row += src_stride;
+		dest_row += cairo_device->stride;
+	}
+}
+
 static void
 dvi_cairo_draw_glyph (DviContext  *dvi,
 		      DviFontChar *ch,
@@ -70,22 +139,22 @@ dvi_cairo_draw_glyph (DviContext  *dvi,
 	    || y + h > cairo_image_surface_get_height (surface))
 		return;
 
-	cairo_save (cairo_device->cr);
-	if (isbox) {
-		cairo_rectangle (cairo_device->cr,
-				 x - cairo_device->xmargin,
-				 y - cairo_device->ymargin,
-				 w, h);
-		cairo_stroke (cairo_device->cr);
-	} else {
-		cairo_translate (cairo_device->cr, x, y);
-		cairo_set_source_surface (cairo_device->cr,
-					  (cairo_surface_t *) glyph->data,
-					  0, 0);
-		cairo_paint (cairo_device->cr);
+	if (!isbox) {
+		dvi_cairo_blend_glyph (cairo_device,
+				       (cairo_surface_t *) glyph->data,
+				       x, y, w, h);
+		return;
 	}
 
+	dvi_cairo_begin_drawing (cairo_device);
+	cairo_save (cairo_device->cr);
+	cairo_rectangle (cairo_device->cr,
+			 x - cairo_device->xmargin,
+			 y - cairo_device->ymargin,
+			 w, h);
+	cairo_stroke (cairo_device->cr);
 	cairo_restore (cairo_device->cr);
+	dvi_cairo_end_drawing (cairo_device);
 }
 
 static void
@@ -103,6 +172,7 @@ dvi_cairo_draw_rule (DviContext *dvi,
 
 	color = cairo_device->fg;
 	
+	dvi_cairo_begin_drawing (cairo_device);
 	cairo_save (cairo_device->cr);
 
 	cairo_set_line_width (cairo_device->cr,
@@ -123,6 +193,7 @@ dvi_cairo_draw_rule (DviContext *dvi,
 	}
 
 	cairo_restore (cairo_device->cr);
+	dvi_cairo_end_drawing (cairo_device);
 }
 
 #ifdef HAVE_SPECTRE
@@ -145,10 +216,13 @@ dvi_cairo_draw_ps (DviContext *dvi,
 
 	cairo_device = (DviCairoDevice *) dvi->device.device_data;
 
+	/* Ghostscript can only be used from one thread at a time */
+	mdvi_lock ();
 	psdoc = spectre_document_new ();
 	spectre_document_load (psdoc, filename);
 	if (spectre_document_status (psdoc)) {
 		spectre_document_free (psdoc);
+		mdvi_unlock ();
 		return;
 	}
 
@@ -163,6 +237,7 @@ dvi_cairo_draw_ps (DviContext *dvi,
 
 	spectre_render_context_free (rc);
 	spectre_document_free (psdoc);
+	mdvi_unlock ();
 
 	if (status) {
 		g_warning ("Error rendering PS document %s: %s\n",
@@ -177,6 +252,7 @@ dvi_cairo_draw_ps (DviContext *dvi,
 						     width, height,
 						     row_length);
 
+	dvi_cairo_begin_drawing (cairo_device);
 	cairo_save (cairo_device->cr);
 
 	cairo_translate (cairo_device->cr,
@@ -186,6 +262,7 @@ dvi_cairo_draw_ps (DviContext *dvi,
 	cairo_paint (cairo_device->cr);
 
 	cairo_restore (cairo_device->cr);
+	dvi_cairo_end_drawing (cairo_device);
 
 	cairo_surface_destroy (image);
 	free (data);
@@ -233,7 +310,15 @@ dvi_cairo_create_image (void *device_data,
 			Uint  height,
 			Uint  bpp)
 {
-	return cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	cairo_surface_t *surface;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	/* per cairo docs, must flush before modifying outside of cairo.
+	 * Nothing but put_pixel touches the image until image_done.
+	 */
+	cairo_surface_flush (surface);
+
+	return surface;
 }
 
 static void
@@ -254,8 +339,6 @@ dvi_cairo_put_pixel (void *image, int x, int y, Ulong color)
 	rowstride = cairo_image_surface_get_stride (surface);
 	p = (guint32*) (cairo_image_surface_get_data (surface) + y * rowstride + x * 4);
 
-        /* per cairo docs, must flush before modifying outside of cairo */
-        cairo_surface_flush(surface);
 	*p = color;
 }
 
@@ -344,7 +427,14 @@ mdvi_cairo_device_render (DviContext* dvi)
         cairo_set_source_rgb (cairo_device->cr, 1., 1., 1.);
         cairo_paint (cairo_device->cr);
 
+	cairo_surface_flush (surface);
+	cairo_device->data = cairo_image_surface_get_data (surface);
+	cairo_device->stride = cairo_image_surface_get_stride (surface);
+
 	mdvi_dopage (dvi, dvi->currpage);
+
+	cairo_surface_mark_dirty (surface);
+	cairo_device->data = NULL;
 }
 
 void
@@ -35,7 +35,11 @@
 #include <sys/wait.h>
 #include <stdlib.h>
 
-GMutex dvi_context_mutex;
+/* Protects the fonts and glyphs shared by all the contexts */
+static GRecMutex mdvi_mutex;
+
+/* Number of pages that can be rendered at the same time */
+#define MAX_RENDER_CONTEXTS 3
 
 enum {
 	PROP_0,
@@ -64,6 +68,14 @@ struct _DviDocument
 	/* PDF exporter */
 	gchar		 *exporter_filename;
 	GString 	 *exporter_opts;
+
+	/* Contexts over the same file, idle ones are in idle_contexts.
+	 * The main context is one of them.
+	 */
+	GMutex            contexts_mutex;
+	GCond             contexts_cond;
+	GQueue            idle_contexts;
+	guint             n_contexts;
 };
 
 typedef struct _DviDocumentClass DviDocumentClass;
@@ -80,6 +92,99 @@ EV_BACKEND_REGISTER_WITH_CODE (DviDocument, dvi_document,
       EV_BACKEND_IMPLEMENT_INTERFACE (EV_TYPE_FILE_EXPORTER, dvi_document_file_exporter_iface_init);
      });
 
+static void
+dvi_document_lock_mdvi (void)
+{
+	g_rec_mutex_lock (&mdvi_mutex);
+}
+
+static void
+dvi_document_unlock_mdvi (void)
+{
+	g_rec_mutex_unlock (&mdvi_mutex);
+}
+
+static DviContext *
+dvi_document_create_context (DviDocument *dvi_document,
+			     const gchar *filename)
+{
+	DviContext *context;
+
+	g_rec_mutex_lock (&mdvi_mutex);
+	context = mdvi_init_context (dvi_document->params, dvi_document->spec, filename);
+	g_rec_mutex_unlock (&mdvi_mutex);
+
+	if (context)
+		mdvi_cairo_device_init (&context->device);
+
+	return context;
+}
+
+static void
+dvi_document_destroy_context (DviContext *context)
+{
+	g_rec_mutex_lock (&mdvi_mutex);
+	mdvi_cairo_device_free (&context->device);
+	mdvi_destroy_context (context);
+	g_rec_mutex_unlock (&mdvi_mutex);
+}
+
+static void
+dvi_document_clear_contexts (DviDocument *dvi_document)
+{
+	DviContext *context;
+
+	g_mutex_lock (&dvi_document->contexts_mutex);
+	/* Only called when nothing is being rendered */
+	g_assert (g_queue_get_length (&dvi_document->idle_contexts) == dvi_document->n_contexts);
+	while ((context = g_queue_pop_head (&dvi_document->idle_contexts)))
+		dvi_document_destroy_context (context);
+	dvi_document->n_contexts = 0;
+	dvi_document->context = NULL;
+	g_mutex_unlock (&dvi_document->contexts_mutex);
+}
+
+/* Takes an idle context for rendering a page, opening another one on
+ * the same file when all of them are busy.
+ */
+static DviContext *
+dvi_document_acquire_context (DviDocument *dvi_document)
+{
+	DviContext *context;
+
+	g_mutex_lock (&dvi_document->contexts_mutex);
+	while (g_queue_is_empty (&dvi_document->idle_contexts)) {
+		if (dvi_document->n_contexts < MAX_RENDER_CONTEXTS) {
+			dvi_document->n_contexts++;
+			g_mutex_unlock (&dvi_document->contexts_mutex);
+
+			context = dvi_document_create_context (dvi_document,
+							       dvi_document->context->filename);
+			if (context)
+				return context;
+
+			g_mutex_lock (&dvi_document->contexts_mutex);
+			dvi_document->n_contexts--;
+		}
+
+		g_cond_wait (&dvi_document->contexts_cond, &dvi_document->contexts_mutex);
+	}
+	context = g_queue_pop_head (&dvi_document->idle_contexts);
+	g_mutex_unlock (&dvi_document->contexts_mutex);
+
+	return context;
+}
+
+static void
+dvi_document_release_context (DviDocument *dvi_document,
+			      DviContext  *context)
+{
+	g_mutex_lock (&dvi_document->contexts_mutex);
+	g_queue_push_head (&dvi_document->idle_contexts, context);
+	g_cond_signal (&dvi_document->contexts_cond);
+	g_mutex_unlock (&dvi_document->contexts_mutex);
+}
+
 static gboolean
 dvi_document_load (EvDocument  *document,
 		   const char  *uri,
@@ -92,12 +197,9 @@ dvi_document_load (EvDocument  *document,
 	if (!filename)
         	return FALSE;
 	
-	g_mutex_lock (&dvi_context_mutex);
-	if (dvi_document->context)
-		mdvi_destroy_context (dvi_document->context);
+	dvi_document_clear_contexts (dvi_document);
 
-	dvi_document->context = mdvi_init_context(dvi_document->params, dvi_document->spec, filename);
-	g_mutex_unlock (&dvi_context_mutex);
+	dvi_document->context = dvi_document_create_context (dvi_document, filename);
 	g_free (filename);
 	
 	if (!dvi_document->context) {
@@ -108,7 +210,8 @@ dvi_document_load (EvDocument  *document,
         	return FALSE;
 	}
 	
-	mdvi_cairo_device_init (&dvi_document->context->device);
+	g_queue_push_head (&dvi_document->idle_contexts, dvi_document->context);
+	dvi_document->n_contexts = 1;
 	
 	
 	dvi_document->base_width = dvi_document->context->dvi_page_w * dvi_document->context->params.conv 
@@ -161,38 +264,38 @@ dvi_document_render (EvDocument      *document,
 	cairo_surface_t *surface;
 	cairo_surface_t *rotated_surface;
 	DviDocument *dvi_document = DVI_DOCUMENT(document);
+	DviContext *context;
 	gint required_width, required_height;
 	gint proposed_width, proposed_height;
 	gint xmargin = 0, ymargin = 0;
 
-	/* We should protect our context since it's not 
-	 * thread safe. The work to the future - 
-	 * let context render page independently
+	/* A context is not thread safe, but each page being rendered
+	 * gets its own one. Only the fonts are shared, mdvi locks them.
 	 */
-	g_mutex_lock (&dvi_context_mutex);
+	context = dvi_document_acquire_context (dvi_document);
 	
-	mdvi_setpage (dvi_document->context, rc->page->index);
+	mdvi_setpage (context, rc->page->index);
 	
-	mdvi_set_shrink (dvi_document->context, 
+	mdvi_set_shrink (context, 
 			 (int)((dvi_document->params->hshrink - 1) / rc->scale) + 1,
 			 (int)((dvi_document->params->vshrink - 1) / rc->scale) + 1);
 
 	required_width = dvi_document->base_width * rc->scale + 0.5;
 	required_height = dvi_document->base_height * rc->scale + 0.5;
-	proposed_width = dvi_document->context->dvi_page_w * dvi_document->context->params.conv;
-	proposed_height = dvi_document->context->dvi_page_h * dvi_document->context->params.vconv;
+	proposed_width = context->dvi_page_w * context->params.conv;
+	proposed_height = context->dvi_page_h * context->params.vconv;
 	
 	if (required_width >= proposed_width)
 	    xmargin = (required_width - proposed_width) / 2;
 	if (required_height >= proposed_height)
 	    ymargin = (required_height - proposed_height) / 2;
 	    
-	mdvi_cairo_device_set_margins (&dvi_document->context->device, xmargin, ymargin);
-	mdvi_cairo_device_set_scale (&dvi_document->context->device, rc->scale);
-	mdvi_cairo_device_render (dvi_document->context);
-	surface = mdvi_cairo_device_get_surface (&dvi_document->context->device);
+	mdvi_cairo_device_set_margins (&context->device, xmargin, ymargin);
+	mdvi_cairo_device_set_scale (&context->device, rc->scale);
+	mdvi_cairo_device_render (context);
+	surface = mdvi_cairo_device_get_surface (&context->device);
 
-	g_mutex_unlock (&dvi_context_mutex);
+	dvi_document_release_context (dvi_document, context);
 
 	rotated_surface = ev_document_misc_surface_rotate_and_scale (surface,
 								     required_width,
@@ -208,12 +311,9 @@ dvi_document_finalize (GObject *object)
 {	
 	DviDocument *dvi_document = DVI_DOCUMENT(object);
 	
-	g_mutex_lock (&dvi_context_mutex);
-	if (dvi_document->context) {
-		mdvi_cairo_device_free (&dvi_document->context->device);
-		mdvi_destroy_context (dvi_document->context);
-	}
-	g_mutex_unlock (&dvi_context_mutex);
+	dvi_document_clear_contexts (dvi_document);
+	g_mutex_clear (&dvi_document->contexts_mutex);
+	g_cond_clear (&dvi_document->contexts_cond);
 
 	if (dvi_document->params)
 		g_free (dvi_document->params);
@@ -244,6 +344,7 @@ dvi_document_class_init (DviDocumentClass *klass)
 	gobject_class->finalize = dvi_document_finalize;
 
 	mdvi_init_kpathsea ("xreader", MDVI_MFMODE, MDVI_FALLBACK_FONT, MDVI_DPI, getenv("TEXMFCNF"));
+	mdvi_set_lock_functions (dvi_document_lock_mdvi, dvi_document_unlock_mdvi);
 
 	mdvi_register_special ("Color", "color", NULL, dvi_document_do_color_special, 1);
 	mdvi_register_fonts ();
@@ -281,6 +382,7 @@ dvi_document_thumbnails_get_thumbnail (EvDocumentThumbnails *document,
 				       gboolean 	     border)
 {
 	DviDocument *dvi_document = DVI_DOCUMENT (document);
+	DviContext *context;
 	GdkPixbuf *pixbuf;
 	GdkPixbuf *rotated_pixbuf;
 	cairo_surface_t *surface;
@@ -290,31 +392,31 @@ dvi_document_thumbnails_get_thumbnail (EvDocumentThumbnails *document,
 	thumb_width = (gint) (dvi_document->base_width * rc->scale);
 	thumb_height = (gint) (dvi_document->base_height * rc->scale);
 
-	g_mutex_lock (&dvi_context_mutex);
+	context = dvi_document_acquire_context (dvi_document);
 	
-	mdvi_setpage (dvi_document->context, rc->page->index);
+	mdvi_setpage (context, rc->page->index);
 
-	mdvi_set_shrink (dvi_document->context, 
+	mdvi_set_shrink (context, 
 			  (int)dvi_document->base_width * dvi_document->params->hshrink / thumb_width,
 			  (int)dvi_document->base_height * dvi_document->params->vshrink / thumb_height);
 
-	proposed_width = dvi_document->context->dvi_page_w * dvi_document->context->params.conv;
-	proposed_height = dvi_document->context->dvi_page_h * dvi_document->context->params.vconv;
+	proposed_width = context->dvi_page_w * context->params.conv;
+	proposed_height = context->dvi_page_h * context->params.vconv;
 			  
 	if (border) {
-	 	mdvi_cairo_device_set_margins (&dvi_document->context->device, 
+	 	mdvi_cairo_device_set_margins (&context->device, 
 					       MAX (thumb_width - proposed_width, 0) / 2,
 					       MAX (thumb_height - proposed_height, 0) / 2); 	
 	} else {
-	 	mdvi_cairo_device_set_margins (&dvi_document->context->device, 
+	 	mdvi_cairo_device_set_margins (&context->device, 
 					       MAX (thumb_width - proposed_width - 2, 0) / 2,
 					       MAX (thumb_height - proposed_height - 2, 0) / 2); 	
 	}
 
-	mdvi_cairo_device_set_scale (&dvi_document->context->device, rc->scale);
-        mdvi_cairo_device_render (dvi_document->context);
-	surface = mdvi_cairo_device_get_surface (&dvi_document->context->device);
-	g_mutex_unlock (&dvi_context_mutex);
+	mdvi_cairo_device_set_scale (&context->device, rc->scale);
+        mdvi_cairo_device_render (context);
+	surface = mdvi_cairo_device_get_surface (&context->device);
+	dvi_document_release_context (dvi_document, context);
 
 	pixbuf = ev_document_misc_pixbuf_from_surface (surface);
 	cairo_surface_destroy (surface);
@@ -596,6 +698,11 @@ dvi_document_init (DviDocument *dvi_document)
 	dvi_document->context = NULL;
 	dvi_document_init_params (dvi_document);
 
+	g_mutex_init (&dvi_document->contexts_mutex);
+	g_cond_init (&dvi_document->contexts_cond);
+	g_queue_init (&dvi_document->idle_contexts);
+	dvi_document->n_contexts = 0;
+
 	dvi_document->exporter_filename = NULL;
 	dvi_document->exporter_opts = NULL;
 }
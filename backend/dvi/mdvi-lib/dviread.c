@@ -633,8 +633,14 @@ int mdvi_configure(DviContext *dvi, DviParamCode option, ...)
 	 * the DVI file again from scratch.
 	 */
 
-	if(reset_all)
-		return (mdvi_reload(dvi, &np) == 0);
+	if(reset_all) {
+		int	status;
+
+		mdvi_lock();
+		status = mdvi_reload(dvi, &np);
+		mdvi_unlock();
+		return (status == 0);
+	}
 
 	if(np.hshrink != dvi->params.hshrink) {
 		np.conv = dvi->dviconv;
@@ -648,7 +654,9 @@ int mdvi_configure(DviContext *dvi, DviParamCode option, ...)
 	}
 
 	if(reset_font) {
+		mdvi_lock();
 		font_reset_chain_glyphs(&dvi->device, dvi->fonts, reset_font);
+		mdvi_unlock();
 	}
 	dvi->params = np;	
 	if((reset_font & MDVI_FONTSEL_GLYPH) && dvi->device.refresh) {
@@ -1020,7 +1028,9 @@ again:
 	
 	/* check if we need to reload the file */
 	if(!reloaded && get_mtime(fileno(dvi->in)) > dvi->modtime) {
+		mdvi_lock();
 		mdvi_reload(dvi, &dvi->params);
+		mdvi_unlock();
 		/* we have to reopen the file, again */
 		reloaded = 1;
 		goto again;
@@ -1246,6 +1256,7 @@ int	set_char(DviContext *dvi, int opcode)
 	int	num;
 	int	h;
 	int	hh;
+	Int32	tfmwidth;
 	DviFontChar *ch;
 	DviFont	*font;
 	
@@ -1258,11 +1269,14 @@ int	set_char(DviContext *dvi, int opcode)
 		return -1;
 	}
 	font = dvi->currfont->ref;
+	/* the glyph is only ours until it's drawn */
+	mdvi_lock();
 	ch = font_get_glyph(dvi, font, num);
 	if(ch == NULL || ch->missing) {
 		/* try to display something anyway */
 		ch = FONTCHAR(font, num);
 		if(!glyph_present(ch)) {
+			mdvi_unlock();
 			dviwarn(dvi, 
 			_("requested character %d does not exist in `%s'\n"), 
 				num, font->fontname);
@@ -1277,16 +1291,18 @@ int	set_char(DviContext *dvi, int opcode)
 			dvi->device.draw_glyph(dvi, ch, 
 				dvi->pos.hh, dvi->pos.vv);
 	}
+	tfmwidth = ch->tfmwidth;
+	mdvi_unlock();
 	if(opcode >= DVI_PUT1 && opcode <= DVI_PUT4) {
 		SHOWCMD((dvi, "putchar", opcode - DVI_PUT1 + 1,
 			"char %d (%s)\n",
 			num, dvi->currfont->ref->fontname));
 	} else {
-		h = dvi->pos.h + ch->tfmwidth;
-		hh = dvi->pos.hh + pixel_round(dvi, ch->tfmwidth);
+		h = dvi->pos.h + tfmwidth;
+		hh = dvi->pos.hh + pixel_round(dvi, tfmwidth);
 		SHOWCMD((dvi, "setchar", num, "(%d,%d) h:=%d%c%d=%d, hh:=%d (%s)\n",
 			dvi->pos.hh, dvi->pos.vv,
-			DBGSUM(dvi->pos.h, ch->tfmwidth, h), hh,
+			DBGSUM(dvi->pos.h, tfmwidth, h), hh,
 			font->fontname));
 		dvi->pos.h  = h;
 		dvi->pos.hh = hh;
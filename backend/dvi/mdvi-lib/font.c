@@ -24,6 +24,26 @@
 #include "private.h"
 
 static ListHead fontlist;
+static DviLockFunc lock_func = NULL;
+static DviLockFunc unlock_func = NULL;
+
+void	mdvi_set_lock_functions(DviLockFunc lock, DviLockFunc unlock)
+{
+	lock_func = lock;
+	unlock_func = unlock;
+}
+
+void	mdvi_lock(void)
+{
+	if(lock_func)
+		lock_func();
+}
+
+void	mdvi_unlock(void)
+{
+	if(unlock_func)
+		unlock_func();
+}
 
 extern char *_mdvi_fallback_font;
 
@@ -344,6 +364,70 @@ static int load_one_glyph(DviContext *dvi, DviFont *font, int code)
 	return 0;
 }
 
+/* 
+ * Anti-aliased glyphs are kept per character for the last few
+ * (shrink, colors, gamma) combinations, so that going back to a zoom
+ * level does not shrink every glyph of the page again. They are only
+ * destroyed along with the unshrunk glyph they were made from.
+ */
+static void font_get_grey_glyph(DviContext *dvi, DviFont *font, DviFontChar *ch)
+{
+	DviGreyGlyph *grey, *prev, *last;
+	int	count;
+
+	prev = NULL;
+	last = NULL;
+	count = 0;
+	for(grey = ch->grey_cache; grey; grey = grey->next) {
+		if(grey->hshrink == dvi->params.hshrink &&
+		   grey->vshrink == dvi->params.vshrink &&
+		   grey->fg == dvi->curr_fg &&
+		   grey->bg == dvi->curr_bg &&
+		   grey->gamma == dvi->params.gamma)
+			break;
+		last = prev;
+		prev = grey;
+		count++;
+	}
+
+	if(grey) {
+		/* move it to the front */
+		if(prev) {
+			prev->next = grey->next;
+			grey->next = ch->grey_cache;
+			ch->grey_cache = grey;
+		}
+		ch->grey = grey->glyph;
+		ch->fg = grey->fg;
+		ch->bg = grey->bg;
+		return;
+	}
+
+	if(count >= MDVI_GREY_CACHE_SIZE) {
+		/* reuse the least recently used entry */
+		grey = prev;
+		if(last)
+			last->next = NULL;
+		else
+			ch->grey_cache = NULL;
+		if(MDVI_GLYPH_NONEMPTY(grey->glyph.data) && dvi->device.free_image)
+			dvi->device.free_image(grey->glyph.data);
+	} else
+		grey = xalloc(DviGreyGlyph);
+
+	ch->grey.data = NULL;
+	font->finfo->shrink1(dvi, font, ch, &ch->grey);
+
+	grey->hshrink = dvi->params.hshrink;
+	grey->vshrink = dvi->params.vshrink;
+	grey->fg = dvi->curr_fg;
+	grey->bg = dvi->curr_bg;
+	grey->gamma = dvi->params.gamma;
+	grey->glyph = ch->grey;
+	grey->next = ch->grey_cache;
+	ch->grey_cache = grey;
+}
+
 DviFontChar *font_get_glyph(DviContext *dvi, DviFont *font, int code)
 {
 	DviFontChar *ch;
@@ -379,18 +463,11 @@ again:
 			mdvi_shrink_box(dvi, font, ch, &ch->shrunk);
 		return ch;
 	} else if(MDVI_ENABLED(dvi, MDVI_PARAM_ANTIALIASED)) {
-		if(ch->grey.data && 
-		   !MDVI_GLYPH_ISEMPTY(ch->grey.data) &&
-		   ch->fg == dvi->curr_fg && 
-		   ch->bg == dvi->curr_bg)
-		   	return ch;
-		if(ch->grey.data &&
-		   !MDVI_GLYPH_ISEMPTY(ch->grey.data)) {
-			if(dvi->device.free_image)
-				dvi->device.free_image(ch->grey.data);
-			ch->grey.data = NULL;
-		}
-		font->finfo->shrink1(dvi, font, ch, &ch->grey);
+		/* 
+		 * Always go through the cache: ch->grey may have been
+		 * bound by another context at a different shrink factor
+		 */
+		font_get_grey_glyph(dvi, font, ch);
 	} else if(!ch->shrunk.data)
 		font->finfo->shrink0(dvi, font, ch, &ch->shrunk);
 
@@ -407,13 +484,18 @@ void	font_reset_one_glyph(DviDevice *dev, DviFontChar *ch, int what)
 		ch->shrunk.data = NULL;
 	}
 	if(what & MDVI_FONTSEL_GREY) {
-		if(MDVI_GLYPH_NONEMPTY(ch->grey.data)) {
-			if(dev->free_image)
-				dev->free_image(ch->grey.data);
-		}
+		/* the image itself belongs to grey_cache */
 		ch->grey.data = NULL;
 	}
 	if(what & MDVI_FONTSEL_GLYPH) {
+		DviGreyGlyph *grey;
+
+		for(; (grey = ch->grey_cache); ) {
+			ch->grey_cache = grey->next;
+			if(MDVI_GLYPH_NONEMPTY(grey->glyph.data) && dev->free_image)
+				dev->free_image(grey->glyph.data);
+			mdvi_free(grey);
+		}
 		if(MDVI_GLYPH_NONEMPTY(ch->glyph.data))
 			bitmap_destroy((BITMAP *)ch->glyph.data);
 		ch->glyph.data = NULL;
@@ -29,6 +29,7 @@
 #include "dviopcodes.h"
 
 typedef struct _DviGlyph DviGlyph;
+typedef struct _DviGreyGlyph DviGreyGlyph;
 typedef struct _DviDevice DviDevice;
 typedef struct _DviFontChar DviFontChar;
 typedef struct _DviFontRef DviFontRef;
@@ -155,6 +156,20 @@ struct _DviGlyph {
 	void	*data;	/* bitmap or XImage */
 };
 
+/* an anti-aliased glyph, kept for as long as its unshrunk bitmap is */
+struct _DviGreyGlyph {
+	DviGreyGlyph *next;
+	Uint	hshrink;
+	Uint	vshrink;
+	Ulong	fg;
+	Ulong	bg;
+	double	gamma;
+	DviGlyph glyph;
+};
+
+/* number of anti-aliased versions kept for each glyph */
+#define MDVI_GREY_CACHE_SIZE	4
+
 typedef void (*DviFontShrinkFunc) 
 	__PROTO((DviContext *, DviFont *, DviFontChar *, DviGlyph *));
 typedef int (*DviFontLoadFunc) __PROTO((DviParams *, DviFont *));
@@ -200,7 +215,8 @@ struct _DviFontChar {
 	/* data for shrunk bitimaps */
 	DviGlyph glyph;
 	DviGlyph shrunk;
-	DviGlyph grey;
+	DviGlyph grey;	/* points into grey_cache */
+	DviGreyGlyph *grey_cache;
 };
 
 struct _DviFontRef {
@@ -594,6 +610,17 @@ extern void font_transform_glyph __PROTO((DviOrientation, DviGlyph *));
 /* destroy all fonts that are not being used, returns number of fonts freed */
 extern int font_free_unused __PROTO((DviDevice *));
 
+/*
+ * Fonts and their glyphs are shared by all contexts. An application
+ * that renders from several threads provides a (recursive) lock for
+ * them, which MDVI takes around every access.
+ */
+typedef void (*DviLockFunc) __PROTO((void));
+
+extern void mdvi_set_lock_functions __PROTO((DviLockFunc, DviLockFunc));
+extern void mdvi_lock __PROTO((void));
+extern void mdvi_unlock __PROTO((void));
+
 #define font_free_glyph(dev, font, code) \
 	font_reset_one_glyph((dev), \
 	FONTCHAR((font), (code)), MDVI_FONTSEL_GLYPH)
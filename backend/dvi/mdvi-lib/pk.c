@@ -503,6 +503,7 @@ static int pk_load_font(DviParams *unused, DviFont *font)
 			font->chars[cc].glyph.w = w;
 			font->chars[cc].glyph.h = h;
 			font->chars[cc].grey.data = NULL;
+			font->chars[cc].grey_cache = NULL;
 			font->chars[cc].shrunk.data = NULL;
 			font->chars[cc].tfmwidth = TFMSCALE(z, tfm, alpha, beta);
 			font->chars[cc].loaded = 0;
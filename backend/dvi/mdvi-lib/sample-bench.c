@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2026, the xreader developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Microbenchmark for do_sample(), which counts the set bits of every box
+ * that becomes one pixel of a shrunk glyph. Every box size from 1x1 to
+ * 32x32 is sampled over a random bitmap, checked against a bit by bit
+ * count, and timed with the lookup table and, where the CPU has one, with
+ * the population count instruction.
+ *
+ * Run with `meson test --benchmark mdvi-sample'.
+ */
+
+#include "bitmap.c"
+
+#include <time.h>
+
+#define BENCH_WIDTH	1024
+#define BENCH_HEIGHT	1024
+#define BENCH_MAX_BOX	32
+#define BENCH_ROUNDS	20
+#define BENCH_REPEATS	5
+
+static int count_bits(BmUnit *data, int stride, int step, int w, int h)
+{
+	int	x, y, n;
+
+	n = 0;
+	for(y = 0; y < h; y++) {
+		BmUnit	*row = bm_offset(data, y * stride);
+
+		for(x = step; x < step + w; x++)
+			if(row[x / BITMAP_BITS] & FIRSTMASKAT(x))
+				n++;
+	}
+	return n;
+}
+
+/* Samples the bitmap in w x h boxes, as mdvi_shrink_glyph_grey() does */
+static long sample_bitmap(BITMAP *map, int w, int h, int check)
+{
+	BmUnit	*row;
+	long	total;
+	int	x, y;
+
+	total = 0;
+	for(y = 0; y + h <= map->height; y += h) {
+		row = bm_offset(map->data, y * map->stride);
+		for(x = 0; x + w <= map->width; x += w) {
+			int	n = do_sample(row, map->stride, x, w, h);
+
+			if(check && n != count_bits(row, map->stride, x, w, h)) {
+				fprintf(stderr, "wrong count for a %dx%d box at %d,%d\n",
+					w, h, x, y);
+				exit(1);
+			}
+			total += n;
+		}
+	}
+	return total;
+}
+
+/* Best of BENCH_REPEATS runs, in nanoseconds per box */
+static double time_boxes(BITMAP *map, int w, int h)
+{
+	struct timespec start, end;
+	double	best, ns;
+	long	boxes;
+	volatile long sink;
+	int	i, j;
+
+	sink = sample_bitmap(map, w, h, 1);
+	boxes = (long)(map->width / w) * (map->height / h) * BENCH_ROUNDS;
+	best = 0;
+	for(j = 0; j < BENCH_REPEATS; j++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(i = 0; i < BENCH_ROUNDS; i++)
+			sink += sample_bitmap(map, w, h, 0);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+		      (end.tv_nsec - start.tv_nsec)) / boxes;
+		if(j == 0 || ns < best)
+			best = ns;
+	}
+	(void)sink;
+
+	return best;
+}
+
+int main(void)
+{
+	BITMAP	map;
+	Uchar	*bytes;
+	size_t	size, i;
+	int	w;
+
+	map.width = BENCH_WIDTH;
+	map.height = BENCH_HEIGHT;
+	map.stride = BM_BYTES_PER_LINE(&map);
+	size = (size_t)map.stride * map.height;
+	map.data = malloc(size);
+	if(map.data == NULL)
+		return 1;
+	srand(1);
+	bytes = (Uchar *)map.data;
+	for(i = 0; i < size; i++)
+		bytes[i] = rand() & 0xff;
+
+	printf("box     table ns/box");
+#ifdef HAVE_SAMPLE_POPCOUNT
+	printf("  popcount ns/box");
+#endif
+	printf("\n");
+
+	for(w = 1; w <= BENCH_MAX_BOX; w++) {
+#ifdef HAVE_SAMPLE_POPCOUNT
+		has_popcount = 0;
+#endif
+		printf("%2dx%-2d   %12.2f", w, w, time_boxes(&map, w, w));
+#ifdef HAVE_SAMPLE_POPCOUNT
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("popcnt")) {
+			has_popcount = 1;
+			printf("  %15.2f", time_boxes(&map, w, w));
+		}
+#endif
+		printf("\n");
+	}
+
+	free(map.data);
+	return 0;
+}
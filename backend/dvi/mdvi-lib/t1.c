@@ -425,6 +425,7 @@ static int t1_load_font(DviParams *params, DviFont *font)
 		font->chars[i].glyph.data = NULL;
 		font->chars[i].shrunk.data = NULL;
 		font->chars[i].grey.data = NULL;
+		font->chars[i].grey_cache = NULL;
 	}
 	
 	return 0;
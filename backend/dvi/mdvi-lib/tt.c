@@ -319,6 +319,7 @@ static int tt_load_font(DviParams *params, DviFont *font)
 		font->chars[i].glyph.data = NULL;
 		font->chars[i].shrunk.data = NULL;
 		font->chars[i].grey.data = NULL;
+		font->chars[i].grey_cache = NULL;
 	}
 	
 	if(info->fmfname == NULL)
@@ -0,0 +1,555 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <gio/gio.h>
+#include <glib/gi18n-lib.h>
+#include <libxml/xmlIO.h>
+
+#include "epub-archive.h"
+#include "unzip.h"
+
+/* Random access to the members of an epub container.
+ *
+ * The zip central directory is read once when the archive is opened and
+ * every member is indexed by its path, so that a chapter or an image can
+ * be decompressed on demand without walking the archive. Members are
+ * addressed with URIs of the form epub://<key>/<path>, where the key
+ * identifies the archive. Those URIs can be handed to libxml, which reads
+ * them through the input callbacks registered here, and to the web view,
+ * which resolves them with ev_document_get_resource().
+ */
+
+#define EPUB_ARCHIVE_MAX_PATH 1024
+
+struct _EpubArchive {
+	GObject     parent_instance;
+
+	unzFile     zip;
+	GMutex      mutex;
+	GHashTable *entries;   /* path -> unz64_file_pos */
+	GHashTable *overrides; /* path -> GBytes */
+
+	gchar      *key;
+	gchar      *base_uri;
+};
+
+typedef struct {
+	GBytes *bytes;
+	gsize   pos;
+} EpubArchiveXmlReader;
+
+G_DEFINE_TYPE (EpubArchive, epub_archive, G_TYPE_OBJECT)
+
+G_LOCK_DEFINE_STATIC (archives);
+static GHashTable *archives = NULL; /* key -> GWeakRef */
+static gint        n_archives = 0;
+
+/* Drops empty and "." segments and resolves ".." ones */
+static gchar *
+epub_archive_normalize_path (const gchar *path)
+{
+	gchar     **segments;
+	GPtrArray  *normalized;
+	gchar      *retval;
+	gint        i;
+
+	segments = g_strsplit (path, "/", -1);
+	normalized = g_ptr_array_new ();
+	for (i = 0; segments[i]; i++) {
+		if (*segments[i] == '\0' || g_str_equal (segments[i], "."))
+			continue;
+		if (g_str_equal (segments[i], "..")) {
+			if (normalized->len > 0)
+				g_ptr_array_remove_index (normalized, normalized->len - 1);
+			continue;
+		}
+		g_ptr_array_add (normalized, segments[i]);
+	}
+	g_ptr_array_add (normalized, NULL);
+
+	retval = g_strjoinv ("/", (gchar **) normalized->pdata);
+	g_ptr_array_free (normalized, TRUE);
+	g_strfreev (segments);
+
+	return retval;
+}
+
+/* Splits an epub:// URI into the archive key and the normalized path of
+ * the member it points to.
+ */
+static gchar *
+epub_archive_split_uri (const gchar  *uri,
+			gchar       **key)
+{
+	const gchar *prefix = EPUB_ARCHIVE_URI_SCHEME "://";
+	const gchar *host, *path;
+	gchar       *escaped, *unescaped;
+	gchar       *retval;
+
+	if (!uri || !g_str_has_prefix (uri, prefix))
+		return NULL;
+
+	host = uri + strlen (prefix);
+	path = strchr (host, '/');
+	if (!path)
+		return NULL;
+
+	if (key)
+		*key = g_strndup (host, path - host);
+
+	escaped = g_strndup (path, strcspn (path, "?#"));
+	unescaped = g_uri_unescape_string (escaped, NULL);
+	retval = epub_archive_normalize_path (unescaped ? unescaped : escaped);
+	g_free (unescaped);
+	g_free (escaped);
+
+	return retval;
+}
+
+static EpubArchive *
+epub_archive_lookup (const gchar *key)
+{
+	GWeakRef    *ref;
+	EpubArchive *archive = NULL;
+
+	G_LOCK (archives);
+	if (archives && (ref = g_hash_table_lookup (archives, key)))
+		archive = g_weak_ref_get (ref);
+	G_UNLOCK (archives);
+
+	return archive;
+}
+
+static void
+epub_archive_free_weak_ref (GWeakRef *ref)
+{
+	g_weak_ref_clear (ref);
+	g_free (ref);
+}
+
+/* libxml input callbacks */
+static int
+epub_archive_xml_match (const char *filename)
+{
+	return filename && g_str_has_prefix (filename, EPUB_ARCHIVE_URI_SCHEME "://");
+}
+
+static void *
+epub_archive_xml_open (const char *filename)
+{
+	EpubArchive          *archive;
+	EpubArchiveXmlReader *reader;
+	GBytes               *bytes;
+	gchar                *key = NULL;
+	gchar                *path;
+
+	path = epub_archive_split_uri (filename, &key);
+	if (!path) {
+		g_free (key);
+		return NULL;
+	}
+
+	archive = epub_archive_lookup (key);
+	g_free (key);
+	if (!archive) {
+		g_free (path);
+		return NULL;
+	}
+
+	bytes = epub_archive_read_entry (archive, path, NULL);
+	g_object_unref (archive);
+	g_free (path);
+	if (!bytes)
+		return NULL;
+
+	reader = g_new0 (EpubArchiveXmlReader, 1);
+	reader->bytes = bytes;
+
+	return reader;
+}
+
+static int
+epub_archive_xml_read (void *context,
+		       char *buffer,
+		       int   len)
+{
+	EpubArchiveXmlReader *reader = context;
+	const gchar          *data;
+	gsize                 size;
+	gsize                 n_read;
+
+	data = g_bytes_get_data (reader->bytes, &size);
+	n_read = MIN ((gsize) len, size - reader->pos);
+	memcpy (buffer, data + reader->pos, n_read);
+	reader->pos += n_read;
+
+	return n_read;
+}
+
+static int
+epub_archive_xml_close (void *context)
+{
+	EpubArchiveXmlReader *reader = context;
+
+	g_bytes_unref (reader->bytes);
+	g_free (reader);
+
+	return 0;
+}
+
+static void
+epub_archive_finalize (GObject *object)
+{
+	EpubArchive *archive = EPUB_ARCHIVE (object);
+
+	if (archive->key) {
+		G_LOCK (archives);
+		g_hash_table_remove (archives, archive->key);
+		G_UNLOCK (archives);
+	}
+
+	if (archive->zip)
+		unzClose (archive->zip);
+	g_hash_table_destroy (archive->entries);
+	g_hash_table_destroy (archive->overrides);
+	g_mutex_clear (&archive->mutex);
+	g_free (archive->key);
+	g_free (archive->base_uri);
+
+	G_OBJECT_CLASS (epub_archive_parent_class)->finalize (object);
+}
+
+static void
+epub_archive_class_init (EpubArchiveClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = epub_archive_finalize;
+
+	archives = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					  (GDestroyNotify) epub_archive_free_weak_ref);
+	xmlRegisterInputCallbacks (epub_archive_xml_match,
+				   epub_archive_xml_open,
+				   epub_archive_xml_read,
+				   epub_archive_xml_close);
+}
+
+static void
+epub_archive_init (EpubArchive *archive)
+{
+	g_mutex_init (&archive->mutex);
+	archive->entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	archive->overrides = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						    (GDestroyNotify) g_bytes_unref);
+}
+
+static gboolean
+epub_archive_build_index (EpubArchive *archive)
+{
+	gint status;
+
+	for (status = unzGoToFirstFile (archive->zip);
+	     status == UNZ_OK;
+	     status = unzGoToNextFile (archive->zip)) {
+		unz_file_info64  info;
+		unz64_file_pos  *pos;
+		gchar            name[EPUB_ARCHIVE_MAX_PATH];
+
+		if (unzGetCurrentFileInfo64 (archive->zip, &info, name, sizeof (name),
+					     NULL, 0, NULL, 0) != UNZ_OK)
+			return FALSE;
+
+		/* Directories and truncated names */
+		if (info.size_filename >= sizeof (name) ||
+		    g_str_has_suffix (name, "/"))
+			continue;
+
+		pos = g_new (unz64_file_pos, 1);
+		if (unzGetFilePos64 (archive->zip, pos) != UNZ_OK) {
+			g_free (pos);
+			return FALSE;
+		}
+		g_hash_table_insert (archive->entries, g_strdup (name), pos);
+	}
+
+	return status == UNZ_END_OF_LIST_OF_FILE;
+}
+
+/**
+ * epub_archive_new:
+ * @filename: path of the epub container
+ * @error: return location for an error, or %NULL
+ *
+ * Opens @filename and indexes its members. Nothing is decompressed until
+ * a member is read.
+ *
+ * Returns: (transfer full): a new #EpubArchive, or %NULL on error
+ */
+EpubArchive *
+epub_archive_new (const gchar  *filename,
+		  GError      **error)
+{
+	EpubArchive *archive;
+	GWeakRef    *ref;
+
+	archive = g_object_new (EPUB_TYPE_ARCHIVE, NULL);
+
+	archive->zip = unzOpen64 (filename);
+	if (!archive->zip) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     _("could not open archive"));
+		g_object_unref (archive);
+		return NULL;
+	}
+
+	if (!epub_archive_build_index (archive)) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				     _("could not extract archive"));
+		g_object_unref (archive);
+		return NULL;
+	}
+
+	archive->key = g_strdup_printf ("book%d", g_atomic_int_add (&n_archives, 1));
+	archive->base_uri = g_strdup_printf ("%s://%s", EPUB_ARCHIVE_URI_SCHEME, archive->key);
+
+	ref = g_new0 (GWeakRef, 1);
+	g_weak_ref_init (ref, archive);
+	G_LOCK (archives);
+	g_hash_table_insert (archives, g_strdup (archive->key), ref);
+	G_UNLOCK (archives);
+
+	return archive;
+}
+
+/**
+ * epub_archive_get_base_uri:
+ * @archive: an #EpubArchive
+ *
+ * Returns: the URI of the archive root, without a trailing slash
+ */
+const gchar *
+epub_archive_get_base_uri (EpubArchive *archive)
+{
+	g_return_val_if_fail (EPUB_IS_ARCHIVE (archive), NULL);
+
+	return archive->base_uri;
+}
+
+gboolean
+epub_archive_has_entry (EpubArchive *archive,
+			const gchar *path)
+{
+	gboolean retval;
+
+	g_return_val_if_fail (EPUB_IS_ARCHIVE (archive), FALSE);
+
+	g_mutex_lock (&archive->mutex);
+	retval = g_hash_table_contains (archive->overrides, path) ||
+		 g_hash_table_contains (archive->entries, path);
+	g_mutex_unlock (&archive->mutex);
+
+	return retval;
+}
+
+static GBytes *
+epub_archive_decompress_current (EpubArchive  *archive,
+				 const gchar  *path,
+				 GError      **error)
+{
+	unz_file_info64  info;
+	guchar          *data;
+	gsize            size, n_read = 0;
+
+	if (unzGetCurrentFileInfo64 (archive->zip, &info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK ||
+	    info.uncompressed_size > G_MAXSIZE ||
+	    unzOpenCurrentFile (archive->zip) != UNZ_OK) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "Could not read “%s” from the archive", path);
+		return NULL;
+	}
+
+	size = info.uncompressed_size;
+	data = g_malloc (MAX (size, 1));
+	while (n_read < size) {
+		gint chunk = unzReadCurrentFile (archive->zip, data + n_read,
+						 MIN (size - n_read, G_MAXINT));
+		if (chunk <= 0)
+			break;
+		n_read += chunk;
+	}
+	unzCloseCurrentFile (archive->zip);
+
+	if (n_read != size) {
+		g_free (data);
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "Could not read “%s” from the archive", path);
+		return NULL;
+	}
+
+	return g_bytes_new_take (data, size);
+}
+
+/**
+ * epub_archive_read_entry:
+ * @archive: an #EpubArchive
+ * @path: the path of a member, relative to the archive root
+ * @error: return location for an error, or %NULL
+ *
+ * Decompresses a single member of the archive. It's safe to call this
+ * from any thread.
+ *
+ * Returns: (transfer full): the contents of the member, or %NULL
+ */
+GBytes *
+epub_archive_read_entry (EpubArchive  *archive,
+			 const gchar  *path,
+			 GError      **error)
+{
+	unz64_file_pos *pos;
+	GBytes         *bytes;
+
+	g_return_val_if_fail (EPUB_IS_ARCHIVE (archive), NULL);
+	g_return_val_if_fail (path != NULL, NULL);
+
+	g_mutex_lock (&archive->mutex);
+
+	bytes = g_hash_table_lookup (archive->overrides, path);
+	if (bytes) {
+		g_bytes_ref (bytes);
+		g_mutex_unlock (&archive->mutex);
+		return bytes;
+	}
+
+	pos = g_hash_table_lookup (archive->entries, path);
+	if (!pos) {
+		g_mutex_unlock (&archive->mutex);
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			     "“%s” is not part of the archive", path);
+		return NULL;
+	}
+
+	if (unzGoToFilePos64 (archive->zip, pos) != UNZ_OK) {
+		g_mutex_unlock (&archive->mutex);
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+			     "Could not read “%s” from the archive", path);
+		return NULL;
+	}
+
+	bytes = epub_archive_decompress_current (archive, path, error);
+	g_mutex_unlock (&archive->mutex);
+
+	return bytes;
+}
+
+/**
+ * epub_archive_uri_to_path:
+ * @archive: an #EpubArchive
+ * @uri: an epub:// URI
+ *
+ * Returns: (transfer full): the path of the member @uri points to, or
+ *   %NULL if @uri doesn't belong to @archive
+ */
+gchar *
+epub_archive_uri_to_path (EpubArchive *archive,
+			  const gchar *uri)
+{
+	gchar *key = NULL;
+	gchar *path;
+
+	g_return_val_if_fail (EPUB_IS_ARCHIVE (archive), NULL);
+
+	path = epub_archive_split_uri (uri, &key);
+	if (path && g_strcmp0 (key, archive->key) != 0) {
+		g_free (path);
+		path = NULL;
+	}
+	g_free (key);
+
+	return path;
+}
+
+/**
+ * epub_archive_build_uri:
+ * @archive: an #EpubArchive
+ * @path: the path of a member, relative to the archive root
+ *
+ * Returns: (transfer full): the URI of the member at @path
+ */
+gchar *
+epub_archive_build_uri (EpubArchive *archive,
+			const gchar *path)
+{
+	gchar *normalized;
+	gchar *escaped;
+	gchar *uri;
+
+	g_return_val_if_fail (EPUB_IS_ARCHIVE (archive), NULL);
+
+	normalized = epub_archive_normalize_path (path);
+	escaped = g_uri_escape_string (normalized, G_URI_RESERVED_CHARS_ALLOWED_IN_PATH, TRUE);
+	uri = g_strdup_printf ("%s/%s", archive->base_uri, escaped);
+	g_free (escaped);
+	g_free (normalized);
+
+	return uri;
+}
+
+GBytes *
+epub_archive_read_uri (EpubArchive  *archive,
+		       const gchar  *uri,
+		       GError      **error)
+{
+	gchar  *path;
+	GBytes *bytes;
+
+	path = epub_archive_uri_to_path (archive, uri);
+	if (!path) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+			     "“%s” is not part of the archive", uri);
+		return NULL;
+	}
+
+	bytes = epub_archive_read_entry (archive, path, error);
+	g_free (path);
+
+	return bytes;
+}
+
+/**
+ * epub_archive_replace_entry:
+ * @archive: an #EpubArchive
+ * @path: the path of a member, relative to the archive root
+ * @bytes: the new contents of the member
+ *
+ * Replaces, or adds, a member in memory. The container on disk is never
+ * modified.
+ */
+void
+epub_archive_replace_entry (EpubArchive *archive,
+			    const gchar *path,
+			    GBytes      *bytes)
+{
+	g_return_if_fail (EPUB_IS_ARCHIVE (archive));
+	g_return_if_fail (path != NULL && bytes != NULL);
+
+	g_mutex_lock (&archive->mutex);
+	g_hash_table_insert (archive->overrides, g_strdup (path), g_bytes_ref (bytes));
+	g_mutex_unlock (&archive->mutex);
+}
@@ -0,0 +1,48 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define EPUB_ARCHIVE_URI_SCHEME "epub"
+
+#define EPUB_TYPE_ARCHIVE epub_archive_get_type ()
+G_DECLARE_FINAL_TYPE (EpubArchive, epub_archive, EPUB, ARCHIVE, GObject)
+
+EpubArchive *epub_archive_new           (const gchar  *filename,
+					 GError      **error);
+const gchar *epub_archive_get_base_uri  (EpubArchive  *archive);
+gboolean     epub_archive_has_entry     (EpubArchive  *archive,
+					 const gchar  *path);
+GBytes      *epub_archive_read_entry    (EpubArchive  *archive,
+					 const gchar  *path,
+					 GError      **error);
+GBytes      *epub_archive_read_uri      (EpubArchive  *archive,
+					 const gchar  *uri,
+					 GError      **error);
+void         epub_archive_replace_entry (EpubArchive  *archive,
+					 const gchar  *path,
+					 GBytes       *bytes);
+gchar       *epub_archive_uri_to_path   (EpubArchive  *archive,
+					 const gchar  *uri);
+gchar       *epub_archive_build_uri     (EpubArchive  *archive,
+					 const gchar  *path);
+
+G_END_DECLS
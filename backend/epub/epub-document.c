@@ -21,8 +21,8 @@
  */
 
 #include "epub-document.h"
+#include "epub-archive.h"
 #include "ev-file-helpers.h"
-#include "unzip.h"
 #include "ev-document-thumbnails.h"
 #include "ev-document-find.h"
 #include "ev-backends-manager.h"
@@ -60,6 +60,17 @@ typedef struct _linknode {
 	guint page;
 }linknode;
 
+/* Visible text of a chapter, extracted once and shared by every search.
+ * The text is NFC normalised UTF-8 with runs of white space collapsed and
+ * block elements separated by a newline, so that matches may span inline
+ * markup but not paragraphs. Only the number of matches is needed, the
+ * view highlights them itself.
+ */
+typedef struct _EpubChapterText {
+	gchar  *text;
+	gchar  *folded;   /* Case folded copy of text, built on first use */
+} EpubChapterText;
+
 typedef struct _EpubDocumentClass EpubDocumentClass;
 
 struct _EpubDocumentClass
@@ -72,18 +83,22 @@ struct _EpubDocument
     EvDocument parent_instance;
 	/*Stores the path to the source archive*/
     gchar* archivename ;
-	/*Stores the path of the directory where we unzipped the epub*/
-    gchar* tmp_archive_dir ;
 	/*Stores the contentlist in a sorted manner*/
     GList* contentList ;
-    /* A variable to hold our epubDocument for unzipping*/
-    unzFile epubDocument ;
-	/*The (sub)directory that actually houses the document*/
+    /*Indexed source archive, its members are read on demand*/
+    EpubArchive *archive ;
+	/*URI of the (sub)directory that actually houses the document*/
 	gchar* documentdir;
 	/*Stores the table of contents*/
 	GList *index;
 	/*Document title, for the sidebar links*/
 	gchar *docTitle;
+	/*Chapter URIs and their cached text, filled in by text_thread*/
+	GPtrArray *chapter_uris;
+	EpubChapterText **chapter_texts;
+	GMutex text_mutex;
+	GThread *text_thread;
+	gint text_cancelled;
 };
 
 static void       epub_document_document_thumbnails_iface_init (EvDocumentThumbnailsInterface *iface);
@@ -131,46 +146,254 @@ epub_document_thumbnails_get_thumbnail (EvDocumentThumbnails *document,
 	return thumbnailpix;
 }
 
+typedef struct {
+	GString  *text;
+	gboolean  pending_space;
+} EpubTextExtractor;
+
+static const gchar *epub_block_elements[] = {
+	"address", "article", "aside", "blockquote", "br", "dd", "div", "dl",
+	"dt", "figcaption", "figure", "footer", "h1", "h2", "h3", "h4", "h5",
+	"h6", "header", "hr", "li", "nav", "ol", "p", "pre", "section", "table",
+	"td", "th", "tr", "ul", NULL
+};
+
 static gboolean
-in_tag(const char* found)
+epub_is_block_element (const xmlChar *name)
 {
-    const char* bracket = found ;
-
-    /* Since the dump started with the body tag, the '<' will be the first
-     * character in the haystack.
-     */
-    while (*bracket != '<') {
-        bracket--;
-        if (*bracket == '>') {
-            /*We encounted a close brace before an open*/
-            return FALSE ;
-        }
-    }
+	gint i;
 
-    return TRUE;
+	for (i = 0; epub_block_elements[i]; i++) {
+		if (!xmlStrcasecmp (name, (const xmlChar *)epub_block_elements[i]))
+			return TRUE;
+	}
+
+	return FALSE;
 }
 
-static int
-get_substr_count(const char * haystack,const char *needle,gboolean case_sensitive)
+static void
+epub_text_extractor_break (EpubTextExtractor *extractor)
 {
-    const char* tmp = haystack ;
-    char* (*string_compare_function)(const char*,const char*);
-    int count=0;
-    if (case_sensitive) {
-        string_compare_function = strstr ;
-    }
-    else {
-        string_compare_function = strcasestr;
-    }
+	GString *text = extractor->text;
 
-    while ((tmp=string_compare_function(tmp,needle))) {
-        if (!in_tag(tmp)) {
-            count++;
-        }
-        tmp = tmp + strlen(needle);
-    }
+	if (text->len > 0 && text->str[text->len - 1] != '\n')
+		g_string_append_c (text, '\n');
+	extractor->pending_space = FALSE;
+}
+
+static void
+epub_text_extractor_add_text (EpubTextExtractor *extractor,
+                              const xmlChar     *content)
+{
+	gchar       *normalized;
+	const gchar *p;
+
+	if (!content)
+		return;
+
+	normalized = g_utf8_normalize ((const gchar *)content, -1, G_NORMALIZE_DEFAULT_COMPOSE);
+	if (!normalized)
+		return;
+
+	for (p = normalized; *p; p = g_utf8_next_char (p)) {
+		gunichar c = g_utf8_get_char (p);
+		GString *text = extractor->text;
+
+		if (g_unichar_isspace (c)) {
+			extractor->pending_space = TRUE;
+			continue;
+		}
+
+		if (extractor->pending_space && text->len > 0 &&
+		    text->str[text->len - 1] != '\n')
+			g_string_append_c (text, ' ');
+		extractor->pending_space = FALSE;
+
+		g_string_append_unichar (text, c);
+	}
+
+	g_free (normalized);
+}
+
+static void
+epub_text_extractor_walk (EpubTextExtractor *extractor,
+                          xmlNodePtr         node)
+{
+	for (; node != NULL; node = node->next) {
+		gboolean block;
+
+		switch (node->type) {
+		case XML_TEXT_NODE:
+		case XML_CDATA_SECTION_NODE:
+			epub_text_extractor_add_text (extractor, node->content);
+			break;
+		case XML_ELEMENT_NODE:
+			if (!xmlStrcasecmp (node->name, (const xmlChar *)"script") ||
+			    !xmlStrcasecmp (node->name, (const xmlChar *)"style"))
+				break;
+
+			block = epub_is_block_element (node->name);
+			if (block)
+				epub_text_extractor_break (extractor);
+			epub_text_extractor_walk (extractor, node->children);
+			if (block)
+				epub_text_extractor_break (extractor);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static xmlNodePtr
+epub_find_body (xmlNodePtr node)
+{
+	for (; node != NULL; node = node->next) {
+		xmlNodePtr body;
+
+		if (node->type != XML_ELEMENT_NODE)
+			continue;
+		if (!xmlStrcasecmp (node->name, (const xmlChar *)"body"))
+			return node;
+		if ((body = epub_find_body (node->children)))
+			return body;
+	}
+
+	return NULL;
+}
+
+static EpubChapterText *
+epub_chapter_text_new (const gchar *uri)
+{
+	EpubChapterText   *chapter;
+	EpubTextExtractor  extractor;
+	xmlDocPtr          doc;
+	xmlNodePtr         body;
+
+	doc = xmlReadFile (uri, NULL,
+	                   XML_PARSE_RECOVER | XML_PARSE_NOERROR |
+	                   XML_PARSE_NOWARNING | XML_PARSE_NONET);
+	if (doc == NULL)
+		doc = htmlReadFile (uri, NULL,
+		                    HTML_PARSE_RECOVER | HTML_PARSE_NOERROR |
+		                    HTML_PARSE_NOWARNING | HTML_PARSE_NONET);
+
+	extractor.text = g_string_new (NULL);
+	extractor.pending_space = FALSE;
+
+	if (doc != NULL) {
+		body = epub_find_body (xmlDocGetRootElement (doc));
+		if (body)
+			epub_text_extractor_walk (&extractor, body->children);
+		xmlFreeDoc (doc);
+	}
+
+	chapter = g_new0 (EpubChapterText, 1);
+	chapter->text = g_string_free (extractor.text, FALSE);
+
+	return chapter;
+}
+
+static void
+epub_chapter_text_free (EpubChapterText *chapter)
+{
+	if (!chapter)
+		return;
+
+	g_free (chapter->text);
+	g_free (chapter->folded);
+	g_free (chapter);
+}
+
+/* Returns the cached text of a chapter, extracting it if the background
+ * thread hasn't got to it yet. The returned text is owned by the document.
+ */
+static EpubChapterText *
+epub_document_get_chapter_text (EpubDocument *epub_document,
+                                guint         chapter_index)
+{
+	EpubChapterText *chapter;
+
+	if (!epub_document->chapter_uris ||
+	    chapter_index >= epub_document->chapter_uris->len)
+		return NULL;
+
+	g_mutex_lock (&epub_document->text_mutex);
+	chapter = epub_document->chapter_texts[chapter_index];
+	g_mutex_unlock (&epub_document->text_mutex);
+	if (chapter)
+		return chapter;
+
+	chapter = epub_chapter_text_new (g_ptr_array_index (epub_document->chapter_uris, chapter_index));
+
+	g_mutex_lock (&epub_document->text_mutex);
+	if (epub_document->chapter_texts[chapter_index]) {
+		epub_chapter_text_free (chapter);
+		chapter = epub_document->chapter_texts[chapter_index];
+	} else {
+		epub_document->chapter_texts[chapter_index] = chapter;
+	}
+	g_mutex_unlock (&epub_document->text_mutex);
+
+	return chapter;
+}
+
+static const gchar *
+epub_chapter_text_get_folded (EpubDocument    *epub_document,
+                              EpubChapterText *chapter)
+{
+	const gchar *folded;
+
+	g_mutex_lock (&epub_document->text_mutex);
+	if (!chapter->folded)
+		chapter->folded = g_utf8_casefold (chapter->text, -1);
+	folded = chapter->folded;
+	g_mutex_unlock (&epub_document->text_mutex);
+
+	return folded;
+}
+
+static gpointer
+epub_document_extract_text_thread (EpubDocument *epub_document)
+{
+	guint i;
 
-    return count;
+	for (i = 0; i < epub_document->chapter_uris->len; i++) {
+		if (g_atomic_int_get (&epub_document->text_cancelled))
+			break;
+		epub_document_get_chapter_text (epub_document, i);
+	}
+
+	return NULL;
+}
+
+/* Collapses runs of white space to a single space, as done for the
+ * chapter text, so that the search text can match it.
+ */
+static gchar *
+epub_collapse_white_space (const gchar *text)
+{
+	GString     *collapsed = g_string_new (NULL);
+	gboolean     space = FALSE;
+	const gchar *p;
+
+	for (p = text; *p; p = g_utf8_next_char (p)) {
+		gunichar c = g_utf8_get_char (p);
+
+		if (g_unichar_isspace (c)) {
+			space = TRUE;
+			continue;
+		}
+
+		if (space)
+			g_string_append_c (collapsed, ' ');
+		space = FALSE;
+		g_string_append_unichar (collapsed, c);
+	}
+	if (space)
+		g_string_append_c (collapsed, ' ');
+
+	return g_string_free (collapsed, FALSE);
 }
 
 static guint
@@ -179,36 +402,41 @@ epub_document_check_hits(EvDocumentFind *document_find,
                          const gchar    *text,
                          gboolean        case_sensitive)
 {
-	gchar *filepath = g_filename_from_uri((gchar*)page->backend_page,NULL,NULL);
-	htmlDocPtr htmldoc =  xmlParseFile(filepath);
-	
-	if (htmldoc == NULL) {
-		g_free (filepath);
+	EpubDocument    *epub_document = EPUB_DOCUMENT (document_find);
+	EpubChapterText *chapter;
+	const gchar     *haystack;
+	const gchar     *p;
+	gchar           *normalized;
+	gchar           *collapsed;
+	gchar           *needle;
+	gsize            needle_len;
+	guint            count = 0;
+
+	chapter = epub_document_get_chapter_text (epub_document, page->index);
+	if (!chapter)
 		return 0;
-	}
-		
-	htmlNodePtr htmltag = xmlDocGetRootElement(htmldoc);
-	if(htmltag == NULL) {
-		xmlFreeDoc(htmldoc);
-		g_free (filepath);
+
+	normalized = g_utf8_normalize (text, -1, G_NORMALIZE_DEFAULT_COMPOSE);
+	if (!normalized)
 		return 0;
+	collapsed = epub_collapse_white_space (normalized);
+	g_free (normalized);
+
+	if (case_sensitive) {
+		needle = collapsed;
+		haystack = chapter->text;
+	} else {
+		needle = g_utf8_casefold (collapsed, -1);
+		g_free (collapsed);
+		haystack = epub_chapter_text_get_folded (epub_document, chapter);
 	}
-	
-	int count=0;
-	htmlNodePtr bodytag = htmltag->xmlChildrenNode;
 
-	while ( xmlStrcmp(bodytag->name,(xmlChar*)"body") ) {
-		bodytag = bodytag->next;
+	needle_len = strlen (needle);
+	if (needle_len > 0) {
+		for (p = strstr (haystack, needle); p; p = strstr (p + needle_len, needle))
+			count++;
 	}
-
-	xmlBufferPtr bodybuffer = xmlBufferCreate();
-	xmlNodeDump(bodybuffer,htmldoc,bodytag,0,1);
-
-	count = get_substr_count((char*)bodybuffer->content,text,case_sensitive);
-
-	xmlBufferFree(bodybuffer);
-	xmlFreeDoc(htmldoc);
-	g_free (filepath);
+	g_free (needle);
 
 	return count;
 }
@@ -382,40 +610,6 @@ epub_document_get_n_pages (EvDocument *document)
     return g_list_length(epub_document->contentList);
 }
 
-/**
- * epub_remove_temporary_dir : Removes a directory recursively.
- * This function is same as comics_remove_temporary_dir
- * Returns:
- *   	0 if it was successfully deleted,
- * 	-1 if an error occurred
- */
-static int
-epub_remove_temporary_dir (gchar *path_name)
-{
-	GDir  *content_dir;
-	const gchar *filename;
-	gchar *filename_with_path;
-
-	if (g_file_test (path_name, G_FILE_TEST_IS_DIR)) {
-		content_dir = g_dir_open  (path_name, 0, NULL);
-		filename  = g_dir_read_name (content_dir);
-		while (filename) {
-			filename_with_path =
-				g_build_filename (path_name,
-						  filename, NULL);
-			epub_remove_temporary_dir (filename_with_path);
-			g_free (filename_with_path);
-			filename = g_dir_read_name (content_dir);
-		}
-		g_dir_close (content_dir);
-	}
-	/* Note from g_remove() documentation: on Windows, it is in general not
-	 * possible to remove a file that is open to some process, or mapped
-	 * into memory.*/
-	return (g_remove (path_name));
-}
-
-
 static gboolean
 check_mime_type             (const gchar* uri,
                              GError** error);
@@ -665,109 +859,12 @@ check_mime_type(const gchar* uri,GError** error)
 }
 
 static gboolean
-extract_one_file(EpubDocument* epub_document, GFile *tmp_gfile, GError ** error)
-{
-    GFile * outfile ;
-    gsize writesize = 0;
-    GString * gfilepath ;
-    unz_file_info64 info ;
-    gchar* directory;
-	GString* dir_create;
-    GFileOutputStream * outstream ;
-
-    if ( unzOpenCurrentFile(epub_document->epubDocument) != UNZ_OK )
-    {
-            return FALSE ;
-    }
-
-    gboolean result = TRUE;
-
-    gpointer currentfilename = g_malloc0(512);
-    unzGetCurrentFileInfo64(epub_document->epubDocument,&info,currentfilename,512,NULL,0,NULL,0) ;
-    directory = g_strrstr(currentfilename,"/") ;
-
-    if ( directory != NULL )
-        directory++;
-
-    gfilepath = g_string_new(epub_document->tmp_archive_dir) ;
-    g_string_append_printf(gfilepath,"/%s",(gchar*)currentfilename);
-    
-    // handle the html extension (IssueID #266)
-    if (g_strrstr(currentfilename, ".html") != NULL)
-        g_string_insert_c (gfilepath, gfilepath->len-4, 'x');
-
-    outfile = g_file_new_for_path (gfilepath->str);
-    g_autofree gchar *rpath = g_file_get_relative_path (tmp_gfile, outfile);
-
-    if (rpath == NULL)
-    {
-        g_set_error_literal (error,
-                             EV_DOCUMENT_ERROR,
-                             EV_DOCUMENT_ERROR_INVALID,
-                             _("epub file is invalid or corrupt"));
-        g_critical ("Invalid filename in Epub container - '%s'", (gchar *) currentfilename);
-        g_object_unref (outfile);
-        result = FALSE;
-        goto out;
-    }
-
-    /*if we encounter a directory, make a directory inside our temporary folder.*/
-    if (directory != NULL && *directory == '\0')
-    {
-        g_mkdir(gfilepath->str,0777);
-        goto out;
-    }
-    else if (directory != NULL && *directory != '\0' ) {
-        gchar* createdir = currentfilename;
-        /*Since a substring can't be longer than the parent string, allocating space equal to the parent's size should suffice*/
-        gchar *createdirname = g_malloc0(strlen(currentfilename));
-        /* Add the name of the directory and subdirectories,if any to a buffer and then create it */
-        gchar *createdirnametemp = createdirname;
-        while ( createdir != directory ) {
-            (*createdirnametemp) = (*createdir);
-            createdirnametemp++;
-            createdir++;
-        }
-        (*createdirnametemp) = '\0';
-
-        dir_create = g_string_new(epub_document->tmp_archive_dir);
-        g_string_append_printf(dir_create,"/%s",createdirname);
-        g_free(createdirname);
-
-        g_mkdir_with_parents(dir_create->str,0777);
-		g_string_free(dir_create,TRUE);
-    }
-
-    outstream = g_file_create(outfile,G_FILE_CREATE_PRIVATE,NULL,error);
-    gpointer buffer = g_malloc0(512);
-    while ( (writesize = unzReadCurrentFile(epub_document->epubDocument,buffer,512) ) != 0 )
-    {
-        if ( g_output_stream_write((GOutputStream*)outstream,buffer,writesize,NULL,error) == -1 )
-        {
-            result = FALSE;
-            break;
-        }
-    }
-    g_free(buffer);
-    g_output_stream_close((GOutputStream*)outstream,NULL,error);
-    g_object_unref(outfile) ;
-    g_object_unref(outstream) ;
-
-out:
-    unzCloseCurrentFile (epub_document->epubDocument) ;
-    g_string_free(gfilepath,TRUE);
-    g_free(currentfilename);
-	return result;
-}
-
-static gboolean
-extract_epub_from_container (const gchar* uri,
-                             EpubDocument *epub_document,
-                             GError ** error)
+open_epub_archive (const gchar* uri,
+                   EpubDocument *epub_document,
+                   GError ** error)
 {
-    GFile *tmp_gfile = NULL;
     GError *err = NULL;
-    epub_document->archivename = g_filename_from_uri(uri,NULL,error);
+    epub_document->archivename = g_filename_from_uri(uri,NULL,&err);
 
     if ( !epub_document->archivename )
     {
@@ -783,103 +880,80 @@ extract_epub_from_container (const gchar* uri,
         return FALSE;
     }
 
-    gchar *epubfilename = g_strrstr(epub_document->archivename,"/");
-    if ( *epubfilename == '/' )
-        epubfilename++ ;
-
-    GString *temporary_sub_directory = g_string_new(epubfilename);
-    g_string_append(temporary_sub_directory,"XXXXXX") ;
-    epub_document->tmp_archive_dir = ev_mkdtemp(temporary_sub_directory->str, error);
-    g_string_free(temporary_sub_directory, TRUE);
-
-    if (!epub_document->tmp_archive_dir) {
-        return FALSE;
-    }
-
-    epub_document->epubDocument = unzOpen64(epub_document->archivename);
-    if ( epub_document->epubDocument == NULL )
+    epub_document->archive = epub_archive_new (epub_document->archivename, &err);
+    if ( epub_document->archive == NULL )
     {
-        if (err)    {
-            g_propagate_error (error, err);
-        }
-        else    {
-            g_set_error_literal (error,
-                         EV_DOCUMENT_ERROR,
-                         EV_DOCUMENT_ERROR_INVALID,
-                         _("could not open archive"));
-        }
+        g_set_error_literal (error,
+                     EV_DOCUMENT_ERROR,
+                     EV_DOCUMENT_ERROR_INVALID,
+                     err->message);
+        g_error_free (err);
         return FALSE;
     }
 
-    gboolean result = FALSE;
+    return TRUE;
+}
 
-    if ( unzGoToFirstFile(epub_document->epubDocument) != UNZ_OK )
-    {
-        if (err) {
-            g_propagate_error (error, err);
-        }
-        else    {
-            g_set_error_literal (error,
-                         EV_DOCUMENT_ERROR,
-                         EV_DOCUMENT_ERROR_INVALID,
-                         _("could not extract archive"));
-        }
-        goto out;
-    }
+/* Resolves href, relative to the directory URI dir, into an archive URI */
+static gchar*
+epub_document_build_uri (EpubDocument *epub_document,
+                         const gchar  *dir,
+                         const gchar  *href)
+{
+    const gchar *fragment = strchr (href, '#');
+    gchar *dirpath, *relative, *unescaped, *path, *uri;
 
-    tmp_gfile = g_file_new_for_path (epub_document->tmp_archive_dir);
+    dirpath = epub_archive_uri_to_path (epub_document->archive, dir);
+    relative = fragment ? g_strndup (href, fragment - href) : g_strdup (href);
+    unescaped = g_uri_unescape_string (relative, NULL);
 
-    while ( TRUE )
-    {
-        if ( extract_one_file(epub_document, tmp_gfile, &err) == FALSE )
-        {
-            if (err) {
-                g_propagate_error (error, err);
-            }
-            else    {
-                g_set_error_literal (error,
-                             EV_DOCUMENT_ERROR,
-                             EV_DOCUMENT_ERROR_INVALID,
-                             _("could not extract archive"));
-            }
-			goto out;
-        }
+    path = g_strconcat (dirpath ? dirpath : "", "/", unescaped ? unescaped : relative, NULL);
+    uri = epub_archive_build_uri (epub_document->archive, path);
 
-        if ( unzGoToNextFile(epub_document->epubDocument) == UNZ_END_OF_LIST_OF_FILE ) {
-            result = TRUE;
-            break;
-        }
+    if (fragment) {
+        gchar *tmp = uri;
+        uri = g_strconcat (tmp, fragment, NULL);
+        g_free (tmp);
     }
 
-out:
-    g_clear_object (&tmp_gfile);
-    unzClose(epub_document->epubDocument);
-    return result;
+    g_free (path);
+    g_free (unescaped);
+    g_free (relative);
+    g_free (dirpath);
+
+    return uri;
 }
 
-static gchar*
-get_uri_to_content(const gchar* uri,GError ** error,EpubDocument *epub_document)
+/* Stores a modified copy of an xml member in memory, the container itself
+ * is never written to.
+ */
+static void
+epub_document_replace_xml (EpubDocument *epub_document,
+                           const gchar  *uri,
+                           xmlDocPtr     doc)
 {
-	gchar* tmp_archive_dir = epub_document->tmp_archive_dir;
-    GError *err = NULL ;
+    xmlChar *buffer = NULL;
+    int size = 0;
+    gchar *path = epub_archive_uri_to_path (epub_document->archive, uri);
 
-    gchar *containerpath = g_filename_from_uri(uri,NULL,&err);
-    if ( !containerpath )
-    {
-        if (err) {
-            g_propagate_error (error,err);
-        }
-        else    {
-            g_set_error_literal (error,
-                                 EV_DOCUMENT_ERROR,
-                                 EV_DOCUMENT_ERROR_INVALID,
-                                 _("could not retrieve container file"));
-        }
-        return NULL ;
+    if (path == NULL)
+        return;
+
+    xmlDocDumpFormatMemory (doc, &buffer, &size, 0);
+    if (buffer != NULL) {
+        GBytes *bytes = g_bytes_new (buffer, size);
+
+        epub_archive_replace_entry (epub_document->archive, path, bytes);
+        g_bytes_unref (bytes);
+        xmlFree (buffer);
     }
+    g_free (path);
+}
 
-    gboolean result = open_xml_document(containerpath);
-    g_free (containerpath);
+static gchar*
+get_uri_to_content(const gchar* uri,GError ** error,EpubDocument *epub_document)
+{
+    gboolean result = open_xml_document(uri);
     if ( result == FALSE )
     {
         g_set_error_literal(error,
@@ -919,47 +993,16 @@ get_uri_to_content(const gchar* uri,GError ** error,EpubDocument *epub_document)
         return NULL ;
     }
 
-	gchar* documentfolder = g_strrstr((gchar*)relativepath,"/");
-	if (documentfolder != NULL) {
-		gchar* copybuffer = (gchar*)relativepath ;
-		gchar* directorybuffer = g_malloc0(sizeof(gchar*)*100);
-		gchar* writer = directorybuffer;
-
-		while(copybuffer != documentfolder) {
-			(*writer) = (*copybuffer);
-			writer++;copybuffer++;
-		}
-		*writer = '\0';
-
-		GString *documentdir = g_string_new(tmp_archive_dir);
-		g_string_append_printf(documentdir,"/%s",directorybuffer);
-		g_free(directorybuffer);
-		epub_document->documentdir = g_string_free(documentdir,FALSE);
-	}
+	gchar *documentfolder = g_path_get_dirname ((gchar*)relativepath);
+	g_free (epub_document->documentdir);
+	if (g_str_equal (documentfolder, "."))
+		epub_document->documentdir = epub_archive_build_uri (epub_document->archive, "");
 	else
-	{
-		epub_document->documentdir = g_strdup(tmp_archive_dir);
-	}
+		epub_document->documentdir = epub_archive_build_uri (epub_document->archive, documentfolder);
+	g_free (documentfolder);
 
-	GString *absolutepath = g_string_new(tmp_archive_dir);
-    g_string_append_printf(absolutepath,"/%s",relativepath);
+    gchar *content_uri = epub_archive_build_uri (epub_document->archive, (gchar*)relativepath);
     g_free (relativepath);
-
-    gchar *content_uri = g_filename_to_uri(absolutepath->str,NULL,&err);
-    g_string_free(absolutepath,TRUE);
-    if ( !content_uri )  {
-        if (err) {
-            g_propagate_error (error,err);
-        }
-        else
-        {
-            g_set_error_literal (error,
-                                 EV_DOCUMENT_ERROR,
-                                 EV_DOCUMENT_ERROR_INVALID,
-                                 _("could not retrieve container file"));
-        }
-        return NULL ;
-    }
 	xml_free_doc();
     return content_uri ;
 }
@@ -988,8 +1031,9 @@ check_add_page_numbers(linknode *listdata, contentListNode *comparenode)
 }
 
 static GList*
-setup_document_content_list(const gchar* content_uri, GError** error,gchar *documentdir)
+setup_document_content_list(EpubDocument *epub_document, const gchar* content_uri, GError** error)
 {
+    gchar *documentdir = epub_document->documentdir;
     GError *err = NULL;
     gint indexcounter = 1;
     xmlNodePtr manifest,spine,itemrefptr,itemptr;
@@ -1079,17 +1123,17 @@ setup_document_content_list(const gchar* content_uri, GError** error,gchar *docu
             }
 
 
-            GString* absolutepath = g_string_new(documentdir);
             gchar *relativepath = (gchar*)xml_get_data_from_node(itemptr,XML_ATTRIBUTE,(xmlChar*)"href");
-            g_string_append_printf(absolutepath,"/%s",relativepath);
+            if ( relativepath == NULL )
+            {
+                g_free (newnode->key);
+                g_free (newnode);
+                errorflag = TRUE;
+                break;
+            }
 
-            // Handle the html extension (IssueID #266)
-           if (g_strrstr(relativepath, ".html") != NULL)
-                g_string_insert_c (absolutepath, absolutepath->len-4, 'x');
+            newnode->value = epub_document_build_uri (epub_document, documentdir, relativepath);
             g_free (relativepath);
-            
-            newnode->value = g_filename_to_uri(absolutepath->str,NULL,&err);
-            g_string_free(absolutepath, TRUE);
 
             if ( newnode->value == NULL )
             {
@@ -1156,9 +1200,7 @@ free_link_nodes(gpointer data)
 static gchar*
 get_toc_file_name(gchar *containeruri)
 {
-	gchar *containerfilename = g_filename_from_uri(containeruri,NULL,NULL);
-	open_xml_document(containerfilename);
-	g_free (containerfilename);
+	open_xml_document(containeruri);
 
 	set_xml_root_node(NULL);
 
@@ -1197,7 +1239,7 @@ epub_document_get_nav_file(gchar* containeruri)
 }
 
 static GList*
-get_child_list(xmlNodePtr ol,gchar* documentdir)
+get_child_list(EpubDocument *epub_document,xmlNodePtr ol,gchar* documentdir)
 {
     GList *childlist = NULL;
     xmlNodePtr li = ol->xmlChildrenNode;
@@ -1213,15 +1255,13 @@ get_child_list(xmlNodePtr ol,gchar* documentdir)
             if ( !xmlStrcmp(children->name,(xmlChar*)"a")) {
                 newlinknode->linktext = (gchar*)xml_get_data_from_node(children,XML_KEYWORD,NULL);
                 gchar* filename = (gchar*)xml_get_data_from_node(children,XML_ATTRIBUTE,(xmlChar*)"href");
-				gchar *filepath = g_strdup_printf("%s/%s",documentdir,filename);
-				newlinknode->pagelink = g_filename_to_uri(filepath,NULL,NULL);
+				newlinknode->pagelink = epub_document_build_uri (epub_document, documentdir, filename);
 				g_free(filename);
-				g_free(filepath);
                 newlinknode->children = NULL;
                 childlist = g_list_prepend(childlist,newlinknode);
             }
             else if ( !xmlStrcmp(children->name,(xmlChar*)"ol")){
-                newlinknode->children = get_child_list(children,documentdir);
+                newlinknode->children = get_child_list(epub_document,children,documentdir);
             }
 
 			children = children->next;
@@ -1235,7 +1275,7 @@ get_child_list(xmlNodePtr ol,gchar* documentdir)
 
 /* For an epub3 style navfile */
 static GList*
-setup_index_from_navfile(gchar *tocpath)
+setup_index_from_navfile(EpubDocument *epub_document,gchar *tocpath)
 {
     GList *index = NULL;
     open_xml_document(tocpath);
@@ -1258,7 +1298,7 @@ setup_index_from_navfile(gchar *tocpath)
 		(*writer) = (*reader) ;
 		writer++;reader++;
 	}
-    index = get_child_list(xmlretval,navdir);
+    index = get_child_list(epub_document,xmlretval,navdir);
 	g_free(navdir);
     xml_free_doc();
     return index;
@@ -1280,9 +1320,7 @@ setup_document_children(EpubDocument *epub_document,xmlNodePtr node)
     		xml_parse_children_of_node(navPoint,(xmlChar*)"navLabel",NULL,NULL);
     		xmlNodePtr navLabel = xmlretval;
     		xmlretval = NULL;
-    		gchar *fragment=NULL,*end=NULL;
-    		GString *uri = NULL;
-            GString *pagelink = NULL;
+    		gchar *src = NULL;
 
     		xml_parse_children_of_node(navLabel,(xmlChar*)"text",NULL,NULL);
     		
@@ -1298,39 +1336,11 @@ setup_document_children(EpubDocument *epub_document,xmlNodePtr node)
            
             xmlretval = NULL;
             xml_parse_children_of_node(navPoint,(xmlChar*)"content",NULL,NULL);
-            pagelink = g_string_new(epub_document->documentdir);
-            newnode->pagelink = (gchar*)xml_get_data_from_node(xmlretval,XML_ATTRIBUTE,(xmlChar*)"src");
-            g_string_append_printf(pagelink,"/%s",newnode->pagelink);
-
-            xmlFree(newnode->pagelink);
-
-            gchar *escaped = g_strdup(pagelink->str);
-
-            //unescaping any special characters
-            pagelink->str = g_uri_unescape_string (escaped,NULL);
-            g_free(escaped);
-
-            // cut off fragment after '#', only in the last segment of path
-            if ((end = g_strrstr(pagelink->str,"#")) != NULL && (end > g_strrstr(pagelink->str,"/"))) {
-	            fragment = g_strdup(g_strrstr(pagelink->str,"#"));
-	            *end = '\0';
-            }
-            
-            uri = g_string_new(g_filename_to_uri(pagelink->str,NULL,NULL));
-            
-            // handle the html extension (IssueID #266)
-            if (g_strrstr(uri->str, ".html") != NULL)
-                g_string_insert_c (uri, uri->len-4, 'x');
-                
-            g_string_free(pagelink,TRUE);
-
-            if (fragment) {
-	            g_string_append(uri,fragment);
-            }
-
-            newnode->pagelink = g_strdup(uri->str);
+            src = (gchar*)xml_get_data_from_node(xmlretval,XML_ATTRIBUTE,(xmlChar*)"src");
+            newnode->pagelink = epub_document_build_uri (epub_document, epub_document->documentdir,
+                                                         src ? src : "");
+            xmlFree(src);
             newnode->children = setup_document_children(epub_document, navPoint);
-            g_string_free(uri,TRUE);
             index = g_list_prepend(index,newnode);
         } 
 
@@ -1343,7 +1353,7 @@ setup_document_children(EpubDocument *epub_document,xmlNodePtr node)
 static GList*
 setup_document_index(EpubDocument *epub_document,gchar *containeruri)
 {
-    GString *tocpath = g_string_new(epub_document->documentdir);
+    gchar *tocpath;
     gchar *tocfilename = get_toc_file_name(containeruri);
     GList *index = NULL;
 
@@ -1354,22 +1364,21 @@ setup_document_index(EpubDocument *epub_document,gchar *containeruri)
 
         if (tocfilename == NULL) {
             //We didn't even find a nav file.The document has no TOC.
-            g_string_free(tocpath,TRUE);
             return NULL;
         }
 
-        g_string_append_printf (tocpath,"/%s",tocfilename);
-        index = setup_index_from_navfile(tocpath->str);
-        g_string_free(tocpath,TRUE);
+        tocpath = epub_document_build_uri (epub_document, epub_document->documentdir, tocfilename);
+        index = setup_index_from_navfile(epub_document,tocpath);
+        g_free(tocpath);
         g_free (tocfilename);
         return index;
     }
 
-    g_string_append_printf (tocpath,"/%s",tocfilename);
+    tocpath = epub_document_build_uri (epub_document, epub_document->documentdir, tocfilename);
     g_free (tocfilename);
 
-    open_xml_document(tocpath->str);
-    g_string_free(tocpath,TRUE);
+    open_xml_document(tocpath);
+    g_free(tocpath);
     set_xml_root_node((xmlChar*)"ncx");
 
 	xmlNodePtr docTitle = xml_get_pointer_to_node((xmlChar*)"docTitle",NULL,NULL);
@@ -1392,18 +1401,10 @@ epub_document_get_info(EvDocument *document)
 {
 	EpubDocument *epub_document = EPUB_DOCUMENT(document);
 	GError *error = NULL ;
-	gchar* infofile ;
 	xmlNodePtr metanode ;
 	GString* buffer ;
 
-	GString* containerpath = g_string_new(epub_document->tmp_archive_dir);
-	g_string_append_printf(containerpath,"/META-INF/container.xml");
-	gchar* containeruri = g_filename_to_uri(containerpath->str,NULL,&error);
-	g_string_free (containerpath, TRUE);
-	if ( error )
-	{
-		return NULL ;
-	}
+	gchar* containeruri = epub_archive_build_uri (epub_document->archive, "META-INF/container.xml");
 
 	gchar* uri = get_uri_to_content (containeruri,&error,epub_document);
 	g_free (containeruri);
@@ -1425,15 +1426,8 @@ epub_document_get_info(EvDocument *document)
 				EV_DOCUMENT_INFO_PERMISSIONS |
 			    EV_DOCUMENT_INFO_N_PAGES ;
 
-	infofile = g_filename_from_uri(uri,NULL,&error);
+	open_xml_document(uri);
 	g_free (uri);
-	if ( error )
-	{
-		return epubinfo;
-	}
-
-	open_xml_document(infofile);
-	g_free (infofile);
 
 	set_xml_root_node((xmlChar*)"package");
 
@@ -1493,147 +1487,44 @@ epub_document_get_page(EvDocument *document,
 	return page ;
 }
 
-static void
-change_to_night_sheet(contentListNode *nodedata,gpointer user_data)
+static GBytes *
+epub_document_get_resource (EvDocument  *document,
+                            const gchar *uri,
+                            gchar      **mime_type,
+                            GError     **error)
 {
-    gchar *filename = g_filename_from_uri(nodedata->value,NULL,NULL);
-    open_xml_document(filename);
-    set_xml_root_node(NULL);
-    xmlNodePtr head =xml_get_pointer_to_node((xmlChar*)"head",NULL,NULL);
-	gchar *class = NULL;
-    xmlretval = NULL;
-    xml_parse_children_of_node(head,(xmlChar*)"link",(xmlChar*)"rel",(xmlChar*)"stylesheet");
-
-    xmlNodePtr day = xmlretval;
-	if ( (class = (gchar*)xml_get_data_from_node(day,XML_ATTRIBUTE,(xmlChar*)"class")) == NULL) {
-		xmlSetProp(day,(xmlChar*)"class",(xmlChar*)"day");
+	EpubDocument *epub_document = EPUB_DOCUMENT (document);
+	GBytes       *bytes;
+	gchar        *path;
+
+	path = epub_archive_uri_to_path (epub_document->archive, uri);
+	if (path == NULL) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+		             "“%s” is not part of the document", uri);
+		return NULL;
 	}
-	g_free(class);
-    xmlSetProp(day,(xmlChar*)"rel",(xmlChar*)"alternate stylesheet");
-    xmlretval = NULL;
-    xml_parse_children_of_node(head,(xmlChar*)"link",(xmlChar*)"class",(xmlChar*)"night");
-    xmlSetProp(xmlretval,(xmlChar*)"rel",(xmlChar*)"stylesheet");
-    xmlSaveFormatFile (filename, xmldocument, 0);
-    xml_free_doc();
-    g_free(filename);
-}
-
-static void
-change_to_day_sheet(contentListNode *nodedata,gpointer user_data)
-{
-    gchar *filename = g_filename_from_uri(nodedata->value,NULL,NULL);
-    open_xml_document(filename);
-    set_xml_root_node(NULL);
-    xmlNodePtr head =xml_get_pointer_to_node((xmlChar*)"head",NULL,NULL);
-
-    xmlretval = NULL;
-    xml_parse_children_of_node(head,(xmlChar*)"link",(xmlChar*)"rel",(xmlChar*)"stylesheet");
-
-    xmlNodePtr day = xmlretval;
-    xmlSetProp(day,(xmlChar*)"rel",(xmlChar*)"alternate stylesheet");
-
-    xmlretval = NULL;
-    xml_parse_children_of_node(head,(xmlChar*)"link",(xmlChar*)"class",(xmlChar*)"day");
-    xmlSetProp(xmlretval,(xmlChar*)"rel",(xmlChar*)"stylesheet");
-    xmlSaveFormatFile (filename, xmldocument, 0);
-    xml_free_doc();
-    g_free(filename);
-}
 
-static gchar*
-epub_document_get_alternate_stylesheet(gchar *docuri)
-{
-    gchar *filename = g_filename_from_uri(docuri,NULL,NULL);
-    open_xml_document(filename);
-    g_free(filename);
-
-    set_xml_root_node(NULL);
-
-    xmlNodePtr head= xml_get_pointer_to_node((xmlChar*)"head",NULL,NULL);
-
-    xmlretval = NULL;
-
-    xml_parse_children_of_node(head,(xmlChar*)"link",(xmlChar*)"class",(xmlChar*)"night");
-
-    if (xmlretval != NULL) {
-        return (gchar*)xml_get_data_from_node(xmlretval,XML_ATTRIBUTE,(xmlChar*)"href");
-    }
-    xml_free_doc();
-    return NULL;
-}
-
-static void
-add_night_sheet(contentListNode *listdata,gchar *sheet)
-{
-    gchar *sheeturi = g_filename_to_uri(sheet,NULL,NULL);
-    open_xml_document(listdata->value);
-
-    set_xml_root_node(NULL);
-
-    xmlSaveFormatFile (listdata->value, xmldocument, 0);
-    xml_free_doc();
-    g_free(sheeturi);
-}
-
-static void
-epub_document_check_add_night_sheet(EvDocument *document)
-{
-    EpubDocument *epub_document = EPUB_DOCUMENT(document);
-
-    g_return_if_fail(EPUB_IS_DOCUMENT(epub_document));
-
-    /*
-     * We'll only check the first page for a supplied night mode stylesheet.
-     * Odds are, if this one has it, all others have it too.
-     */
-	contentListNode *node = epub_document->contentList->data;
-    gchar* stylesheetfilename = epub_document_get_alternate_stylesheet((gchar*)node->value) ;
-
-    if (stylesheetfilename == NULL) {
-        gchar *style = "body {color:rgb(255,255,255);\
-                        background-color:rgb(0,0,0);\
-                        text-align:justify;\
-                        line-spacing:1.8;\
-                        margin-top:0px;\
-                        margin-bottom:4px;\
-                        margin-right:50px;\
-                        margin-left:50px;\
-                        text-indent:3em;}\
-                        h1, h2, h3, h4, h5, h6\
-                        {color:white;\
-                        text-align:center;\
-                        font-style:italic;\
-                        font-weight:bold;}";
-
-        gchar *csspath = g_strdup_printf("%s/xreadernightstyle.css",epub_document->documentdir);
-
-
-        GFile *styles = g_file_new_for_path (csspath);
-        GOutputStream *outstream = (GOutputStream*)g_file_create(styles,G_FILE_CREATE_PRIVATE,NULL,NULL);
-        if ( g_output_stream_write((GOutputStream*)outstream,style,strlen(style),NULL,NULL) == -1 )
-        {
-            return ;
-        }
-        g_output_stream_close((GOutputStream*)outstream,NULL,NULL);
-        g_object_unref(styles) ;
-        g_object_unref(outstream) ;
-        //add this stylesheet to each document, for later.
-        g_list_foreach(epub_document->contentList,(GFunc)add_night_sheet,csspath);
-        g_free(csspath);
-    }
-    g_free(stylesheetfilename);
-}
-
-static void
-epub_document_toggle_night_mode(EvDocument *document,gboolean night)
-{
-    EpubDocument *epub_document = EPUB_DOCUMENT(document);
+	bytes = epub_archive_read_entry (epub_document->archive, path, error);
+	if (bytes && mime_type) {
+		/* Chapters are always treated as XHTML, even when they use
+		 * an .html extension (IssueID #266).
+		 */
+		if (g_str_has_suffix (path, ".html") || g_str_has_suffix (path, ".htm")) {
+			*mime_type = g_strdup ("application/xhtml+xml");
+		} else {
+			gchar *content_type;
+
+			content_type = g_content_type_guess (path,
+			                                     g_bytes_get_data (bytes, NULL),
+			                                     g_bytes_get_size (bytes),
+			                                     NULL);
+			*mime_type = g_content_type_get_mime_type (content_type);
+			g_free (content_type);
+		}
+	}
+	g_free (path);
 
-    g_return_if_fail(EPUB_IS_DOCUMENT(epub_document));
-    if (night)
-        g_list_foreach(epub_document->contentList,(GFunc)change_to_night_sheet,NULL);
-    else
-        g_list_foreach(epub_document->contentList,(GFunc)change_to_day_sheet,NULL);
+	return bytes;
 }
 
 static gchar*
@@ -1683,13 +1574,16 @@ epub_document_set_index_pages(GList *index,GList *contentList)
 
 
 static void
-add_mathjax_script_node_to_file(gchar *filename, gchar *data)
+add_mathjax_script_node_to_file(EpubDocument *epub_document, gchar *uri, gchar *data)
 {
-	xmlDocPtr mathdocument = xmlParseFile (filename);
+	xmlDocPtr mathdocument = xmlParseFile (uri);
 	xmlNodePtr mathroot = xmlDocGetRootElement(mathdocument);
 
-	if (mathroot == NULL)
+	if (mathroot == NULL) {
+		if (mathdocument)
+			xmlFreeDoc (mathdocument);
 		return;
+	}
 
 	xmlNodePtr head = mathroot->children;
 
@@ -1700,7 +1594,8 @@ add_mathjax_script_node_to_file(gchar *filename, gchar *data)
 		head = head->next;
 	}
 
-	if (xmlStrcmp(head->name,(xmlChar*)"head")) {
+	if (head == NULL) {
+		xmlFreeDoc (mathdocument);
 		return ;
 	}
 
@@ -1708,20 +1603,19 @@ add_mathjax_script_node_to_file(gchar *filename, gchar *data)
 	xmlNewProp(script,(xmlChar*)"type",(xmlChar*)"text/javascript");
 	xmlNewProp(script,(xmlChar*)"src",(xmlChar*)data);
 
-	xmlSaveFormatFile(filename, mathdocument, 0);
+	epub_document_replace_xml (epub_document, uri, mathdocument);
 	xmlFreeDoc (mathdocument);
 }
 
 static void
-epub_document_add_mathJax(gchar* containeruri,gchar* documentdir)
+epub_document_add_mathJax(EpubDocument *epub_document,gchar* containeruri)
 {
-	gchar *containerfilename= g_filename_from_uri(containeruri,NULL,NULL);
 	GString *mathjaxdir = g_string_new(MATHJAX_DIRECTORY);
 
 	gchar *mathjaxref = g_filename_to_uri(mathjaxdir->str,NULL,NULL);
 	gchar *nodedata = g_strdup_printf("%s/MathJax.js?config=TeX-AMS-MML_SVG",mathjaxref);
 
-	open_xml_document(containerfilename);
+	open_xml_document(containeruri);
 	set_xml_root_node(NULL);
 	xmlNodePtr manifest = xml_get_pointer_to_node((xmlChar*)"manifest",NULL,NULL);
 
@@ -1738,22 +1632,39 @@ epub_document_add_mathJax(gchar* containeruri,gchar* documentdir)
 		if (mathml != NULL &&
 		    !xmlStrcmp(mathml, (xmlChar*)"mathml") ) {
 			gchar *href = (gchar*)xml_get_data_from_node(item, XML_ATTRIBUTE, (xmlChar*)"href");
-			gchar *filename = g_strdup_printf("%s/%s",documentdir,href);
+			gchar *uri = epub_document_build_uri (epub_document, epub_document->documentdir, href);
 
-			add_mathjax_script_node_to_file(filename,nodedata);
+			add_mathjax_script_node_to_file(epub_document,uri,nodedata);
 			g_free(href);
-			g_free(filename);
+			g_free(uri);
 		}
 		g_free(mathml);
 		item = item->next;
 	}
 	xml_free_doc();
 	g_free(mathjaxref);
-	g_free(containerfilename);
 	g_free(nodedata);
 	g_string_free(mathjaxdir,TRUE);
 }
 
+static void
+epub_document_start_text_extraction (EpubDocument *epub_document)
+{
+	GList *l;
+
+	epub_document->chapter_uris = g_ptr_array_new_with_free_func (g_free);
+	for (l = epub_document->contentList; l; l = g_list_next (l)) {
+		contentListNode *node = l->data;
+
+		g_ptr_array_add (epub_document->chapter_uris, g_strdup (node->value));
+	}
+	epub_document->chapter_texts = g_new0 (EpubChapterText *, epub_document->chapter_uris->len);
+
+	epub_document->text_thread = g_thread_new ("EpubTextExtractor",
+	                                           (GThreadFunc) epub_document_extract_text_thread,
+	                                           epub_document);
+}
+
 static gboolean
 epub_document_load (EvDocument* document,
                     const char* uri,
@@ -1769,25 +1680,14 @@ epub_document_load (EvDocument* document,
 		return FALSE;
 	}
 
-	extract_epub_from_container (uri,epub_document,&err);
-
-	if ( err )
+	if ( open_epub_archive (uri,epub_document,&err) == FALSE )
 	{
 		g_propagate_error( error,err );
 		return FALSE;
 	}
 
 	/*FIXME : can this be different, ever?*/
-	GString *containerpath = g_string_new(epub_document->tmp_archive_dir);
-	g_string_append_printf(containerpath,"/META-INF/container.xml");
-	gchar *containeruri = g_filename_to_uri(containerpath->str,NULL,&err);
-	g_string_free (containerpath, TRUE);
-
-	if ( err )
-	{
-		g_propagate_error(error,err);
-		return FALSE;
-	}
+	gchar *containeruri = epub_archive_build_uri (epub_document->archive, "META-INF/container.xml");
 
 	gchar *contentOpfUri = get_uri_to_content (containeruri,&err,epub_document);
 	g_free (containeruri);
@@ -1801,12 +1701,12 @@ epub_document_load (EvDocument* document,
 	epub_document->docTitle = epub_document_set_document_title(contentOpfUri);
 	epub_document->index = setup_document_index(epub_document,contentOpfUri);
 
-	epub_document->contentList = setup_document_content_list (contentOpfUri,&err,epub_document->documentdir);
+	epub_document->contentList = setup_document_content_list (epub_document,contentOpfUri,&err);
 
     if (epub_document->index != NULL && epub_document->contentList != NULL)
 	    epub_document_set_index_pages(epub_document->index, epub_document->contentList);
 
-    epub_document_add_mathJax(contentOpfUri,epub_document->documentdir);
+    epub_document_add_mathJax(epub_document,contentOpfUri);
 	g_free (contentOpfUri);
 
 	if ( epub_document->contentList == NULL )
@@ -1815,6 +1715,8 @@ epub_document_load (EvDocument* document,
 		return FALSE;
 	}
 
+	epub_document_start_text_extraction (epub_document);
+
 	return TRUE;
 }
 
@@ -1822,11 +1724,12 @@ static void
 epub_document_init (EpubDocument *epub_document)
 {
     epub_document->archivename = NULL ;
-    epub_document->tmp_archive_dir = NULL ;
+    epub_document->archive = NULL ;
     epub_document->contentList = NULL ;
 	epub_document->documentdir = NULL;
 	epub_document->index = NULL;
 	epub_document->docTitle = NULL;
+	g_mutex_init (&epub_document->text_mutex);
 }
 
 
@@ -1835,12 +1738,24 @@ epub_document_finalize (GObject *object)
 {
 	EpubDocument *epub_document = EPUB_DOCUMENT (object);
 
-	if (epub_document->epubDocument != NULL) {
-		if (epub_remove_temporary_dir (epub_document->tmp_archive_dir) == -1)
-			g_warning (_("There was an error deleting “%s”."),
-				   epub_document->tmp_archive_dir);
+	if (epub_document->text_thread) {
+		g_atomic_int_set (&epub_document->text_cancelled, TRUE);
+		g_thread_join (epub_document->text_thread);
+		epub_document->text_thread = NULL;
 	}
 
+	if (epub_document->chapter_texts) {
+		guint i;
+
+		for (i = 0; i < epub_document->chapter_uris->len; i++)
+			epub_chapter_text_free (epub_document->chapter_texts[i]);
+		g_free (epub_document->chapter_texts);
+		epub_document->chapter_texts = NULL;
+	}
+	g_clear_pointer (&epub_document->chapter_uris, g_ptr_array_unref);
+	g_mutex_clear (&epub_document->text_mutex);
+
+
 	if ( epub_document->contentList ) {
             g_list_free_full(epub_document->contentList,(GDestroyNotify)free_tree_nodes);
 			epub_document->contentList = NULL;
@@ -1851,10 +1766,7 @@ epub_document_finalize (GObject *object)
 		epub_document->index = NULL;
 	}
 
-	if ( epub_document->tmp_archive_dir) {
-		g_free (epub_document->tmp_archive_dir);
-		epub_document->tmp_archive_dir = NULL;
-	}
+	g_clear_object (&epub_document->archive);
 
 	if (epub_document->docTitle) {
 		g_free(epub_document->docTitle);
@@ -1884,6 +1796,5 @@ epub_document_class_init (EpubDocumentClass *klass)
 	ev_document_class->get_n_pages = epub_document_get_n_pages;
 	ev_document_class->get_info = epub_document_get_info;
 	ev_document_class->get_page = epub_document_get_page;
-	ev_document_class->toggle_night_mode = epub_document_toggle_night_mode;
-    ev_document_class->check_add_night_sheet = epub_document_check_add_night_sheet;
+	ev_document_class->get_resource = epub_document_get_resource;
 }
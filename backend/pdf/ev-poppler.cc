@@ -23,6 +23,7 @@
 
 #include <math.h>
 #include <string.h>
+#include <unistd.h>
 #include <gtk/gtk.h>
 #include <poppler.h>
 #include <poppler-document.h>
@@ -34,11 +35,14 @@
 #include <cairo-ps.h>
 #endif
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #include "ev-poppler.h"
+#include "pdf-links-model.h"
 #include "ev-file-exporter.h"
 #include "ev-document-find.h"
 #include "ev-document-misc.h"
+#include "ev-file-helpers.h"
 #include "ev-document-links.h"
 #include "ev-document-images.h"
 #include "ev-document-fonts.h"
@@ -107,6 +111,13 @@ struct _PdfDocument
 	gboolean forms_modified;
 	gboolean annots_modified;
 
+	/* Size of the file when it was loaded, and size and
+	 * entity tag of the file after the last incremental save
+	 */
+	goffset load_size;
+	goffset file_size;
+	gchar *file_etag;
+
 	PopplerFontInfo *font_info;
 	PopplerFontsIter *fonts_iter;
 	int fonts_scanned_pages;
@@ -142,10 +153,8 @@ static EvLinkDest *ev_link_dest_from_dest    (PdfDocument       *pdf_document,
 static EvLink     *ev_link_from_action       (PdfDocument       *pdf_document,
 					      PopplerAction     *action);
 static void        pdf_print_context_free    (PdfPrintContext   *ctx);
-static gboolean    attachment_save_to_buffer (PopplerAttachment *attachment,
-					      gchar            **buffer,
-					      gsize             *buffer_size,
-					      GError           **error);
+static EvAttachment *ev_attachment_from_poppler_attachment (PopplerAttachment *attachment,
+							   GObject           *owner);
 
 EV_BACKEND_REGISTER_WITH_CODE (PdfDocument, pdf_document,
 			 {
@@ -208,6 +217,11 @@ pdf_document_dispose (GObject *object)
 		poppler_fonts_iter_free (pdf_document->fonts_iter);
 	}
 
+	if (pdf_document->file_etag) {
+		g_free (pdf_document->file_etag);
+		pdf_document->file_etag = NULL;
+	}
+
 	G_OBJECT_CLASS (pdf_document_parent_class)->dispose (object);
 }
 
@@ -272,6 +286,195 @@ pdf_document_save (EvDocument  *document,
 	return retval;
 }
 
+/* Returns the size and entity tag of @uri if it is a local file */
+static gboolean
+pdf_document_query_file (const char *uri,
+			 goffset    *size,
+			 gchar     **etag)
+{
+	GFile     *file;
+	GFileInfo *info = NULL;
+
+	file = g_file_new_for_uri (uri);
+	if (g_file_is_native (file))
+		info = g_file_query_info (file,
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+					  G_FILE_ATTRIBUTE_ETAG_VALUE,
+					  G_FILE_QUERY_INFO_NONE,
+					  NULL, NULL);
+	g_object_unref (file);
+
+	if (!info)
+		return FALSE;
+
+	*size = g_file_info_get_size (info);
+	*etag = g_strdup (g_file_info_get_etag (info));
+	g_object_unref (info);
+
+	return TRUE;
+}
+
+/* Number of bytes compared before the end of the original file to make
+ * sure poppler wrote an incremental update and not a full rewrite
+ */
+#define INCREMENTAL_CHECK_SIZE 1024
+
+/* @saved is a complete copy of the document written by poppler. When it
+ * is an incremental update of the file as it was loaded, @target gets the
+ * bytes past the loaded size, so that the result is identical to @saved.
+ * poppler's update always holds every change made since the document was
+ * loaded, so it replaces any update appended by an earlier save. The
+ * original bytes are never rewritten: should the write fail, @target is
+ * truncated back to its original size. Returns %FALSE when @target can't
+ * be updated this way, and a full save is needed instead.
+ */
+static gboolean
+pdf_document_append_update (PdfDocument *pdf_document,
+			    GFile       *saved,
+			    GFile       *target)
+{
+	GFileInputStream *input;
+	GFileIOStream    *io;
+	gchar             saved_tail[INCREMENTAL_CHECK_SIZE];
+	gchar             target_tail[INCREMENTAL_CHECK_SIZE];
+	gsize             check_size;
+	gsize             saved_read = 0;
+	gsize             target_read = 0;
+	gboolean          retval;
+
+	check_size = MIN (pdf_document->load_size, INCREMENTAL_CHECK_SIZE);
+
+	input = g_file_read (saved, NULL, NULL);
+	if (!input)
+		return FALSE;
+
+	io = g_file_open_readwrite (target, NULL, NULL);
+	if (!io) {
+		g_object_unref (input);
+		return FALSE;
+	}
+
+	retval = g_seekable_seek (G_SEEKABLE (input),
+				  pdf_document->load_size - check_size,
+				  G_SEEK_SET, NULL, NULL) &&
+		g_input_stream_read_all (G_INPUT_STREAM (input),
+					 saved_tail, check_size,
+					 &saved_read, NULL, NULL) &&
+		g_seekable_seek (G_SEEKABLE (io),
+				 pdf_document->load_size - check_size,
+				 G_SEEK_SET, NULL, NULL) &&
+		g_input_stream_read_all (g_io_stream_get_input_stream (G_IO_STREAM (io)),
+					 target_tail, check_size,
+					 &target_read, NULL, NULL) &&
+		saved_read == check_size && target_read == check_size &&
+		memcmp (saved_tail, target_tail, check_size) == 0;
+
+	if (retval) {
+		GOutputStream *output;
+
+		output = g_io_stream_get_output_stream (G_IO_STREAM (io));
+		retval = g_seekable_seek (G_SEEKABLE (io),
+					  pdf_document->load_size,
+					  G_SEEK_SET, NULL, NULL) &&
+			g_output_stream_splice (output,
+						G_INPUT_STREAM (input),
+						G_OUTPUT_STREAM_SPLICE_NONE,
+						NULL, NULL) != -1 &&
+			g_output_stream_flush (output, NULL, NULL) &&
+			/* Drop what is left of a longer earlier update */
+			g_seekable_truncate (G_SEEKABLE (io),
+					     g_seekable_tell (G_SEEKABLE (io)),
+					     NULL, NULL);
+		if (!retval)
+			g_seekable_truncate (G_SEEKABLE (io),
+					     pdf_document->load_size,
+					     NULL, NULL);
+	}
+	retval = g_io_stream_close (G_IO_STREAM (io), NULL, NULL) && retval;
+
+	g_object_unref (io);
+	g_object_unref (input);
+
+	return retval;
+}
+
+static gboolean
+pdf_document_save_incremental (EvDocument  *document,
+			       const char  *uri,
+			       GError     **error)
+{
+	PdfDocument *pdf_document = PDF_DOCUMENT (document);
+	goffset      size;
+	gchar       *etag = NULL;
+	gboolean     unchanged;
+	gchar       *tmp_filename = NULL;
+	gchar       *tmp_uri;
+	GError      *poppler_error = NULL;
+	gboolean     retval;
+	gint         fd;
+
+	if (pdf_document->load_size <= 0 ||
+	    !pdf_document_query_file (uri, &size, &etag))
+		return FALSE;
+
+	/* Somebody else wrote to the file, fall back to a full save */
+	unchanged = size == pdf_document->file_size &&
+		g_strcmp0 (etag, pdf_document->file_etag) == 0;
+	g_free (etag);
+	if (!unchanged)
+		return FALSE;
+
+	/* The file on disk is already up to date */
+	if (!pdf_document->forms_modified && !pdf_document->annots_modified)
+		return TRUE;
+
+	fd = ev_mkstemp ("saveupdate.XXXXXX", &tmp_filename, error);
+	if (fd == -1)
+		return FALSE;
+	close (fd);
+
+	tmp_uri = g_filename_to_uri (tmp_filename, NULL, error);
+	if (!tmp_uri) {
+		g_unlink (tmp_filename);
+		g_free (tmp_filename);
+		return FALSE;
+	}
+
+	/* poppler writes a modified document as the original file
+	 * followed by an incremental update with the changed objects
+	 */
+	retval = poppler_document_save (pdf_document->document,
+					tmp_uri, &poppler_error);
+	if (retval) {
+		GFile *saved = g_file_new_for_uri (tmp_uri);
+		GFile *target = g_file_new_for_uri (uri);
+
+		retval = pdf_document_append_update (pdf_document, saved,
+						     target);
+		g_object_unref (target);
+		g_object_unref (saved);
+	} else {
+		/* Let the full save report the error */
+		g_error_free (poppler_error);
+	}
+
+	g_unlink (tmp_filename);
+	g_free (tmp_filename);
+	g_free (tmp_uri);
+
+	if (retval) {
+		pdf_document->forms_modified = FALSE;
+		pdf_document->annots_modified = FALSE;
+	}
+
+	g_free (pdf_document->file_etag);
+	pdf_document->file_etag = NULL;
+	if (!pdf_document_query_file (uri, &pdf_document->file_size, &pdf_document->file_etag))
+		pdf_document->load_size = -1;
+
+	return retval;
+}
+
 static gboolean
 pdf_document_load (EvDocument   *document,
 		   const char   *uri,
@@ -288,6 +491,12 @@ pdf_document_load (EvDocument   *document,
 		return FALSE;
 	}
 
+	g_free (pdf_document->file_etag);
+	pdf_document->file_etag = NULL;
+	if (!pdf_document_query_file (uri, &pdf_document->file_size, &pdf_document->file_etag))
+		pdf_document->file_size = -1;
+	pdf_document->load_size = pdf_document->file_size;
+
 	return TRUE;
 }
 
@@ -823,6 +1032,7 @@ pdf_document_class_init (PdfDocumentClass *klass)
 	g_object_class->dispose = pdf_document_dispose;
 
 	ev_document_class->save = pdf_document_save;
+	ev_document_class->save_incremental = pdf_document_save_incremental;
 	ev_document_class->load = pdf_document_load;
 	ev_document_class->get_n_pages = pdf_document_get_n_pages;
 	ev_document_class->get_page = pdf_document_get_page;
@@ -838,8 +1048,8 @@ pdf_document_class_init (PdfDocumentClass *klass)
 static gboolean
 pdf_document_has_document_security (EvDocumentSecurity *document_security)
 {
-	/* FIXME: do we really need to have this? */
-	return FALSE;
+	/* Only documents that needed a password to be opened */
+	return PDF_DOCUMENT (document_security)->password != NULL;
 }
 
 static void
@@ -1196,59 +1406,11 @@ ev_link_from_action (PdfDocument   *pdf_document,
 	return link;
 }
 
-static void
-build_tree (PdfDocument      *pdf_document,
-	    GtkTreeModel     *model,
-	    GtkTreeIter      *parent,
-	    PopplerIndexIter *iter)
+static EvLink *
+pdf_document_links_link_from_action (EvDocumentLinks *document_links,
+				     PopplerAction   *action)
 {
-
-	do {
-		GtkTreeIter tree_iter;
-		PopplerIndexIter *child;
-		PopplerAction *action;
-		EvLink *link = NULL;
-		gboolean expand;
-		char *title_markup;
-
-		action = poppler_index_iter_get_action (iter);
-		expand = poppler_index_iter_is_open (iter);
-
-		if (!action)
-			continue;
-
-		/* Block zoom change when action link is pressed (bug fix #175) */
-		if (action->goto_dest.dest)
-			action->goto_dest.dest->change_zoom = 0;
-
-		link = ev_link_from_action (pdf_document, action);
-		if (!link || strlen (ev_link_get_title (link)) <= 0) {
-			poppler_action_free (action);
-			if (link)
-				g_object_unref (link);
-
-			continue;
-		}
-
-		gtk_tree_store_append (GTK_TREE_STORE (model), &tree_iter, parent);
-		title_markup = g_markup_escape_text (ev_link_get_title (link), -1);
-
-		gtk_tree_store_set (GTK_TREE_STORE (model), &tree_iter,
-				    EV_DOCUMENT_LINKS_COLUMN_MARKUP, title_markup,
-				    EV_DOCUMENT_LINKS_COLUMN_LINK, link,
-				    EV_DOCUMENT_LINKS_COLUMN_EXPAND, expand,
-				    -1);
-
-		g_free (title_markup);
-		g_object_unref (link);
-
-		child = poppler_index_iter_get_child (iter);
-		if (child)
-			build_tree (pdf_document, model, &tree_iter, child);
-		poppler_index_iter_free (child);
-		poppler_action_free (action);
-
-	} while (poppler_index_iter_next (iter));
+	return ev_link_from_action (PDF_DOCUMENT (document_links), action);
 }
 
 static GtkTreeModel *
@@ -1263,12 +1425,9 @@ pdf_document_links_get_links_model (EvDocumentLinks *document_links)
 	iter = poppler_index_iter_new (pdf_document->document);
 	/* Create the model if we have items*/
 	if (iter != NULL) {
-		model = (GtkTreeModel *) gtk_tree_store_new (EV_DOCUMENT_LINKS_COLUMN_NUM_COLUMNS,
-							     G_TYPE_STRING,
-							     G_TYPE_OBJECT,
-							     G_TYPE_BOOLEAN,
-							     G_TYPE_STRING);
-		build_tree (pdf_document, model, NULL, iter);
+		/* Children and destinations are read on demand */
+		model = pdf_links_model_new (document_links, iter,
+					     pdf_document_links_link_from_action);
 		poppler_index_iter_free (iter);
 	}
 
@@ -2656,29 +2815,18 @@ ev_annot_from_poppler_annot (PopplerAnnot *poppler_annot,
 	        case POPPLER_ANNOT_FILE_ATTACHMENT: {
 			PopplerAnnotFileAttachment *poppler_annot_attachment;
 			PopplerAttachment          *poppler_attachment;
-			gchar                      *data = NULL;
-			gsize                       size;
-			GError                     *error = NULL;
 
 			poppler_annot_attachment = POPPLER_ANNOT_FILE_ATTACHMENT (poppler_annot);
 			poppler_attachment = poppler_annot_file_attachment_get_attachment (poppler_annot_attachment);
 
-			if (poppler_attachment &&
-			    attachment_save_to_buffer (poppler_attachment, &data, &size, &error)) {
+			if (poppler_attachment) {
 				EvAttachment *ev_attachment;
-				GDateTime *poppler_attachment_mtime = poppler_attachment_get_mtime (poppler_attachment);
-				GDateTime *poppler_attachment_ctime = poppler_attachment_get_ctime (poppler_attachment);
-
-				ev_attachment = ev_attachment_new (poppler_attachment->name,
-								   poppler_attachment->description,
-                                   poppler_attachment_mtime,
-                                   poppler_attachment_ctime,
-								   size, data);
+
+				/* The page keeps the document the attachment stream belongs to alive */
+				ev_attachment = ev_attachment_from_poppler_attachment (poppler_attachment,
+										       G_OBJECT (page->backend_page));
 				ev_annot = ev_annotation_attachment_new (page, ev_attachment);
 				g_object_unref (ev_attachment);
-			} else if (error) {
-				g_warning ("%s", error->message);
-				g_error_free (error);
 			}
 
 			if (poppler_attachment)
@@ -3417,63 +3565,72 @@ pdf_document_document_annotations_iface_init (EvDocumentAnnotationsInterface *if
 }
 
 /* Attachments */
-struct SaveToBufferData {
-	gchar *buffer;
-	gsize len, max;
-};
+typedef struct {
+	PopplerAttachment *attachment;
+	GObject           *owner;
+} PdfAttachmentSource;
+
+static void
+pdf_attachment_source_free (gpointer data)
+{
+	PdfAttachmentSource *source = (PdfAttachmentSource *) data;
+
+	g_object_unref (source->attachment);
+	g_object_unref (source->owner);
+	g_slice_free (PdfAttachmentSource, source);
+}
 
 static gboolean
-attachment_save_to_buffer_callback (const gchar  *buf,
+attachment_save_to_stream_callback (const gchar  *buf,
 				    gsize         count,
 				    gpointer      user_data,
 				    GError      **error)
 {
-	struct SaveToBufferData *sdata = (SaveToBufferData *)user_data;
-	gchar *new_buffer;
-	gsize new_max;
-
-	if (sdata->len + count > sdata->max) {
-		new_max = MAX (sdata->max * 2, sdata->len + count);
-		new_buffer = (gchar *)g_realloc (sdata->buffer, new_max);
+	return g_output_stream_write_all (G_OUTPUT_STREAM (user_data),
+					  buf, count, NULL, NULL, error);
+}
 
-		sdata->buffer = new_buffer;
-		sdata->max = new_max;
-	}
+static gboolean
+pdf_attachment_save (EvAttachment  *ev_attachment,
+		     GOutputStream *stream,
+		     gpointer       user_data,
+		     GError       **error)
+{
+	PdfAttachmentSource *source = (PdfAttachmentSource *) user_data;
+	gboolean             retval;
 
-	memcpy (sdata->buffer + sdata->len, buf, count);
-	sdata->len += count;
+	ev_document_doc_mutex_lock ();
+	retval = poppler_attachment_save_to_callback (source->attachment,
+						      attachment_save_to_stream_callback,
+						      stream,
+						      error);
+	ev_document_doc_mutex_unlock ();
 
-	return TRUE;
+	return retval;
 }
 
-static gboolean
-attachment_save_to_buffer (PopplerAttachment  *attachment,
-			   gchar             **buffer,
-			   gsize              *buffer_size,
-			   GError            **error)
-{
-	static const gint initial_max = 1024;
-	struct SaveToBufferData sdata;
-
-	*buffer = NULL;
-	*buffer_size = 0;
-
-	sdata.buffer = (gchar *) g_malloc (initial_max);
-	sdata.max = initial_max;
-	sdata.len = 0;
-
-	if (! poppler_attachment_save_to_callback (attachment,
-						   attachment_save_to_buffer_callback,
-						   &sdata,
-						   error)) {
-		g_free (sdata.buffer);
-		return FALSE;
-	}
+/* Only the attachment metadata is read here, the embedded file is
+ * streamed from the document when the attachment is saved or opened.
+ * @owner must keep the document @attachment belongs to alive.
+ */
+static EvAttachment *
+ev_attachment_from_poppler_attachment (PopplerAttachment *attachment,
+				       GObject           *owner)
+{
+	PdfAttachmentSource *source;
 
-	*buffer = sdata.buffer;
-	*buffer_size = sdata.len;
+	source = g_slice_new (PdfAttachmentSource);
+	source->attachment = (PopplerAttachment *) g_object_ref (attachment);
+	source->owner = (GObject *) g_object_ref (owner);
 
-	return TRUE;
+	return ev_attachment_new_with_save_func (attachment->name,
+						 attachment->description,
+						 poppler_attachment_get_mtime (attachment),
+						 poppler_attachment_get_ctime (attachment),
+						 attachment->size,
+						 pdf_attachment_save,
+						 source,
+						 pdf_attachment_source_free);
 }
 
 static GList *
@@ -3488,34 +3645,14 @@ pdf_document_attachments_get_attachments (EvDocumentAttachments *document)
 
 	for (list = attachments; list; list = list->next) {
 		PopplerAttachment *attachment;
-		EvAttachment *ev_attachment;
-		gchar *data = NULL;
-		gsize size;
-		GError *error = NULL;
 
 		attachment = (PopplerAttachment *) list->data;
-
-		if (attachment_save_to_buffer (attachment, &data, &size, &error)) {
-			GDateTime *mtime = poppler_attachment_get_mtime (attachment);
-			GDateTime *ctime = poppler_attachment_get_ctime (attachment);
-			ev_attachment = ev_attachment_new (attachment->name,
-							   attachment->description,
-                               mtime,
-                               ctime,
-							   size, data);
-
-			retval = g_list_prepend (retval, ev_attachment);
-		} else {
-			if (error) {
-				g_warning ("%s", error->message);
-				g_error_free (error);
-
-				g_free (data);
-			}
-		}
-
+		retval = g_list_prepend (retval,
+					 ev_attachment_from_poppler_attachment (attachment,
+										G_OBJECT (pdf_document->document)));
 		g_object_unref (attachment);
 	}
+	g_list_free (attachments);
 
 	return g_list_reverse (retval);
 }
@@ -0,0 +1,499 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include "pdf-links-model.h"
+
+/* Read-only tree model for the document outline.
+ *
+ * Only the top level items are read when the model is created. The
+ * children of an item are read from the poppler index iterator the first
+ * time they are requested, and the EvLink of an item (which needs the
+ * destination page to be looked up) and its page label are only built
+ * when the corresponding columns are read. Nodes are never freed before
+ * the model, so iters are persistent.
+ *
+ * The model is meant to be used from one thread at a time. The document
+ * lock is taken around every lazy access to poppler, so the caller must
+ * not hold it.
+ */
+
+typedef struct _PdfLinksNode PdfLinksNode;
+
+struct _PdfLinksNode {
+	PdfLinksNode     *parent;
+	guint             index;
+
+	PopplerAction    *action;
+	gchar            *markup;
+	gboolean          expand;
+
+	/* Iterator positioned on the first child, until children is filled.
+	 * Left unset when none of the children has a title.
+	 */
+	PopplerIndexIter *child_iter;
+	GPtrArray        *children;
+
+	EvLink           *link;
+	gchar            *page_label;
+	gboolean          page_label_loaded;
+};
+
+struct _PdfLinksModel {
+	GObject               parent_instance;
+
+	gint                  stamp;
+	EvDocumentLinks      *document_links;
+	PdfLinksModelLinkFunc link_func;
+	PdfLinksNode         *root;
+};
+
+static void pdf_links_model_tree_model_iface_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (PdfLinksModel, pdf_links_model, G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+						pdf_links_model_tree_model_iface_init))
+
+static void
+pdf_links_node_free (PdfLinksNode *node)
+{
+	if (node->children)
+		g_ptr_array_free (node->children, TRUE);
+	poppler_index_iter_free (node->child_iter);
+	if (node->action)
+		poppler_action_free (node->action);
+	if (node->link)
+		g_object_unref (node->link);
+	g_free (node->markup);
+	g_free (node->page_label);
+	g_slice_free (PdfLinksNode, node);
+}
+
+/* Must be called with the document lock held */
+static gboolean
+pdf_links_iter_is_shown (PopplerIndexIter *iter,
+			 PopplerAction   **action)
+{
+	*action = poppler_index_iter_get_action (iter);
+	if (!*action)
+		return FALSE;
+
+	if (!(*action)->any.title || (*action)->any.title[0] == '\0') {
+		poppler_action_free (*action);
+		*action = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Must be called with the document lock held. Takes ownership of @iter
+ * and returns it when at least one of its entries will become a child
+ * node, or frees it so that no expander is drawn for an empty level.
+ */
+static PopplerIndexIter *
+pdf_links_iter_check_children (PopplerIndexIter *iter)
+{
+	PopplerIndexIter *scan;
+	PopplerAction    *action;
+	gboolean          shown;
+
+	if (!iter)
+		return NULL;
+
+	scan = poppler_index_iter_copy (iter);
+	do {
+		shown = pdf_links_iter_is_shown (scan, &action);
+		if (shown)
+			poppler_action_free (action);
+	} while (!shown && poppler_index_iter_next (scan));
+	poppler_index_iter_free (scan);
+
+	if (!shown) {
+		poppler_index_iter_free (iter);
+		return NULL;
+	}
+
+	return iter;
+}
+
+/* Must be called with the document lock held */
+static void
+pdf_links_node_read_children (PdfLinksNode     *node,
+			      PopplerIndexIter *iter)
+{
+	node->children = g_ptr_array_new_with_free_func ((GDestroyNotify)pdf_links_node_free);
+	if (!iter)
+		return;
+
+	do {
+		PdfLinksNode  *child;
+		PopplerAction *action;
+
+		if (!pdf_links_iter_is_shown (iter, &action))
+			continue;
+
+		/* Block zoom change when action link is pressed (bug fix #175) */
+		if (action->type == POPPLER_ACTION_GOTO_DEST && action->goto_dest.dest)
+			action->goto_dest.dest->change_zoom = 0;
+
+		child = g_slice_new0 (PdfLinksNode);
+		child->parent = node;
+		child->index = node->children->len;
+		child->action = action;
+		child->markup = g_markup_escape_text (action->any.title, -1);
+		child->expand = poppler_index_iter_is_open (iter);
+		child->child_iter = pdf_links_iter_check_children (poppler_index_iter_get_child (iter));
+
+		g_ptr_array_add (node->children, child);
+	} while (poppler_index_iter_next (iter));
+}
+
+static GPtrArray *
+pdf_links_node_get_children (PdfLinksNode *node)
+{
+	if (!node->children) {
+		ev_document_doc_mutex_lock ();
+		pdf_links_node_read_children (node, node->child_iter);
+		ev_document_doc_mutex_unlock ();
+
+		poppler_index_iter_free (node->child_iter);
+		node->child_iter = NULL;
+	}
+
+	return node->children;
+}
+
+static EvLink *
+pdf_links_model_get_node_link (PdfLinksModel *model,
+			       PdfLinksNode  *node)
+{
+	if (!node->link) {
+		ev_document_doc_mutex_lock ();
+		node->link = model->link_func (model->document_links, node->action);
+		ev_document_doc_mutex_unlock ();
+	}
+
+	return node->link;
+}
+
+static const gchar *
+pdf_links_model_get_node_page_label (PdfLinksModel *model,
+				     PdfLinksNode  *node)
+{
+	if (!node->page_label_loaded) {
+		EvLink *link;
+
+		link = pdf_links_model_get_node_link (model, node);
+		if (link) {
+			/* Named destinations are looked up in poppler */
+			ev_document_doc_mutex_lock ();
+			node->page_label = ev_document_links_get_link_page_label (model->document_links,
+										  link);
+			ev_document_doc_mutex_unlock ();
+		}
+		node->page_label_loaded = TRUE;
+	}
+
+	return node->page_label;
+}
+
+static inline PdfLinksNode *
+pdf_links_model_get_node (PdfLinksModel *model,
+			  GtkTreeIter   *iter)
+{
+	if (!iter)
+		return model->root;
+
+	g_return_val_if_fail (iter->stamp == model->stamp, NULL);
+
+	return iter->user_data;
+}
+
+static inline gboolean
+pdf_links_model_set_iter (PdfLinksModel *model,
+			  GtkTreeIter   *iter,
+			  PdfLinksNode  *node)
+{
+	iter->stamp = model->stamp;
+	iter->user_data = node;
+
+	return node != NULL;
+}
+
+static GtkTreeModelFlags
+pdf_links_model_get_flags (GtkTreeModel *tree_model)
+{
+	return GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+pdf_links_model_get_n_columns (GtkTreeModel *tree_model)
+{
+	return EV_DOCUMENT_LINKS_COLUMN_NUM_COLUMNS;
+}
+
+static GType
+pdf_links_model_get_column_type (GtkTreeModel *tree_model,
+				 gint          column)
+{
+	switch (column) {
+	case EV_DOCUMENT_LINKS_COLUMN_MARKUP:
+	case EV_DOCUMENT_LINKS_COLUMN_PAGE_LABEL:
+		return G_TYPE_STRING;
+	case EV_DOCUMENT_LINKS_COLUMN_LINK:
+		return G_TYPE_OBJECT;
+	case EV_DOCUMENT_LINKS_COLUMN_EXPAND:
+		return G_TYPE_BOOLEAN;
+	default:
+		g_assert_not_reached ();
+	}
+
+	return G_TYPE_INVALID;
+}
+
+static gboolean
+pdf_links_model_get_iter (GtkTreeModel *tree_model,
+			  GtkTreeIter  *iter,
+			  GtkTreePath  *path)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = model->root;
+	gint          *indices;
+	gint           depth, i;
+
+	indices = gtk_tree_path_get_indices (path);
+	depth = gtk_tree_path_get_depth (path);
+	for (i = 0; i < depth; i++) {
+		GPtrArray *children = pdf_links_node_get_children (node);
+
+		if (indices[i] < 0 || (guint)indices[i] >= children->len)
+			return FALSE;
+		node = g_ptr_array_index (children, indices[i]);
+	}
+
+	if (node == model->root)
+		return FALSE;
+
+	return pdf_links_model_set_iter (model, iter, node);
+}
+
+static GtkTreePath *
+pdf_links_model_get_path (GtkTreeModel *tree_model,
+			  GtkTreeIter  *iter)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, iter);
+	GtkTreePath   *path;
+
+	path = gtk_tree_path_new ();
+	for (; node && node->parent; node = node->parent)
+		gtk_tree_path_prepend_index (path, node->index);
+
+	return path;
+}
+
+static void
+pdf_links_model_get_value (GtkTreeModel *tree_model,
+			   GtkTreeIter  *iter,
+			   gint          column,
+			   GValue       *value)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, iter);
+
+	g_value_init (value, pdf_links_model_get_column_type (tree_model, column));
+	if (!node || node == model->root)
+		return;
+
+	switch (column) {
+	case EV_DOCUMENT_LINKS_COLUMN_MARKUP:
+		g_value_set_string (value, node->markup);
+		break;
+	case EV_DOCUMENT_LINKS_COLUMN_LINK:
+		g_value_set_object (value, pdf_links_model_get_node_link (model, node));
+		break;
+	case EV_DOCUMENT_LINKS_COLUMN_EXPAND:
+		g_value_set_boolean (value, node->expand);
+		break;
+	case EV_DOCUMENT_LINKS_COLUMN_PAGE_LABEL:
+		g_value_set_string (value, pdf_links_model_get_node_page_label (model, node));
+		break;
+	}
+}
+
+static gboolean
+pdf_links_model_iter_next (GtkTreeModel *tree_model,
+			   GtkTreeIter  *iter)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, iter);
+	GPtrArray     *siblings;
+
+	if (!node || !node->parent)
+		return FALSE;
+
+	siblings = node->parent->children;
+	if (node->index + 1 >= siblings->len)
+		return pdf_links_model_set_iter (model, iter, NULL);
+
+	return pdf_links_model_set_iter (model, iter,
+					 g_ptr_array_index (siblings, node->index + 1));
+}
+
+static gboolean
+pdf_links_model_iter_nth_child (GtkTreeModel *tree_model,
+				GtkTreeIter  *iter,
+				GtkTreeIter  *parent,
+				gint          n)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, parent);
+	GPtrArray     *children;
+
+	if (!node)
+		return FALSE;
+
+	children = pdf_links_node_get_children (node);
+	if (n < 0 || (guint)n >= children->len)
+		return FALSE;
+
+	return pdf_links_model_set_iter (model, iter, g_ptr_array_index (children, n));
+}
+
+static gboolean
+pdf_links_model_iter_children (GtkTreeModel *tree_model,
+			       GtkTreeIter  *iter,
+			       GtkTreeIter  *parent)
+{
+	return pdf_links_model_iter_nth_child (tree_model, iter, parent, 0);
+}
+
+static gboolean
+pdf_links_model_iter_has_child (GtkTreeModel *tree_model,
+				GtkTreeIter  *iter)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, iter);
+
+	if (!node)
+		return FALSE;
+
+	/* Don't read the children just to draw the expander */
+	if (!node->children)
+		return node->child_iter != NULL;
+
+	return node->children->len > 0;
+}
+
+static gint
+pdf_links_model_iter_n_children (GtkTreeModel *tree_model,
+				 GtkTreeIter  *iter)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, iter);
+
+	if (!node)
+		return 0;
+
+	return pdf_links_node_get_children (node)->len;
+}
+
+static gboolean
+pdf_links_model_iter_parent (GtkTreeModel *tree_model,
+			     GtkTreeIter  *iter,
+			     GtkTreeIter  *child)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (tree_model);
+	PdfLinksNode  *node = pdf_links_model_get_node (model, child);
+
+	if (!node || !node->parent || node->parent == model->root)
+		return FALSE;
+
+	return pdf_links_model_set_iter (model, iter, node->parent);
+}
+
+static void
+pdf_links_model_finalize (GObject *object)
+{
+	PdfLinksModel *model = PDF_LINKS_MODEL (object);
+
+	pdf_links_node_free (model->root);
+	g_object_unref (model->document_links);
+
+	G_OBJECT_CLASS (pdf_links_model_parent_class)->finalize (object);
+}
+
+static void
+pdf_links_model_init (PdfLinksModel *model)
+{
+	model->stamp = g_random_int ();
+}
+
+static void
+pdf_links_model_class_init (PdfLinksModelClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = pdf_links_model_finalize;
+}
+
+static void
+pdf_links_model_tree_model_iface_init (GtkTreeModelIface *iface)
+{
+	iface->get_flags = pdf_links_model_get_flags;
+	iface->get_n_columns = pdf_links_model_get_n_columns;
+	iface->get_column_type = pdf_links_model_get_column_type;
+	iface->get_iter = pdf_links_model_get_iter;
+	iface->get_path = pdf_links_model_get_path;
+	iface->get_value = pdf_links_model_get_value;
+	iface->iter_next = pdf_links_model_iter_next;
+	iface->iter_children = pdf_links_model_iter_children;
+	iface->iter_has_child = pdf_links_model_iter_has_child;
+	iface->iter_n_children = pdf_links_model_iter_n_children;
+	iface->iter_nth_child = pdf_links_model_iter_nth_child;
+	iface->iter_parent = pdf_links_model_iter_parent;
+}
+
+/**
+ * pdf_links_model_new:
+ * @document_links: the #EvDocumentLinks the outline belongs to
+ * @iter: a #PopplerIndexIter for the top level of the outline
+ * @link_func: function used to build the #EvLink of an outline item
+ *
+ * Creates a model for the outline, reading only its top level from @iter.
+ * Must be called with the document lock held.
+ *
+ * Returns: (transfer full): a new #GtkTreeModel
+ */
+GtkTreeModel *
+pdf_links_model_new (EvDocumentLinks       *document_links,
+		     PopplerIndexIter      *iter,
+		     PdfLinksModelLinkFunc  link_func)
+{
+	PdfLinksModel *model;
+
+	model = g_object_new (PDF_TYPE_LINKS_MODEL, NULL);
+	model->document_links = g_object_ref (document_links);
+	model->link_func = link_func;
+
+	model->root = g_slice_new0 (PdfLinksNode);
+	pdf_links_node_read_children (model->root, iter);
+
+	return GTK_TREE_MODEL (model);
+}
@@ -0,0 +1,37 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <poppler.h>
+
+#include "ev-document-links.h"
+
+G_BEGIN_DECLS
+
+typedef EvLink *(* PdfLinksModelLinkFunc) (EvDocumentLinks *document_links,
+					   PopplerAction   *action);
+
+#define PDF_TYPE_LINKS_MODEL pdf_links_model_get_type ()
+G_DECLARE_FINAL_TYPE (PdfLinksModel, pdf_links_model, PDF, LINKS_MODEL, GObject)
+
+GtkTreeModel *pdf_links_model_new (EvDocumentLinks       *document_links,
+				   PopplerIndexIter      *iter,
+				   PdfLinksModelLinkFunc  link_func);
+
+G_END_DECLS
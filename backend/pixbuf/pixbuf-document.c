@@ -25,6 +25,20 @@
 #include "ev-document-misc.h"
 #include "ev-file-helpers.h"
 
+/* Upper bound for the decoded levels kept around between renders */
+#define LEVELS_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+/* The image is never kept resident at full resolution.  Instead, the
+ * level needed for a given scale (the image downsampled by a power of
+ * two) is decoded on demand, using the loader size hints so that
+ * formats able to decode at a reduced size (like JPEG) never allocate
+ * the full image, and a few recently used levels are cached.
+ */
+typedef struct {
+	gint       level;
+	GdkPixbuf *pixbuf;
+} PixbufLevel;
+
 struct _PixbufDocumentClass
 {
 	EvDocumentClass parent_class;
@@ -34,9 +48,14 @@ struct _PixbufDocument
 {
 	EvDocument parent_instance;
 
-	GdkPixbuf *pixbuf;
-	
 	gchar *uri;
+	gchar *filename;
+
+	gint width;
+	gint height;
+
+	GQueue levels;
+	gsize  levels_size;
 };
 
 typedef struct _PixbufDocumentClass PixbufDocumentClass;
@@ -49,6 +68,148 @@ EV_BACKEND_REGISTER_WITH_CODE (PixbufDocument, pixbuf_document,
 							 pixbuf_document_document_thumbnails_iface_init)				   
 		   });
 
+static gsize
+pixbuf_level_get_size (PixbufLevel *level)
+{
+	return gdk_pixbuf_get_rowstride (level->pixbuf) *
+		gdk_pixbuf_get_height (level->pixbuf);
+}
+
+static void
+pixbuf_level_free (PixbufLevel *level)
+{
+	g_object_unref (level->pixbuf);
+	g_slice_free (PixbufLevel, level);
+}
+
+static void
+pixbuf_document_clear_levels (PixbufDocument *pixbuf_document)
+{
+	PixbufLevel *level;
+
+	while ((level = g_queue_pop_head (&pixbuf_document->levels)))
+		pixbuf_level_free (level);
+	pixbuf_document->levels_size = 0;
+}
+
+static void
+pixbuf_document_add_level (PixbufDocument *pixbuf_document,
+			   gint            level_index,
+			   GdkPixbuf      *pixbuf)
+{
+	PixbufLevel *level;
+
+	level = g_slice_new (PixbufLevel);
+	level->level = level_index;
+	level->pixbuf = g_object_ref (pixbuf);
+
+	g_queue_push_head (&pixbuf_document->levels, level);
+	pixbuf_document->levels_size += pixbuf_level_get_size (level);
+
+	/* Always keep the level just added, even when it's over budget */
+	while (pixbuf_document->levels_size > LEVELS_CACHE_MAX_SIZE &&
+	       pixbuf_document->levels.length > 1) {
+		level = g_queue_pop_tail (&pixbuf_document->levels);
+		pixbuf_document->levels_size -= pixbuf_level_get_size (level);
+		pixbuf_level_free (level);
+	}
+}
+
+static gint
+pixbuf_document_get_level_for_scale (PixbufDocument *pixbuf_document,
+				     gdouble         scale)
+{
+	gint min_size = MIN (pixbuf_document->width, pixbuf_document->height);
+	gint level = 0;
+
+	/* Coarsest level that still has at least the requested resolution */
+	while (level < 30 &&
+	       scale * (2 << level) <= 1.0 &&
+	       (min_size >> (level + 1)) > 0)
+		level++;
+
+	return level;
+}
+
+static GdkPixbuf *
+pixbuf_document_get_level (PixbufDocument *pixbuf_document,
+			   gint            level_index,
+			   GError        **error)
+{
+	PixbufLevel *finer = NULL;
+	GdkPixbuf   *pixbuf;
+	GList       *l;
+	gint         width, height;
+
+	for (l = pixbuf_document->levels.head; l; l = l->next) {
+		PixbufLevel *level = l->data;
+
+		if (level->level == level_index) {
+			g_queue_unlink (&pixbuf_document->levels, l);
+			g_queue_push_head_link (&pixbuf_document->levels, l);
+
+			return g_object_ref (level->pixbuf);
+		}
+
+		if (level->level < level_index &&
+		    (!finer || level->level > finer->level))
+			finer = level;
+	}
+
+	width = MAX (1, (pixbuf_document->width + (1 << level_index) - 1) >> level_index);
+	height = MAX (1, (pixbuf_document->height + (1 << level_index) - 1) >> level_index);
+
+	if (finer) {
+		/* Downsampling a cached level is much cheaper than decoding again */
+		pixbuf = gdk_pixbuf_scale_simple (finer->pixbuf, width, height,
+						  GDK_INTERP_BILINEAR);
+	} else if (level_index == 0) {
+		pixbuf = gdk_pixbuf_new_from_file (pixbuf_document->filename, error);
+	} else {
+		pixbuf = gdk_pixbuf_new_from_file_at_size (pixbuf_document->filename,
+							   width, height, error);
+	}
+
+	if (!pixbuf)
+		return NULL;
+
+	pixbuf_document_add_level (pixbuf_document, level_index, pixbuf);
+
+	return pixbuf;
+}
+
+static GdkPixbuf *
+pixbuf_document_get_scaled_pixbuf (PixbufDocument *pixbuf_document,
+				   gdouble         scale,
+				   gint            width,
+				   gint            height)
+{
+	GdkPixbuf *pixbuf, *scaled_pixbuf;
+	GError    *error = NULL;
+	gint       level;
+
+	level = pixbuf_document_get_level_for_scale (pixbuf_document, scale);
+	pixbuf = pixbuf_document_get_level (pixbuf_document, level, &error);
+	if (!pixbuf) {
+		g_warning ("Error loading image: %s", error->message);
+		g_error_free (error);
+
+		return NULL;
+	}
+
+	width = MAX (width, 1);
+	height = MAX (height, 1);
+	if (gdk_pixbuf_get_width (pixbuf) == width &&
+	    gdk_pixbuf_get_height (pixbuf) == height)
+		return pixbuf;
+
+	scaled_pixbuf = gdk_pixbuf_scale_simple (pixbuf, width, height,
+						 GDK_INTERP_BILINEAR);
+	g_object_unref (pixbuf);
+
+	return scaled_pixbuf;
+}
+
 static gboolean
 pixbuf_document_load (EvDocument  *document,
 		      const char  *uri,
@@ -57,19 +218,38 @@ pixbuf_document_load (EvDocument  *document,
 	PixbufDocument *pixbuf_document = PIXBUF_DOCUMENT (document);
 	
 	gchar *filename;
-	GdkPixbuf *pixbuf;
+	GdkPixbuf *pixbuf = NULL;
+	gint width, height;
 
 	/* FIXME: We could actually load uris  */
 	filename = g_filename_from_uri (uri, NULL, error);
 	if (!filename)
 		return FALSE;
-	
-	pixbuf = gdk_pixbuf_new_from_file (filename, error);
 
-	if (!pixbuf)
-		return FALSE;
+	/* Only the header is read here, the pixels are decoded when rendering */
+	if (!gdk_pixbuf_get_file_info (filename, &width, &height) ||
+	    width <= 0 || height <= 0) {
+		/* Decode the whole image to get a proper error */
+		pixbuf = gdk_pixbuf_new_from_file (filename, error);
+		if (!pixbuf) {
+			g_free (filename);
+			return FALSE;
+		}
+
+		width = gdk_pixbuf_get_width (pixbuf);
+		height = gdk_pixbuf_get_height (pixbuf);
+	}
+
+	pixbuf_document_clear_levels (pixbuf_document);
+	pixbuf_document->width = width;
+	pixbuf_document->height = height;
+	if (pixbuf) {
+		pixbuf_document_add_level (pixbuf_document, 0, pixbuf);
+		g_object_unref (pixbuf);
+	}
 
-	pixbuf_document->pixbuf = pixbuf;
+	g_free (pixbuf_document->filename);
+	pixbuf_document->filename = filename;
 	g_free (pixbuf_document->uri);
 	pixbuf_document->uri = g_strdup (uri);
 	
@@ -100,8 +280,8 @@ pixbuf_document_get_page_size (EvDocument   *document,
 {
 	PixbufDocument *pixbuf_document = PIXBUF_DOCUMENT (document);
 
-	*width = gdk_pixbuf_get_width (pixbuf_document->pixbuf);
-	*height = gdk_pixbuf_get_height (pixbuf_document->pixbuf);
+	*width = pixbuf_document->width;
+	*height = pixbuf_document->height;
 }
 
 static cairo_surface_t *
@@ -112,11 +292,12 @@ pixbuf_document_render (EvDocument      *document,
 	GdkPixbuf *scaled_pixbuf, *rotated_pixbuf;
 	cairo_surface_t *surface;
 
-	scaled_pixbuf = gdk_pixbuf_scale_simple (
-		pixbuf_document->pixbuf,
-		(gdk_pixbuf_get_width (pixbuf_document->pixbuf) * rc->scale) + 0.5,
-		(gdk_pixbuf_get_height (pixbuf_document->pixbuf) * rc->scale) + 0.5,
-		GDK_INTERP_BILINEAR);
+	scaled_pixbuf = pixbuf_document_get_scaled_pixbuf (
+		pixbuf_document, rc->scale,
+		(pixbuf_document->width * rc->scale) + 0.5,
+		(pixbuf_document->height * rc->scale) + 0.5);
+	if (!scaled_pixbuf)
+		return NULL;
 	
         rotated_pixbuf = gdk_pixbuf_rotate_simple (scaled_pixbuf, 360 - rc->rotation);
         g_object_unref (scaled_pixbuf);
@@ -132,8 +313,9 @@ pixbuf_document_finalize (GObject *object)
 {
 	PixbufDocument *pixbuf_document = PIXBUF_DOCUMENT (object);
 
-	g_object_unref (pixbuf_document->pixbuf);
+	pixbuf_document_clear_levels (pixbuf_document);
 	g_free (pixbuf_document->uri);
+	g_free (pixbuf_document->filename);
 	
 	G_OBJECT_CLASS (pixbuf_document_parent_class)->finalize (object);
 }
@@ -162,12 +344,13 @@ pixbuf_document_thumbnails_get_thumbnail (EvDocumentThumbnails *document,
 	GdkPixbuf *pixbuf, *rotated_pixbuf;
 	gint width, height;
 	
-	width = (gint) (gdk_pixbuf_get_width (pixbuf_document->pixbuf) * rc->scale);
-	height = (gint) (gdk_pixbuf_get_height (pixbuf_document->pixbuf) * rc->scale);
+	width = (gint) (pixbuf_document->width * rc->scale);
+	height = (gint) (pixbuf_document->height * rc->scale);
 	
-	pixbuf = gdk_pixbuf_scale_simple (pixbuf_document->pixbuf,
-					  width, height,
-					  GDK_INTERP_BILINEAR);
+	pixbuf = pixbuf_document_get_scaled_pixbuf (pixbuf_document, rc->scale,
+						     width, height);
+	if (!pixbuf)
+		return NULL;
 
 	rotated_pixbuf = gdk_pixbuf_rotate_simple (pixbuf, 360 - rc->rotation);
         g_object_unref (pixbuf);
@@ -182,8 +365,8 @@ pixbuf_document_thumbnails_get_dimensions (EvDocumentThumbnails *document,
 					   gint                 *height)
 {
 	PixbufDocument *pixbuf_document = PIXBUF_DOCUMENT (document);
-	gint p_width = gdk_pixbuf_get_width (pixbuf_document->pixbuf);
-	gint p_height = gdk_pixbuf_get_height (pixbuf_document->pixbuf);
+	gint p_width = pixbuf_document->width;
+	gint p_height = pixbuf_document->height;
 
 	if (rc->rotation == 90 || rc->rotation == 270) {
 		*width = (gint) (p_height * rc->scale);
@@ -205,4 +388,5 @@ pixbuf_document_document_thumbnails_iface_init (EvDocumentThumbnailsInterface *i
 static void
 pixbuf_document_init (PixbufDocument *pixbuf_document)
 {
+	g_queue_init (&pixbuf_document->levels);
 }
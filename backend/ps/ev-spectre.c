@@ -30,11 +30,27 @@
 #include "ev-document-thumbnails.h"
 #include "ev-document-misc.h"
 
+/* Budget for the pages kept after rendering them */
+#define RENDER_CACHE_MAX_SIZE (32 * 1024 * 1024)
+
+typedef struct {
+	gint             index;
+	gint             rotation;
+	cairo_surface_t *surface;
+} PSRenderedPage;
+
 struct _PSDocument {
 	EvDocument object;
 
 	SpectreDocument *doc;
 	SpectreExporter *exporter;
+
+	/* Every render runs Ghostscript from scratch, keep the last
+	 * pages around to produce other (smaller) scales from them.
+	 */
+	SpectreRenderContext *render_context;
+	GQueue                rendered_pages;
+	gsize                 rendered_size;
 };
 
 struct _PSDocumentClass {
@@ -56,6 +72,31 @@ EV_BACKEND_REGISTER_WITH_CODE (PSDocument, ps_document,
 static void
 ps_document_init (PSDocument *ps_document)
 {
+	g_queue_init (&ps_document->rendered_pages);
+}
+
+static gsize
+ps_rendered_page_get_size (PSRenderedPage *rendered)
+{
+	return cairo_image_surface_get_stride (rendered->surface) *
+		cairo_image_surface_get_height (rendered->surface);
+}
+
+static void
+ps_rendered_page_free (PSRenderedPage *rendered)
+{
+	cairo_surface_destroy (rendered->surface);
+	g_slice_free (PSRenderedPage, rendered);
+}
+
+static void
+ps_document_clear_rendered_pages (PSDocument *ps)
+{
+	PSRenderedPage *rendered;
+
+	while ((rendered = g_queue_pop_head (&ps->rendered_pages)))
+		ps_rendered_page_free (rendered);
+	ps->rendered_size = 0;
 }
 
 static void
@@ -63,6 +104,13 @@ ps_document_dispose (GObject *object)
 {
 	PSDocument *ps = PS_DOCUMENT (object);
 
+	ps_document_clear_rendered_pages (ps);
+
+	if (ps->render_context) {
+		spectre_render_context_free (ps->render_context);
+		ps->render_context = NULL;
+	}
+
 	if (ps->doc) {
 		spectre_document_free (ps->doc);
 		ps->doc = NULL;
@@ -89,6 +137,7 @@ ps_document_load (EvDocument *document,
 	if (!filename)
 		return FALSE;
 	
+	ps_document_clear_rendered_pages (ps);
 	ps->doc = spectre_document_new ();
 
 	spectre_document_load (ps->doc, filename);
@@ -283,12 +332,87 @@ ps_document_get_backend_info (EvDocument            *document,
 	return TRUE;
 }
 
+/* Draws @surface scaled to @width x @height into a new surface */
+static cairo_surface_t *
+ps_document_scale_surface (cairo_surface_t *surface,
+			   gint             width,
+			   gint             height)
+{
+	cairo_surface_t *new_surface;
+	cairo_t         *cr;
+
+	new_surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+	cr = cairo_create (new_surface);
+	cairo_scale (cr,
+		     (gdouble)width / cairo_image_surface_get_width (surface),
+		     (gdouble)height / cairo_image_surface_get_height (surface));
+	cairo_set_source_surface (cr, surface, 0, 0);
+	cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_GOOD);
+	cairo_paint (cr);
+	cairo_destroy (cr);
+
+	return new_surface;
+}
+
+/* Finds a rendered page at least as large as the requested one */
+static PSRenderedPage *
+ps_document_lookup_rendered_page (PSDocument *ps,
+				  gint        index,
+				  gint        rotation,
+				  gint        width,
+				  gint        height)
+{
+	GList *l;
+
+	for (l = ps->rendered_pages.head; l; l = l->next) {
+		PSRenderedPage *rendered = l->data;
+
+		if (rendered->index != index || rendered->rotation != rotation)
+			continue;
+		if (cairo_image_surface_get_width (rendered->surface) < width ||
+		    cairo_image_surface_get_height (rendered->surface) < height)
+			continue;
+
+		g_queue_unlink (&ps->rendered_pages, l);
+		g_queue_push_head_link (&ps->rendered_pages, l);
+
+		return rendered;
+	}
+
+	return NULL;
+}
+
+static void
+ps_document_add_rendered_page (PSDocument      *ps,
+			       gint             index,
+			       gint             rotation,
+			       cairo_surface_t *surface)
+{
+	PSRenderedPage *rendered;
+
+	rendered = g_slice_new (PSRenderedPage);
+	rendered->index = index;
+	rendered->rotation = rotation;
+	rendered->surface = cairo_surface_reference (surface);
+
+	g_queue_push_head (&ps->rendered_pages, rendered);
+	ps->rendered_size += ps_rendered_page_get_size (rendered);
+
+	while (ps->rendered_size > RENDER_CACHE_MAX_SIZE &&
+	       g_queue_get_length (&ps->rendered_pages) > 1) {
+		rendered = g_queue_pop_tail (&ps->rendered_pages);
+		ps->rendered_size -= ps_rendered_page_get_size (rendered);
+		ps_rendered_page_free (rendered);
+	}
+}
+
 static cairo_surface_t *
 ps_document_render (EvDocument      *document,
 		    EvRenderContext *rc)
 {
+	PSDocument           *ps = PS_DOCUMENT (document);
 	SpectrePage          *ps_page;
-	SpectreRenderContext *src;
+	PSRenderedPage       *rendered;
 	gint                  width_points;
 	gint                  height_points;
 	gint                  width, height;
@@ -297,6 +421,7 @@ ps_document_render (EvDocument      *document,
 	gint                  stride;
 	gint                  rotation;
 	cairo_surface_t      *surface;
+	cairo_surface_t      *copy;
 	static const cairo_user_data_key_t key;
 
 	ps_page = (SpectrePage *)rc->page->backend_page;
@@ -307,13 +432,27 @@ ps_document_render (EvDocument      *document,
 	height = (gint) ((height_points * rc->scale) + 0.5);
 	rotation = (rc->rotation + get_page_rotation (ps_page)) % 360;
 
-	src = spectre_render_context_new ();
-	spectre_render_context_set_scale (src,
+	if (rotation == 90 || rotation == 270) {
+		swidth = height;
+		sheight = width;
+	} else {
+		swidth = width;
+		sheight = height;
+	}
+
+	/* Thumbnails and zooming out don't need Ghostscript again */
+	rendered = ps_document_lookup_rendered_page (ps, rc->page->index, rotation,
+						     swidth, sheight);
+	if (rendered)
+		return ps_document_scale_surface (rendered->surface, swidth, sheight);
+
+	if (!ps->render_context)
+		ps->render_context = spectre_render_context_new ();
+	spectre_render_context_set_scale (ps->render_context,
 					  (gdouble)width / width_points,
 					  (gdouble)height / height_points);
-	spectre_render_context_set_rotation (src, rotation);
-	spectre_page_render (ps_page, src, &data, &stride);
-	spectre_render_context_free (src);
+	spectre_render_context_set_rotation (ps->render_context, rotation);
+	spectre_page_render (ps_page, ps->render_context, &data, &stride);
 
 	if (spectre_page_status (ps_page) != SPECTRE_STATUS_SUCCESS) {
 		g_warning ("libspectre reports: %s",
@@ -326,21 +465,21 @@ ps_document_render (EvDocument      *document,
 		return NULL;
 	}
 
-	if (rotation == 90 || rotation == 270) {
-		swidth = height;
-		sheight = width;
-	} else {
-		swidth = width;
-		sheight = height;
-	}
-	
 	surface = cairo_image_surface_create_for_data (data,
 						       CAIRO_FORMAT_RGB24,
 						       swidth, sheight,
 						       stride);
 	cairo_surface_set_user_data (surface, &key,
 				     data, (cairo_destroy_func_t)g_free);
-	return surface;
+
+	/* The caller may modify the surface it gets (e.g. to invert
+	 * colors), so it gets a copy of the one that is kept.
+	 */
+	ps_document_add_rendered_page (ps, rc->page->index, rotation, surface);
+	copy = ps_document_scale_surface (surface, swidth, sheight);
+	cairo_surface_destroy (surface);
+
+	return copy;
 }
 
 static void
@@ -24,6 +24,7 @@
 
 #include <config.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #include <glib/gi18n-lib.h>
 
@@ -40,12 +41,24 @@ struct _TiffDocumentClass
   EvDocumentClass parent_class;
 };
 
+/* What is needed of a directory without reading it again */
+typedef struct
+{
+  toff_t  offset;
+  guint32 width;
+  guint32 height;
+  gfloat  x_res;
+  gfloat  y_res;
+  guint16 orientation;
+} TiffPageInfo;
+
 struct _TiffDocument
 {
   EvDocument parent_instance;
 
   TIFF *tiff;
   gint n_pages;
+  TiffPageInfo *pages;
   TIFF2PSContext *ps_export_ctx;
   
   gchar *uri;
@@ -81,6 +94,62 @@ pop_handlers (void)
 	TIFFSetWarningHandler (orig_warning_handler);
 }
 
+static void
+tiff_document_get_resolution (TIFF   *tiff,
+			      gfloat *x_res,
+			      gfloat *y_res)
+{
+	gfloat x = 72.0, y = 72.0;
+	gushort unit;
+	
+	if (TIFFGetField (tiff, TIFFTAG_XRESOLUTION, &x) &&
+	    TIFFGetField (tiff, TIFFTAG_YRESOLUTION, &y)) {
+		if (TIFFGetFieldDefaulted (tiff, TIFFTAG_RESOLUTIONUNIT, &unit)) {
+			if (unit == RESUNIT_CENTIMETER) {
+				x *= 2.54;
+				y *= 2.54;
+			}
+		}
+	}
+
+	*x_res = x;
+	*y_res = y;
+}
+
+/* Reads every directory once, in order, recording where it starts */
+static void
+tiff_document_index_pages (TiffDocument *tiff_document)
+{
+	TIFF   *tiff = tiff_document->tiff;
+	GArray *pages;
+
+	pages = g_array_new (FALSE, TRUE, sizeof (TiffPageInfo));
+	do {
+		TiffPageInfo info = { 0, };
+
+		info.offset = TIFFCurrentDirOffset (tiff);
+		TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &info.width);
+		TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &info.height);
+		TIFFGetFieldDefaulted (tiff, TIFFTAG_ORIENTATION, &info.orientation);
+		tiff_document_get_resolution (tiff, &info.x_res, &info.y_res);
+		g_array_append_val (pages, info);
+	} while (TIFFReadDirectory (tiff));
+
+	tiff_document->n_pages = pages->len;
+	tiff_document->pages = (TiffPageInfo *) g_array_free (pages, FALSE);
+}
+
+static gboolean
+tiff_document_set_page (TiffDocument *tiff_document,
+			gint          page)
+{
+	if (page < 0 || page >= tiff_document->n_pages)
+		return FALSE;
+
+	return TIFFSetSubDirectory (tiff_document->tiff,
+				    tiff_document->pages[page].offset) == 1;
+}
+
 static gboolean
 tiff_document_load (EvDocument  *document,
 		    const char  *uri,
@@ -97,14 +166,6 @@ tiff_document_load (EvDocument  *document,
 	push_handlers ();
 
 	tiff = TIFFOpen (filename, "r");
-	if (tiff) {
-		guint32 w, h;
-		
-		/* FIXME: unused data? why bother here */
-		TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &w);
-		TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &h);
-	}
-	
 	if (!tiff) {
 		pop_handlers ();
 
@@ -118,6 +179,7 @@ tiff_document_load (EvDocument  *document,
 	}
 	
 	tiff_document->tiff = tiff;
+	tiff_document_index_pages (tiff_document);
 	g_free (tiff_document->uri);
 	g_free (filename);
 	tiff_document->uri = g_strdup (uri);
@@ -143,252 +205,479 @@ tiff_document_get_n_pages (EvDocument  *document)
 	
 	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), 0);
 	g_return_val_if_fail (tiff_document->tiff != NULL, 0);
-	
-	if (tiff_document->n_pages == -1) {
-		push_handlers ();
-		tiff_document->n_pages = 0;
-		
-		do {
-			tiff_document->n_pages ++;
-		}
-		while (TIFFReadDirectory (tiff_document->tiff));
-		pop_handlers ();
-	}
 
 	return tiff_document->n_pages;
 }
 
-static void
-tiff_document_get_resolution (TiffDocument *tiff_document,
-			      gfloat       *x_res,
-			      gfloat       *y_res)
-{
-	gfloat x = 72.0, y = 72.0;
-	gushort unit;
-	
-	if (TIFFGetField (tiff_document->tiff, TIFFTAG_XRESOLUTION, &x) &&
-	    TIFFGetField (tiff_document->tiff, TIFFTAG_YRESOLUTION, &y)) {
-		if (TIFFGetFieldDefaulted (tiff_document->tiff, TIFFTAG_RESOLUTIONUNIT, &unit)) {
-			if (unit == RESUNIT_CENTIMETER) {
-				x *= 2.54;
-				y *= 2.54;
-			}
-		}
-	}
-
-	*x_res = x;
-	*y_res = y;
-}
-
 static void
 tiff_document_get_page_size (EvDocument *document,
 			     EvPage     *page,
 			     double     *width,
 			     double     *height)
 {
-	guint32 w, h;
-	gfloat x_res, y_res;
 	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
+	TiffPageInfo *info;
+	guint32 h;
 	
 	g_return_if_fail (TIFF_IS_DOCUMENT (document));
 	g_return_if_fail (tiff_document->tiff != NULL);
+	g_return_if_fail (page->index >= 0 && page->index < tiff_document->n_pages);
+
+	info = &tiff_document->pages[page->index];
+	h = info->height * (info->x_res / info->y_res);
 	
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, page->index) != 1) {
-		pop_handlers ();
+	*width = info->width;
+	*height = h;
+}
+
+/* Upper bound for the rows decoded at once */
+#define TIFF_BAND_MAX_SIZE (16 * 1024 * 1024)
+
+/* Switches to the smallest reduced-resolution SubIFD of the current
+ * directory that is still at least @dest_width x @dest_height, if any,
+ * and updates @width and @height accordingly.
+ */
+static void
+tiff_document_select_reduced_image (TiffDocument *tiff_document,
+				    gint          page,
+				    gint          dest_width,
+				    gint          dest_height,
+				    gint         *width,
+				    gint         *height)
+{
+	TIFF    *tiff = tiff_document->tiff;
+	guint16  n_subifds;
+	toff_t  *subifds;
+	toff_t  *offsets;
+	toff_t   best_offset = 0;
+	gint     best_width = *width;
+	gint     best_height = *height;
+	guint    i;
+
+	if (!TIFFGetField (tiff, TIFFTAG_SUBIFD, &n_subifds, &subifds) || n_subifds == 0)
 		return;
+
+	/* The array belongs to the current directory */
+	offsets = g_new (toff_t, n_subifds);
+	memcpy (offsets, subifds, n_subifds * sizeof (toff_t));
+
+	for (i = 0; i < n_subifds; i++) {
+		guint32 w, h, subfile_type = 0;
+
+		if (!TIFFSetSubDirectory (tiff, offsets[i]))
+			continue;
+
+		TIFFGetField (tiff, TIFFTAG_SUBFILETYPE, &subfile_type);
+		if (!(subfile_type & FILETYPE_REDUCEDIMAGE) ||
+		    !TIFFGetField (tiff, TIFFTAG_IMAGEWIDTH, &w) ||
+		    !TIFFGetField (tiff, TIFFTAG_IMAGELENGTH, &h))
+			continue;
+
+		if (w >= dest_width && h >= dest_height && w < best_width) {
+			best_offset = offsets[i];
+			best_width = w;
+			best_height = h;
+		}
+	}
+	g_free (offsets);
+
+	if (best_offset != 0 && TIFFSetSubDirectory (tiff, best_offset)) {
+		*width = best_width;
+		*height = best_height;
+	} else {
+		tiff_document_set_page (tiff_document, page);
+	}
+}
+
+static void
+flush_box_row (guint64 *sums,
+	       guint   *col_counts,
+	       guint    n_rows,
+	       gint     dest_width,
+	       guint32 *dest)
+{
+	gint x;
+
+	for (x = 0; x < dest_width; x++) {
+		guint64 n = (guint64) col_counts[x] * n_rows;
+		guint64 *sum = sums + x * 3;
+
+		dest[x] = 0xff000000 |
+			((sum[0] / n) << 16) |
+			((sum[1] / n) << 8) |
+			(sum[2] / n);
+	}
+	memset (sums, 0, dest_width * 3 * sizeof (guint64));
+}
+
+/* Whether the current directory is a layout tiff_convert_scanline() handles:
+ * bilevel and 8 bit grayscale, as in most fax and scanner output, or 8 bit
+ * RGB, with the samples of every pixel stored together.
+ */
+static gboolean
+tiff_scanline_format_supported (TIFF *tiff)
+{
+	guint16 photometric, bits_per_sample, samples_per_pixel, planar_config;
+
+	if (!TIFFGetField (tiff, TIFFTAG_PHOTOMETRIC, &photometric))
+		return FALSE;
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_PLANARCONFIG, &planar_config);
+
+	if (planar_config != PLANARCONFIG_CONTIG)
+		return FALSE;
+
+	switch (photometric) {
+	case PHOTOMETRIC_MINISWHITE:
+	case PHOTOMETRIC_MINISBLACK:
+		return samples_per_pixel == 1 &&
+			(bits_per_sample == 1 || bits_per_sample == 8);
+	case PHOTOMETRIC_RGB:
+		return bits_per_sample == 8 &&
+			(samples_per_pixel == 3 || samples_per_pixel == 4);
+	default:
+		return FALSE;
 	}
-	
-	TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &w);
-	TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &h);
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	h = h * (x_res / y_res);
-	
-	*width = w;
-	*height = h;
-	
-	pop_handlers ();
 }
 
+/* Converts a scanline read with TIFFReadScanline() to the ABGR pixels
+ * returned by TIFFRGBAImageGet(). Extra samples are ignored.
+ */
+static void
+tiff_convert_scanline (TIFF         *tiff,
+		       const guchar *src,
+		       gint          width,
+		       guint32      *dest)
+{
+	guint16 photometric, bits_per_sample, samples_per_pixel;
+	gint    x;
+
+	TIFFGetField (tiff, TIFFTAG_PHOTOMETRIC, &photometric);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+	TIFFGetFieldDefaulted (tiff, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+
+	for (x = 0; x < width; x++) {
+		guint32 r, g, b;
+
+		if (photometric == PHOTOMETRIC_RGB) {
+			const guchar *p = src + x * samples_per_pixel;
+
+			r = p[0];
+			g = p[1];
+			b = p[2];
+		} else {
+			guint32 v;
+
+			if (bits_per_sample == 1)
+				v = (src[x >> 3] >> (7 - (x & 7))) & 1 ? 0xff : 0;
+			else
+				v = src[x];
+			if (photometric == PHOTOMETRIC_MINISWHITE)
+				v = 0xff - v;
+			r = g = b = v;
+		}
+
+		dest[x] = 0xff000000 | (b << 16) | (g << 8) | r;
+	}
+}
+
+/* Decodes the current directory into a @dest_width x @dest_height surface,
+ * which must not be larger than the image. The image is read a band of
+ * strips or tiles at a time, in file order, and every destination pixel
+ * is the average of the source pixels that fall into it, so that memory
+ * use depends on the destination size rather than on the image size.
+ *
+ * TIFFRGBAImageGet() decodes a strip from its start up to the requested
+ * rows, so an image stored in a single strip, as fax and scanner output
+ * often is, would be decoded again for every band. When its layout
+ * allows it, such an image is read one scanline at a time instead.
+ */
 static cairo_surface_t *
-tiff_document_render (EvDocument      *document,
-		      EvRenderContext *rc)
+tiff_document_decode_scaled (TIFF     *tiff,
+			     gint      width,
+			     gint      height,
+			     gboolean  flip_horizontally,
+			     gboolean  flip_vertically,
+			     gint      dest_width,
+			     gint      dest_height)
 {
-	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
-	int width, height;
-	float x_res, y_res;
-	gint rowstride, bytes;
-	guchar *pixels = NULL;
-	guchar *p;
-	int orientation;
+	TIFFRGBAImage    img;
+	char             emsg[1024];
 	cairo_surface_t *surface;
-	cairo_surface_t *rotated_surface;
-	static const cairo_user_data_key_t key;
-	
-	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), NULL);
-	g_return_val_if_fail (tiff_document->tiff != NULL, NULL);
-  
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, rc->page->index) != 1) {
-		pop_handlers ();
-		g_warning("Failed to select page %d", rc->page->index);
+	guchar          *data;
+	gint             stride;
+	guint32         *raster;
+	guint64         *sums;
+	guint           *col_of, *col_counts;
+	guchar          *scanline = NULL;
+	guint32          band_rows = 0;
+	guint32          unit_rows;
+	guint            rows_in_box = 0;
+	gint             dest_y = flip_vertically ? dest_height - 1 : 0;
+	gint             x, y;
+
+	if (!TIFFIsTiled (tiff))
+		TIFFGetFieldDefaulted (tiff, TIFFTAG_ROWSPERSTRIP, &band_rows);
+
+	if (!TIFFIsTiled (tiff) && band_rows >= (guint32) height &&
+	    tiff_scanline_format_supported (tiff)) {
+		scanline = g_try_malloc (TIFFScanlineSize (tiff));
+		if (!scanline) {
+			g_warning ("Failed to allocate memory for rendering.");
+			return NULL;
+		}
+		/* Scanlines come in file order, as bands do below */
+		band_rows = MIN (64, height);
+	} else {
+		if (!TIFFRGBAImageOK (tiff, emsg) ||
+		    !TIFFRGBAImageBegin (&img, tiff, 0, emsg)) {
+			g_warning ("Failed to decode image: %s", emsg);
+			return NULL;
+		}
+		/* Bands are flipped by libtiff within themselves, so keep them in
+		 * file order and flip while writing the destination rows instead.
+		 */
+		img.req_orientation = img.orientation;
+
+		/* Whole strips or tiles, so that none is decoded twice */
+		if (TIFFIsTiled (tiff))
+			TIFFGetField (tiff, TIFFTAG_TILELENGTH, &band_rows);
+		unit_rows = MAX (band_rows, 1);
+		band_rows = unit_rows;
+		if (band_rows < 64)
+			band_rows *= 64 / band_rows;
+		band_rows = MIN (band_rows, (guint32) height);
+		while (band_rows > unit_rows && (gsize) band_rows * width * 4 > TIFF_BAND_MAX_SIZE)
+			band_rows = MAX (band_rows / unit_rows / 2, 1) * unit_rows;
+		/* A single strip or tile is still too large: split it, at the
+		 * cost of decoding it again for every band.
+		 */
+		while (band_rows > 1 && (gsize) band_rows * width * 4 > TIFF_BAND_MAX_SIZE)
+			band_rows /= 2;
+	}
+
+	raster = g_try_new (guint32, (gsize) width * band_rows);
+	if (!raster) {
+		g_warning ("Failed to allocate memory for rendering.");
+		if (scanline)
+			g_free (scanline);
+		else
+			TIFFRGBAImageEnd (&img);
 		return NULL;
 	}
 
-	if (!TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &width)) {
-		pop_handlers ();
-		g_warning("Failed to read image width");
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, dest_width, dest_height);
+	if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS) {
+		g_free (raster);
+		if (scanline)
+			g_free (scanline);
+		else
+			TIFFRGBAImageEnd (&img);
+		cairo_surface_destroy (surface);
 		return NULL;
 	}
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+
+	col_of = g_new (guint, width);
+	col_counts = g_new0 (guint, dest_width);
+	for (x = 0; x < width; x++) {
+		col_of[x] = (guint64) x * dest_width / width;
+		if (flip_horizontally)
+			col_of[x] = dest_width - 1 - col_of[x];
+		col_counts[col_of[x]]++;
+	}
+	sums = g_new0 (guint64, dest_width * 3);
+
+	for (y = 0; y < height; y += band_rows) {
+		guint32 rows = MIN (band_rows, (guint32) (height - y));
+		guint32 r;
+
+		if (scanline) {
+			for (r = 0; r < rows; r++) {
+				guint32 *row = raster + (gsize) r * width;
+
+				if (TIFFReadScanline (tiff, scanline, y + r, 0) < 0)
+					memset (row, 0xff, (gsize) width * sizeof (guint32));
+				else
+					tiff_convert_scanline (tiff, scanline, width, row);
+			}
+		} else {
+			img.row_offset = y;
+			img.col_offset = 0;
+			if (!TIFFRGBAImageGet (&img, raster, width, rows))
+				memset (raster, 0xff, (gsize) width * rows * sizeof (guint32));
+		}
 
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &height)) {
+		for (r = 0; r < rows; r++) {
+			guint32 *row = raster + (gsize) r * width;
+			gint     row_dest_y = (guint64) (y + r) * dest_height / height;
+
+			if (flip_vertically)
+				row_dest_y = dest_height - 1 - row_dest_y;
+
+			if (row_dest_y != dest_y) {
+				flush_box_row (sums, col_counts, rows_in_box, dest_width,
+					       (guint32 *) (data + dest_y * stride));
+				rows_in_box = 0;
+				dest_y = row_dest_y;
+			}
+
+			for (x = 0; x < width; x++) {
+				guint64 *sum = sums + col_of[x] * 3;
+
+				sum[0] += TIFFGetR (row[x]);
+				sum[1] += TIFFGetG (row[x]);
+				sum[2] += TIFFGetB (row[x]);
+			}
+			rows_in_box++;
+		}
+	}
+	flush_box_row (sums, col_counts, rows_in_box, dest_width,
+		       (guint32 *) (data + dest_y * stride));
+
+	g_free (sums);
+	g_free (col_counts);
+	g_free (col_of);
+	g_free (raster);
+	if (scanline)
+		g_free (scanline);
+	else
+		TIFFRGBAImageEnd (&img);
+
+	cairo_surface_mark_dirty (surface);
+
+	return surface;
+}
+
+/* Flips that bring an image in @orientation to ORIENTATION_TOPLEFT, as
+ * done by libtiff for TIFFReadRGBAImageOriented().
+ */
+static void
+get_flips_to_top_left (int       orientation,
+		       gboolean *flip_horizontally,
+		       gboolean *flip_vertically)
+{
+	switch (orientation) {
+	case ORIENTATION_TOPRIGHT:
+	case ORIENTATION_RIGHTTOP:
+		*flip_horizontally = TRUE;
+		*flip_vertically = FALSE;
+		break;
+	case ORIENTATION_BOTRIGHT:
+	case ORIENTATION_RIGHTBOT:
+		*flip_horizontally = TRUE;
+		*flip_vertically = TRUE;
+		break;
+	case ORIENTATION_BOTLEFT:
+	case ORIENTATION_LEFTBOT:
+		*flip_horizontally = FALSE;
+		*flip_vertically = TRUE;
+		break;
+	default:
+		*flip_horizontally = FALSE;
+		*flip_vertically = FALSE;
+	}
+}
+
+static cairo_surface_t *
+tiff_document_render_page (TiffDocument    *tiff_document,
+			   EvRenderContext *rc,
+			   gboolean         use_file_orientation)
+{
+	TiffPageInfo *info;
+	int width, height;
+	int dest_width, dest_height;
+	int decode_width, decode_height;
+	float x_res, y_res;
+	gboolean flip_horizontally = FALSE;
+	gboolean flip_vertically = FALSE;
+	cairo_surface_t *surface;
+	cairo_surface_t *rotated_surface;
+
+	push_handlers ();
+	if (!tiff_document_set_page (tiff_document, rc->page->index)) {
 		pop_handlers ();
-		g_warning("Failed to read image height");
+		g_warning("Failed to select page %d", rc->page->index);
 		return NULL;
 	}
 
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_ORIENTATION, &orientation)) {
-		orientation = ORIENTATION_TOPLEFT;
-	}
+	info = &tiff_document->pages[rc->page->index];
+	width = info->width;
+	height = info->height;
+	x_res = info->x_res;
+	y_res = info->y_res;
+
+	/* The image is shown as stored, unless asked for top-left */
+	if (!use_file_orientation)
+		get_flips_to_top_left (info->orientation, &flip_horizontally, &flip_vertically);
 
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	
-	pop_handlers ();
-  
 	/* Sanity check the doc */
 	if (width <= 0 || height <= 0) {
+		pop_handlers ();
 		g_warning("Invalid width or height.");
 		return NULL;
 	}
 
-	rowstride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, width);
-	if (rowstride / 4 != width) {
-		g_warning("Overflow while rendering document.");
-		/* overflow, or cairo was changed in an unsupported way */
-		return NULL;                
-	}
-	
-	bytes = height * rowstride;
-	if (bytes / rowstride != height) {
-		g_warning("Overflow while rendering document.");
-		/* overflow */
-		return NULL;
-	}
-	
-	pixels = g_try_malloc (bytes);
-	if (!pixels) {
-		g_warning("Failed to allocate memory for rendering.");
-		return NULL;
-	}
-	
-	surface = cairo_image_surface_create_for_data (pixels,
-						       CAIRO_FORMAT_RGB24,
-						       width, height,
-						       rowstride);
-	cairo_surface_set_user_data (surface, &key,
-				     pixels, (cairo_destroy_func_t)g_free);
-
-	TIFFReadRGBAImageOriented (tiff_document->tiff,
-				   width, height,
-				   (uint32 *)pixels,
-				   orientation, 0);
-	pop_handlers ();
+	dest_width = MAX ((width * rc->scale) + 0.5, 1);
+	dest_height = MAX ((height * rc->scale * (x_res / y_res)) + 0.5, 1);
 
-	/* Convert the format returned by libtiff to
-	* what cairo expects
-	*/
-	p = pixels;
-	while (p < pixels + bytes) {
-		guint32 *pixel = (guint32*)p;
-		guint8 r = TIFFGetR(*pixel);
-		guint8 g = TIFFGetG(*pixel);
-		guint8 b = TIFFGetB(*pixel);
-		guint8 a = TIFFGetA(*pixel);
+	/* Downsample while decoding; scaling up is left to cairo */
+	decode_width = MIN (dest_width, width);
+	decode_height = MIN (dest_height, height);
 
-		*pixel = (a << 24) | (r << 16) | (g << 8) | b;
+	tiff_document_select_reduced_image (tiff_document, rc->page->index,
+					    decode_width, decode_height,
+					    &width, &height);
 
-		p += 4;
-	}
+	surface = tiff_document_decode_scaled (tiff_document->tiff,
+					       width, height,
+					       flip_horizontally, flip_vertically,
+					       decode_width, decode_height);
+	pop_handlers ();
+
+	if (!surface)
+		return NULL;
 
 	rotated_surface = ev_document_misc_surface_rotate_and_scale (surface,
-								     (width * rc->scale) + 0.5,
-								     (height * rc->scale * (x_res / y_res)) + 0.5,
+								     dest_width,
+								     dest_height,
 								     rc->rotation);
 	cairo_surface_destroy (surface);
-	
+
 	return rotated_surface;
 }
 
+static cairo_surface_t *
+tiff_document_render (EvDocument      *document,
+		      EvRenderContext *rc)
+{
+	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
+
+	g_return_val_if_fail (TIFF_IS_DOCUMENT (document), NULL);
+	g_return_val_if_fail (tiff_document->tiff != NULL, NULL);
+
+	return tiff_document_render_page (tiff_document, rc, TRUE);
+}
+
 static GdkPixbuf *
 tiff_document_render_pixbuf (EvDocument      *document,
 			     EvRenderContext *rc)
 {
 	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
-	int width, height;
-	float x_res, y_res;
-	gint rowstride, bytes;
-	guchar *pixels = NULL;
+	cairo_surface_t *surface;
 	GdkPixbuf *pixbuf;
-	GdkPixbuf *scaled_pixbuf;
-	GdkPixbuf *rotated_pixbuf;
-	
-	push_handlers ();
-	if (TIFFSetDirectory (tiff_document->tiff, rc->page->index) != 1) {
-		pop_handlers ();
-		return NULL;
-	}
 
-	if (!TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGEWIDTH, &width)) {
-		pop_handlers ();
+	surface = tiff_document_render_page (tiff_document, rc, FALSE);
+	if (!surface)
 		return NULL;
-	}
 
-	if (! TIFFGetField (tiff_document->tiff, TIFFTAG_IMAGELENGTH, &height)) {
-		pop_handlers ();
-		return NULL;
-	}
-
-	tiff_document_get_resolution (tiff_document, &x_res, &y_res);
-	
-	pop_handlers ();
-  
-	/* Sanity check the doc */
-	if (width <= 0 || height <= 0)
-		return NULL;                
-
-	rowstride = width * 4;
-	if (rowstride / 4 != width)
-		/* overflow */
-		return NULL;                
-        
-	bytes = height * rowstride;
-	if (bytes / rowstride != height)
-		/* overflow */
-		return NULL;                
-	
-	pixels = g_try_malloc (bytes);
-	if (!pixels)
-		return NULL;
-	
-	pixbuf = gdk_pixbuf_new_from_data (pixels, GDK_COLORSPACE_RGB, TRUE, 8, 
-					   width, height, rowstride,
-					   (GdkPixbufDestroyNotify) g_free, NULL);
-	TIFFReadRGBAImageOriented (tiff_document->tiff,
-				   width, height,
-				   (uint32 *)pixels,
-				   ORIENTATION_TOPLEFT, 0);
-	pop_handlers ();
+	pixbuf = ev_document_misc_pixbuf_from_surface (surface);
+	cairo_surface_destroy (surface);
 
-	scaled_pixbuf = gdk_pixbuf_scale_simple (pixbuf,
-						 width * rc->scale,
-						 height * rc->scale * (x_res / y_res),
-						 GDK_INTERP_BILINEAR);
-	g_object_unref (pixbuf);
-	
-	rotated_pixbuf = gdk_pixbuf_rotate_simple (scaled_pixbuf, 360 - rc->rotation);
-	g_object_unref (scaled_pixbuf);
-	
-	return rotated_pixbuf;
+	return pixbuf;
 }
 
 static gchar *
@@ -397,13 +686,17 @@ tiff_document_get_page_label (EvDocument *document,
 {
 	TiffDocument *tiff_document = TIFF_DOCUMENT (document);
 	static gchar *label;
+	gchar *retval = NULL;
 
-	if (TIFFGetField (tiff_document->tiff, TIFFTAG_PAGENAME, &label) &&
+	push_handlers ();
+	if (tiff_document_set_page (tiff_document, page->index) &&
+	    TIFFGetField (tiff_document->tiff, TIFFTAG_PAGENAME, &label) &&
 	    g_utf8_validate (label, -1, NULL)) {
-		return g_strdup (label);
+		retval = g_strdup (label);
 	}
+	pop_handlers ();
 
-	return NULL;
+	return retval;
 }
 
 static void
@@ -415,6 +708,7 @@ tiff_document_finalize (GObject *object)
 		TIFFClose (tiff_document->tiff);
 	if (tiff_document->uri)
 		g_free (tiff_document->uri);
+	g_free (tiff_document->pages);
 
 	G_OBJECT_CLASS (tiff_document_parent_class)->finalize (object);
 }
@@ -499,7 +793,7 @@ tiff_document_file_exporter_do_page (EvFileExporter *exporter, EvRenderContext *
 
 	if (document->ps_export_ctx == NULL)
 		return;
-	if (TIFFSetDirectory (document->tiff, rc->page->index) != 1)
+	if (!tiff_document_set_page (document, rc->page->index))
 		return;
 	tiff2ps_process_page (document->ps_export_ctx, document->tiff,
 			      0, 0, 0, 0, 0);
@@ -537,5 +831,5 @@ tiff_document_document_file_exporter_iface_init (EvFileExporterInterface *iface)
 static void
 tiff_document_init (TiffDocument *tiff_document)
 {
-	tiff_document->n_pages = -1;
+	tiff_document->n_pages = 0;
 }
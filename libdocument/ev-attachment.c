@@ -43,6 +43,11 @@ struct _EvAttachmentPrivate {
 	gsize                    size;
 	gchar                   *data;
 	gchar                   *mime_type;
+	gboolean                 mime_type_uncertain;
+
+	EvAttachmentSaveFunc     save_func;
+	gpointer                 save_func_data;
+	GDestroyNotify           save_func_destroy;
 
 	GAppInfo                *app;
 	GFile                   *tmp_file;
@@ -90,6 +95,12 @@ ev_attachment_finalize (GObject *object)
 		attachment->priv->mime_type = NULL;
 	}
 
+	if (attachment->priv->save_func_destroy)
+		attachment->priv->save_func_destroy (attachment->priv->save_func_data);
+	attachment->priv->save_func = NULL;
+	attachment->priv->save_func_data = NULL;
+	attachment->priv->save_func_destroy = NULL;
+
 	if (attachment->priv->app) {
 		g_object_unref (attachment->priv->app);
 		attachment->priv->app = NULL;
@@ -132,8 +143,8 @@ ev_attachment_set_property (GObject      *object,
 		attachment->priv->data = g_value_get_pointer (value);
 		attachment->priv->mime_type = g_content_type_guess (attachment->priv->name,
 								    (guchar *) attachment->priv->data,
-								    attachment->priv->size,
-								    NULL);
+								    attachment->priv->data ? attachment->priv->size : 0,
+								    &attachment->priv->mime_type_uncertain);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object,
@@ -241,6 +252,46 @@ ev_attachment_new (const gchar *name,
 	return attachment;
 }
 
+/**
+ * ev_attachment_new_with_save_func:
+ * @name: the attachment name
+ * @description: the attachment description
+ * @mtime: (nullable): the modification date
+ * @ctime: (nullable): the creation date
+ * @size: the size of the attachment contents in bytes
+ * @save_func: function that writes the attachment contents to a stream
+ * @user_data: data passed to @save_func
+ * @destroy: (nullable): function to free @user_data
+ *
+ * Creates an attachment whose contents are not kept in memory. They are
+ * written out by @save_func only when the attachment is saved or opened.
+ * Since the contents are not known in advance, the MIME type is guessed
+ * from @name.
+ *
+ * Returns: (transfer full): a new #EvAttachment
+ */
+EvAttachment *
+ev_attachment_new_with_save_func (const gchar          *name,
+				  const gchar          *description,
+				  GDateTime            *mtime,
+				  GDateTime            *ctime,
+				  gsize                 size,
+				  EvAttachmentSaveFunc  save_func,
+				  gpointer              user_data,
+				  GDestroyNotify        destroy)
+{
+	EvAttachment *attachment;
+
+	g_return_val_if_fail (save_func != NULL, NULL);
+
+	attachment = ev_attachment_new (name, description, mtime, ctime, size, NULL);
+	attachment->priv->save_func = save_func;
+	attachment->priv->save_func_data = user_data;
+	attachment->priv->save_func_destroy = destroy;
+
+	return attachment;
+}
+
 const gchar *
 ev_attachment_get_name (EvAttachment *attachment)
 {
@@ -281,6 +332,35 @@ ev_attachment_get_mime_type (EvAttachment *attachment)
 	return attachment->priv->mime_type;
 }
 
+/**
+ * ev_attachment_save_to_stream:
+ * @attachment: an #EvAttachment
+ * @stream: a #GOutputStream
+ * @error: (nullable): return location for a #GError
+ *
+ * Writes the contents of @attachment to @stream. The stream is not closed.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+ev_attachment_save_to_stream (EvAttachment  *attachment,
+			      GOutputStream *stream,
+			      GError       **error)
+{
+	g_return_val_if_fail (EV_IS_ATTACHMENT (attachment), FALSE);
+	g_return_val_if_fail (G_IS_OUTPUT_STREAM (stream), FALSE);
+
+	if (attachment->priv->save_func)
+		return attachment->priv->save_func (attachment, stream,
+						    attachment->priv->save_func_data,
+						    error);
+
+	return g_output_stream_write_all (stream,
+					  attachment->priv->data,
+					  attachment->priv->size,
+					  NULL, NULL, error);
+}
+
 gboolean
 ev_attachment_save (EvAttachment *attachment,
 		    GFile        *file,
@@ -288,7 +368,6 @@ ev_attachment_save (EvAttachment *attachment,
 {
 	GFileOutputStream *output_stream;
 	GError *ioerror = NULL;
-	gssize  written_bytes;
 
 	g_return_val_if_fail (EV_IS_ATTACHMENT (attachment), FALSE);
 	g_return_val_if_fail (G_IS_FILE (file), FALSE);
@@ -311,29 +390,29 @@ ev_attachment_save (EvAttachment *attachment,
 		return FALSE;
 	}
 	
-	written_bytes = g_output_stream_write (G_OUTPUT_STREAM (output_stream),
-					       attachment->priv->data,
-					       attachment->priv->size,
-					       NULL, &ioerror);
-	if (written_bytes == -1) {
+	if (!ev_attachment_save_to_stream (attachment,
+					   G_OUTPUT_STREAM (output_stream),
+					   &ioerror)) {
 		char *uri;
 		
 		uri = g_file_get_uri (file);
 		g_set_error (error,
 			     EV_ATTACHMENT_ERROR,
-			     ioerror->code,
+			     ioerror ? ioerror->code : 0,
 			     _("Couldn't save attachment “%s”: %s"),
 			     uri,
-			     ioerror->message);
+			     ioerror ? ioerror->message : "");
 		
 		g_output_stream_close (G_OUTPUT_STREAM (output_stream), NULL, NULL);
-		g_error_free (ioerror);
+		g_object_unref (output_stream);
+		g_clear_error (&ioerror);
 		g_free (uri);
 
 		return FALSE;
 	}
 
 	g_output_stream_close (G_OUTPUT_STREAM (output_stream), NULL, NULL);
+	g_object_unref (output_stream);
 
 	return TRUE;
 	
@@ -385,6 +464,90 @@ ev_attachment_launch_app (EvAttachment *attachment,
 	return TRUE;
 }
 
+/* Writes the attachment to a new temporary file and finds out its content
+ * type. Only reads the immutable name, so it can run in any thread.
+ */
+static GFile *
+ev_attachment_write_tmp_file (EvAttachment *attachment,
+			      gchar       **content_type,
+			      GError      **error)
+{
+	char  *basename;
+	char  *template;
+	GFile *file;
+
+	*content_type = NULL;
+
+	/* FIXMEchpe: convert to filename encoding first! */
+	basename = g_path_get_basename (ev_attachment_get_name (attachment));
+	template = g_strdup_printf ("%s.XXXXXX", basename);
+	file = ev_mkstemp_file (template, error);
+	g_free (template);
+	g_free (basename);
+
+	if (file == NULL)
+		return NULL;
+
+	if (!ev_attachment_save (attachment, file, error)) {
+		ev_tmp_file_unlink (file);
+		g_object_unref (file);
+		return NULL;
+	}
+
+	if (attachment->priv->mime_type_uncertain) {
+		GFileInfo *info;
+
+		info = g_file_query_info (file,
+					  G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
+					  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+		if (info) {
+			*content_type = g_strdup (g_file_info_get_content_type (info));
+			g_object_unref (info);
+		}
+	}
+
+	return file;
+}
+
+static void
+ev_attachment_set_tmp_file (EvAttachment *attachment,
+			    GFile        *file,
+			    gchar        *content_type)
+{
+	if (attachment->priv->tmp_file) {
+		/* Another open got there first */
+		ev_tmp_file_unlink (file);
+		g_object_unref (file);
+		g_free (content_type);
+		return;
+	}
+
+	attachment->priv->tmp_file = file;
+
+	/* The name alone wasn't enough, now the contents are on disk */
+	if (content_type) {
+		g_free (attachment->priv->mime_type);
+		attachment->priv->mime_type = content_type;
+		attachment->priv->mime_type_uncertain = FALSE;
+	}
+}
+
+static gboolean
+ev_attachment_save_tmp_file (EvAttachment *attachment,
+			     GError      **error)
+{
+	GFile *file;
+	gchar *content_type;
+
+	file = ev_attachment_write_tmp_file (attachment, &content_type, error);
+	if (file == NULL)
+		return FALSE;
+
+	ev_attachment_set_tmp_file (attachment, file, content_type);
+
+	return TRUE;
+}
+
 gboolean
 ev_attachment_open (EvAttachment *attachment,
 		    GdkScreen    *screen,
@@ -392,9 +555,13 @@ ev_attachment_open (EvAttachment *attachment,
 		    GError      **error)
 {
 	GAppInfo *app_info;
-	gboolean  retval = FALSE;
 
 	g_return_val_if_fail (EV_IS_ATTACHMENT (attachment), FALSE);
+
+	if (!attachment->priv->tmp_file &&
+	    attachment->priv->save_func &&
+	    !ev_attachment_save_tmp_file (attachment, error))
+		return FALSE;
 	
 	if (!attachment->priv->app) {
 		app_info = g_app_info_get_default_for_type (attachment->priv->mime_type, FALSE);
@@ -411,33 +578,205 @@ ev_attachment_open (EvAttachment *attachment,
 		return FALSE;
 	}
 
-	if (attachment->priv->tmp_file) {
-		retval = ev_attachment_launch_app (attachment, screen,
-						   timestamp, error);
-	} else {
-                char *basename;
-                char *template;
-		GFile *file;
-
-                /* FIXMEchpe: convert to filename encoding first! */
-                basename = g_path_get_basename (ev_attachment_get_name (attachment));
-                template = g_strdup_printf ("%s.XXXXXX", basename);
-                file = ev_mkstemp_file (template, error);
-                g_free (template);
-                g_free (basename);
-
-		if (file != NULL && ev_attachment_save (attachment, file, error)) {
-			if (attachment->priv->tmp_file)
-				g_object_unref (attachment->priv->tmp_file);
-			attachment->priv->tmp_file = g_object_ref (file);
-
-			retval = ev_attachment_launch_app (attachment, screen,
-							   timestamp, error);
-		}
+	if (!attachment->priv->tmp_file &&
+	    !ev_attachment_save_tmp_file (attachment, error))
+		return FALSE;
 
-		g_object_unref (file);
+	return ev_attachment_launch_app (attachment, screen, timestamp, error);
+}
+
+static void
+save_thread (GTask        *task,
+	     gpointer      source_object,
+	     gpointer      task_data,
+	     GCancellable *cancellable)
+{
+	GError *error = NULL;
+
+	if (ev_attachment_save (EV_ATTACHMENT (source_object),
+				G_FILE (task_data), &error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+}
+
+/**
+ * ev_attachment_save_async:
+ * @attachment: an #EvAttachment
+ * @file: the #GFile to save to
+ * @cancellable: (allow-none): a #GCancellable
+ * @callback: called in the thread-default main context when done
+ * @user_data: data for @callback
+ *
+ * Like ev_attachment_save(), but writes the contents in a worker thread so
+ * that large embedded files don't block the caller.
+ */
+void
+ev_attachment_save_async (EvAttachment        *attachment,
+			  GFile               *file,
+			  GCancellable        *cancellable,
+			  GAsyncReadyCallback  callback,
+			  gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (EV_IS_ATTACHMENT (attachment));
+	g_return_if_fail (G_IS_FILE (file));
+
+	task = g_task_new (attachment, cancellable, callback, user_data);
+	g_task_set_task_data (task, g_object_ref (file), g_object_unref);
+	g_task_run_in_thread (task, save_thread);
+	g_object_unref (task);
+}
+
+/**
+ * ev_attachment_save_finish:
+ * @attachment: an #EvAttachment
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError
+ *
+ * Returns: %TRUE if the attachment was saved
+ */
+gboolean
+ev_attachment_save_finish (EvAttachment *attachment,
+			   GAsyncResult *result,
+			   GError      **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, attachment), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+typedef struct {
+	GdkScreen *screen;
+	guint32    timestamp;
+	GFile     *file;
+	gchar     *content_type;
+} OpenData;
+
+static void
+open_data_free (OpenData *data)
+{
+	if (data->screen)
+		g_object_unref (data->screen);
+	if (data->file) {
+		ev_tmp_file_unlink (data->file);
+		g_object_unref (data->file);
 	}
+	g_free (data->content_type);
+	g_slice_free (OpenData, data);
+}
+
+static void
+open_save_tmp_file_thread (GTask        *task,
+			   gpointer      source_object,
+			   gpointer      task_data,
+			   GCancellable *cancellable)
+{
+	OpenData *data = task_data;
+	GError   *error = NULL;
+
+	data->file = ev_attachment_write_tmp_file (EV_ATTACHMENT (source_object),
+						   &data->content_type,
+						   &error);
+	if (data->file)
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+}
+
+static void
+open_tmp_file_saved_cb (GObject      *source_object,
+			GAsyncResult *result,
+			gpointer      user_data)
+{
+	EvAttachment *attachment = EV_ATTACHMENT (source_object);
+	GTask        *task = G_TASK (user_data);
+	GTask        *save_task = G_TASK (result);
+	OpenData     *data = g_task_get_task_data (save_task);
+	GError       *error = NULL;
+
+	if (!g_task_propagate_boolean (save_task, &error)) {
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	ev_attachment_set_tmp_file (attachment, data->file, data->content_type);
+	data->file = NULL;
+	data->content_type = NULL;
 
-	return retval;
+	if (ev_attachment_open (attachment, data->screen, data->timestamp, &error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, error);
+	g_object_unref (task);
 }
 
+/**
+ * ev_attachment_open_async:
+ * @attachment: an #EvAttachment
+ * @screen: (allow-none): the #GdkScreen to launch the application on
+ * @timestamp: the timestamp of the event that triggered the open
+ * @cancellable: (allow-none): a #GCancellable
+ * @callback: called in the thread-default main context when done
+ * @user_data: data for @callback
+ *
+ * Like ev_attachment_open(), but the contents of attachments that are read
+ * back from the document are written to the temporary file in a worker
+ * thread. The application is launched from the calling thread afterwards.
+ */
+void
+ev_attachment_open_async (EvAttachment        *attachment,
+			  GdkScreen           *screen,
+			  guint32              timestamp,
+			  GCancellable        *cancellable,
+			  GAsyncReadyCallback  callback,
+			  gpointer             user_data)
+{
+	GTask    *task;
+	GTask    *save_task;
+	OpenData *data;
+	GError   *error = NULL;
+
+	g_return_if_fail (EV_IS_ATTACHMENT (attachment));
+
+	task = g_task_new (attachment, cancellable, callback, user_data);
+
+	if (attachment->priv->tmp_file || !attachment->priv->save_func) {
+		/* Nothing to read back from the document */
+		if (ev_attachment_open (attachment, screen, timestamp, &error))
+			g_task_return_boolean (task, TRUE);
+		else
+			g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	data = g_slice_new0 (OpenData);
+	data->screen = screen ? g_object_ref (screen) : NULL;
+	data->timestamp = timestamp;
+
+	save_task = g_task_new (attachment, cancellable, open_tmp_file_saved_cb, task);
+	g_task_set_task_data (save_task, data, (GDestroyNotify) open_data_free);
+	g_task_run_in_thread (save_task, open_save_tmp_file_thread);
+	g_object_unref (save_task);
+}
+
+/**
+ * ev_attachment_open_finish:
+ * @attachment: an #EvAttachment
+ * @result: the #GAsyncResult passed to the callback
+ * @error: return location for a #GError
+ *
+ * Returns: %TRUE if the application was launched
+ */
+gboolean
+ev_attachment_open_finish (EvAttachment *attachment,
+			   GAsyncResult *result,
+			   GError      **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, attachment), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
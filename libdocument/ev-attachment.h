@@ -42,6 +42,20 @@ typedef struct _EvAttachmentPrivate EvAttachmentPrivate;
 
 #define EV_ATTACHMENT_ERROR (ev_attachment_error_quark ())
 
+/**
+ * EvAttachmentSaveFunc:
+ * @attachment: the #EvAttachment being saved
+ * @stream: the #GOutputStream to write the contents to
+ * @user_data: the data passed to ev_attachment_new_with_save_func()
+ * @error: return location for a #GError
+ *
+ * Returns: %TRUE if the whole contents were written
+ */
+typedef gboolean (* EvAttachmentSaveFunc) (EvAttachment  *attachment,
+					   GOutputStream *stream,
+					   gpointer       user_data,
+					   GError       **error);
+
 struct _EvAttachment {
 	GObject base_instance;
 	
@@ -60,12 +74,23 @@ EvAttachment *ev_attachment_new                  (const gchar  *name,
 						  GDateTime    *ctime,
 						  gsize         size,
 						  gpointer      data);
+EvAttachment *ev_attachment_new_with_save_func   (const gchar          *name,
+						  const gchar          *description,
+						  GDateTime            *mtime,
+						  GDateTime            *ctime,
+						  gsize                 size,
+						  EvAttachmentSaveFunc  save_func,
+						  gpointer              user_data,
+						  GDestroyNotify        destroy);
 
 const gchar *ev_attachment_get_name              (EvAttachment *attachment);
 const gchar *ev_attachment_get_description       (EvAttachment *attachment);
 GDateTime   *ev_attachment_get_modification_date (EvAttachment *attachment);
 GDateTime   *ev_attachment_get_creation_date     (EvAttachment *attachment);
 const gchar *ev_attachment_get_mime_type         (EvAttachment *attachment);
+gboolean     ev_attachment_save_to_stream        (EvAttachment  *attachment,
+						  GOutputStream *stream,
+						  GError       **error);
 gboolean     ev_attachment_save                  (EvAttachment *attachment,
 						  GFile        *file,
 						  GError      **error);
@@ -73,6 +98,23 @@ gboolean     ev_attachment_open                  (EvAttachment *attachment,
 						  GdkScreen    *screen,
 						  guint32       timestamp,
 						  GError      **error);
+void         ev_attachment_save_async            (EvAttachment        *attachment,
+						  GFile               *file,
+						  GCancellable        *cancellable,
+						  GAsyncReadyCallback  callback,
+						  gpointer             user_data);
+gboolean     ev_attachment_save_finish           (EvAttachment *attachment,
+						  GAsyncResult *result,
+						  GError      **error);
+void         ev_attachment_open_async            (EvAttachment        *attachment,
+						  GdkScreen           *screen,
+						  guint32              timestamp,
+						  GCancellable        *cancellable,
+						  GAsyncReadyCallback  callback,
+						  gpointer             user_data);
+gboolean     ev_attachment_open_finish           (EvAttachment *attachment,
+						  GAsyncResult *result,
+						  GError      **error);
 
 G_END_DECLS
 
@@ -56,8 +56,15 @@ struct _EvDocumentPrivate
 	EvDocumentInfo *info;
 
 	synctex_scanner_t synctex_scanner;
+
+	/* Recently requested pages, most recent first */
+	GMutex          page_cache_mutex;
+	GQueue          page_cache;
 };
 
+/* Number of EvPage objects kept by ev_document_get_page() */
+#define PAGE_CACHE_SIZE 32
+
 static gint            _ev_document_get_n_pages     (EvDocument *document);
 static void            _ev_document_get_page_size   (EvDocument *document,
 						     EvPage     *page,
@@ -96,11 +103,25 @@ ev_document_impl_get_info (EvDocument *document)
 	return g_new0 (EvDocumentInfo, 1);
 }
 
+static void
+ev_document_clear_page_cache (EvDocument *document)
+{
+	EvPage *page;
+
+	g_mutex_lock (&document->priv->page_cache_mutex);
+	while ((page = g_queue_pop_head (&document->priv->page_cache)))
+		g_object_unref (page);
+	g_mutex_unlock (&document->priv->page_cache_mutex);
+}
+
 static void
 ev_document_finalize (GObject *object)
 {
 	EvDocument *document = EV_DOCUMENT (object);
 
+	ev_document_clear_page_cache (document);
+	g_mutex_clear (&document->priv->page_cache_mutex);
+
 	if (document->priv->uri) {
 		g_free (document->priv->uri);
 		document->priv->uri = NULL;
@@ -139,6 +160,9 @@ ev_document_init (EvDocument *document)
 {
 	document->priv = ev_document_get_instance_private (document);
 
+	g_mutex_init (&document->priv->page_cache_mutex);
+	g_queue_init (&document->priv->page_cache);
+
 	/* Assume all pages are the same size until proven otherwise */
 	document->priv->uniform = TRUE;
 	/* Assume that the document is not a web document*/
@@ -248,6 +272,7 @@ ev_document_load (EvDocument  *document,
 	if (!g_strcmp0 (mimetype ,"application/epub+zip"))
 		document->iswebdocument=TRUE ;
 		
+	ev_document_clear_page_cache (document);
 	retval = klass->load (document, uri, &err);
 	if (!retval) {
 		if (err) {
@@ -392,13 +417,93 @@ ev_document_save (EvDocument  *document,
 	return klass->save (document, uri, error);
 }
 
+/**
+ * ev_document_save_incremental:
+ * @document: an #EvDocument
+ * @uri: the URI of the file @document was loaded from
+ * @error: a #GError location to store an error, or %NULL
+ *
+ * Saves @document over the file it was loaded from, writing only the
+ * changes made to it instead of a whole new copy. Backends that can't
+ * do that for @uri return %FALSE without setting @error; ev_document_save()
+ * should be used instead in that case.
+ *
+ * This only saves rewriting the file itself: the PDF backend still has
+ * poppler write the complete document to a temporary file on every save,
+ * and copies the changes from there. Each save in a session rewrites the
+ * update appended by the previous one, since poppler's update holds every
+ * change made since the document was loaded.
+ *
+ * Returns: %TRUE on success, or %FALSE with @error filled in on error
+ */
+gboolean
+ev_document_save_incremental (EvDocument  *document,
+			      const char  *uri,
+			      GError     **error)
+{
+	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
+
+	if (!klass->save_incremental)
+		return FALSE;
+
+	return klass->save_incremental (document, uri, error);
+}
+
+/**
+ * ev_document_get_page:
+ * @document: an #EvDocument
+ * @index: index of page
+ *
+ * Recently requested pages are shared: asking again for the same @index
+ * returns the same #EvPage instead of creating a new backend page.
+ *
+ * Returns: (transfer full): the #EvPage at @index
+ */
 EvPage *
 ev_document_get_page (EvDocument *document,
 		      gint        index)
 {
-	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
+	EvDocumentClass   *klass = EV_DOCUMENT_GET_CLASS (document);
+	EvDocumentPrivate *priv = document->priv;
+	EvPage            *page;
+	GList             *l;
+
+	g_mutex_lock (&priv->page_cache_mutex);
+	for (l = priv->page_cache.head; l; l = l->next) {
+		page = EV_PAGE (l->data);
+
+		if (page->index != index)
+			continue;
+
+		g_queue_unlink (&priv->page_cache, l);
+		g_queue_push_head_link (&priv->page_cache, l);
+		g_object_ref (page);
+		g_mutex_unlock (&priv->page_cache_mutex);
 
-	return klass->get_page (document, index);
+		return page;
+	}
+	g_mutex_unlock (&priv->page_cache_mutex);
+
+	page = klass->get_page (document, index);
+	if (!page)
+		return NULL;
+
+	g_mutex_lock (&priv->page_cache_mutex);
+	/* Another thread may have added it meanwhile, the cache only
+	 * keeps the first one.
+	 */
+	for (l = priv->page_cache.head; l; l = l->next) {
+		if (EV_PAGE (l->data)->index == index)
+			break;
+	}
+	if (!l) {
+		g_queue_push_head (&priv->page_cache, g_object_ref (page));
+		if (g_queue_get_length (&priv->page_cache) > PAGE_CACHE_SIZE)
+			g_object_unref (g_queue_pop_tail (&priv->page_cache));
+	}
+	g_mutex_unlock (&priv->page_cache_mutex);
+
+	return page;
 }
 
 static gboolean
@@ -955,16 +1060,69 @@ ev_rect_cmp (EvRectangle *a,
 		  (ABS (a->y2 - b->y2) < EPSILON));
 }
 
+/**
+ * ev_document_toggle_night_mode:
+ * @document: an #EvDocument
+ * @night: whether night mode is on
+ *
+ * Does nothing unless the backend still implements it. #EvWebView now
+ * applies night mode to web based documents on its own, following the
+ * inverted colors setting of its #EvDocumentModel.
+ *
+ * Deprecated: 4.6.5: Use ev_document_model_set_inverted_colors() instead.
+ */
 void
-ev_document_toggle_night_mode(EvDocument *document,gboolean night)
+ev_document_toggle_night_mode (EvDocument *document,
+			       gboolean    night)
 {
-	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS(document);
-	return klass->toggle_night_mode(document,night) ;
+	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
+
+	if (klass->toggle_night_mode)
+		klass->toggle_night_mode (document, night);
 }
 
+/**
+ * ev_document_check_add_night_sheet:
+ * @document: an #EvDocument
+ *
+ * Does nothing unless the backend still implements it.
+ *
+ * Deprecated: 4.6.5: Use ev_document_model_set_inverted_colors() instead.
+ */
 void
-ev_document_check_add_night_sheet(EvDocument *document)
+ev_document_check_add_night_sheet (EvDocument *document)
+{
+	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
+
+	if (klass->check_add_night_sheet)
+		klass->check_add_night_sheet (document);
+}
+
+/**
+ * ev_document_get_resource:
+ * @document: an #EvDocument
+ * @uri: the URI of a resource of @document, as used by its pages
+ * @mime_type: (out) (allow-none): return location for the MIME type
+ * @error: return location for an error, or %NULL
+ *
+ * Reads a resource, such as a chapter or an image, that a page of a web
+ * based document refers to.
+ *
+ * Returns: (transfer full): the contents of the resource, or %NULL
+ */
+GBytes *
+ev_document_get_resource (EvDocument  *document,
+			  const gchar *uri,
+			  gchar      **mime_type,
+			  GError     **error)
 {
-	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS(document);
-	return klass->check_add_night_sheet(document) ;
+	EvDocumentClass *klass = EV_DOCUMENT_GET_CLASS (document);
+
+	if (!klass->get_resource) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+				     "Document doesn't provide resources");
+		return NULL;
+	}
+
+	return klass->get_resource (document, uri, mime_type, error);
 }
@@ -33,6 +33,7 @@
 #include <cairo.h>
 
 #include "ev-document-info.h"
+#include "ev-macros.h"
 #include "ev-page.h"
 #include "ev-render-context.h"
 
@@ -115,8 +116,17 @@ struct _EvDocumentClass
                                                EvDocumentBackendInfo *info);
         gboolean	  (* support_synctex) (EvDocument      *document);
 
+	/* No longer implemented by any backend, kept for ABI compatibility */
 	void              (* toggle_night_mode)  (EvDocument      *document,gboolean night);
-	void              (*check_add_night_sheet)(EvDocument      *document);	
+	void              (*check_add_night_sheet)(EvDocument      *document);
+
+	GBytes          * (* get_resource)    (EvDocument      *document,
+					       const gchar     *uri,
+					       gchar          **mime_type,
+					       GError         **error);
+	gboolean          (* save_incremental) (EvDocument     *document,
+					       const char      *uri,
+					       GError         **error);
 };
 
 GType            ev_document_get_type             (void) G_GNUC_CONST;
@@ -146,6 +156,9 @@ gboolean         ev_document_load                 (EvDocument      *document,
 gboolean         ev_document_save                 (EvDocument      *document,
 						   const char      *uri,
 						   GError         **error);
+gboolean         ev_document_save_incremental     (EvDocument      *document,
+						   const char      *uri,
+						   GError         **error);
 gint             ev_document_get_n_pages          (EvDocument      *document);
 EvPage          *ev_document_get_page             (EvDocument      *document,
 						   gint             index);
@@ -186,8 +199,14 @@ EvMapping       *ev_document_synctex_forward_search
 
 gint             ev_rect_cmp                      (EvRectangle     *a,
 					           EvRectangle     *b);
+EV_DEPRECATED
 void            ev_document_toggle_night_mode     (EvDocument *document,gboolean night);
+EV_DEPRECATED
 void			ev_document_check_add_night_sheet (EvDocument *document);
+GBytes          *ev_document_get_resource         (EvDocument      *document,
+						   const gchar     *uri,
+						   gchar          **mime_type,
+						   GError         **error);
 
 #define EV_TYPE_RECTANGLE (ev_rectangle_get_type ())
 struct _EvRectangle
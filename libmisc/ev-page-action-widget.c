@@ -31,6 +31,7 @@
 /* Widget we pass back */
 static void  ev_page_action_widget_init       (EvPageActionWidget      *action_widget);
 static void  ev_page_action_widget_class_init (EvPageActionWidgetClass *action_widget);
+static void  ev_page_action_widget_build_completion (EvPageActionWidget *proxy);
 
 enum
 {
@@ -202,6 +203,16 @@ focus_out_cb (EvPageActionWidget *action_widget)
 	return FALSE;
 }
 
+static gboolean
+focus_in_cb (EvPageActionWidget *action_widget)
+{
+	if (action_widget->model &&
+	    !gtk_entry_get_completion (GTK_ENTRY (action_widget->entry)))
+		ev_page_action_widget_build_completion (action_widget);
+
+	return FALSE;
+}
+
 static void
 ev_page_action_widget_init (EvPageActionWidget *action_widget)
 {
@@ -225,6 +236,8 @@ ev_page_action_widget_init (EvPageActionWidget *action_widget)
 				  action_widget);
 	g_signal_connect_swapped (action_widget->entry, "focus-out-event",
 							  G_CALLBACK (focus_out_cb), action_widget);
+	g_signal_connect_swapped (action_widget->entry, "focus-in-event",
+				  G_CALLBACK (focus_in_cb), action_widget);
 
 	obj = gtk_widget_get_accessible (action_widget->entry);
 	atk_object_set_name (obj, "page-label-entry");
@@ -504,19 +517,15 @@ get_filter_model_from_model (GtkTreeModel *model)
 }
 
 
-void
-ev_page_action_widget_update_links_model (EvPageActionWidget *proxy, GtkTreeModel *model)
+static void
+ev_page_action_widget_build_completion (EvPageActionWidget *proxy)
 {
 	GtkTreeModel *filter_model;
 	GtkEntryCompletion *completion;
 	GtkCellRenderer *renderer;
 
-	if (!model)
-		return;
-
 	/* Magik */
-	proxy->model = model;
-	filter_model = get_filter_model_from_model (model);
+	filter_model = get_filter_model_from_model (proxy->model);
 
 	completion = gtk_entry_completion_new ();
 	g_object_set (G_OBJECT (completion),
@@ -545,6 +554,22 @@ ev_page_action_widget_update_links_model (EvPageActionWidget *proxy, GtkTreeMode
 	g_object_unref (completion);
 }
 
+void
+ev_page_action_widget_update_links_model (EvPageActionWidget *proxy, GtkTreeModel *model)
+{
+	if (!model)
+		return;
+
+	proxy->model = model;
+	gtk_entry_set_completion (GTK_ENTRY (proxy->entry), NULL);
+
+	/* Building the completion walks the whole links model, which may
+	 * be loaded lazily, so wait until the entry is actually used.
+	 */
+	if (gtk_widget_has_focus (proxy->entry))
+		ev_page_action_widget_build_completion (proxy);
+}
+
 void
 ev_page_action_widget_grab_focus (EvPageActionWidget *proxy)
 {
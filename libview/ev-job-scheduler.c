@@ -65,6 +65,21 @@ ev_job_queue_push (EvSchedulerJob *job,
 	g_mutex_unlock (&job_queue_mutex);
 }
 
+/* Whether a job more urgent than @priority is waiting */
+static gboolean
+ev_job_queue_has_higher_priority (EvJobPriority priority)
+{
+	gboolean retval = FALSE;
+	gint     i;
+
+	g_mutex_lock (&job_queue_mutex);
+	for (i = EV_JOB_PRIORITY_URGENT; i < priority && !retval; i++)
+		retval = !g_queue_is_empty (job_queue[i]);
+	g_mutex_unlock (&job_queue_mutex);
+
+	return retval;
+}
+
 static EvSchedulerJob *
 ev_job_queue_get_next_unlocked (void)
 {
@@ -169,9 +184,13 @@ ev_scheduler_thread_job_cancelled (EvSchedulerJob *job,
 	}
 }
 
-static void
-ev_job_thread (EvJob *job)
+/* Returns %TRUE if the job gave way to a more urgent one
+ * before it was done and has to be queued again
+ */
+static gboolean
+ev_job_thread (EvSchedulerJob *s_job)
 {
+	EvJob   *job = s_job->job;
 	gboolean result;
 
 	ev_debug_message (DEBUG_JOBS, "%s", EV_GET_TYPE_NAME (job));
@@ -183,9 +202,15 @@ ev_job_thread (EvJob *job)
                         g_atomic_pointer_set (&running_job, job);
 			result = ev_job_run (job);
                 }
+
+		/* Don't keep the thread busy with a long running job */
+		if (result && ev_job_queue_has_higher_priority (s_job->priority))
+			break;
 	} while (result);
 
         g_atomic_pointer_set (&running_job, NULL);
+
+	return result;
 }
 
 static gboolean
@@ -214,8 +239,10 @@ ev_job_thread_proxy (gpointer data)
 		}
 		g_mutex_unlock (&job_queue_mutex);
 
-		ev_job_thread (job->job);
-		ev_scheduler_job_destroy (job);
+		if (ev_job_thread (job))
+			ev_job_queue_push (job, job->priority);
+		else
+			ev_scheduler_job_destroy (job);
 	}
 
 	return NULL;
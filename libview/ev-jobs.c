@@ -50,6 +50,8 @@ static void ev_job_init                   (EvJob                 *job);
 static void ev_job_class_init             (EvJobClass            *class);
 static void ev_job_links_init             (EvJobLinks            *job);
 static void ev_job_links_class_init       (EvJobLinksClass       *class);
+static void ev_job_links_pages_init       (EvJobLinksPages       *job);
+static void ev_job_links_pages_class_init (EvJobLinksPagesClass  *class);
 static void ev_job_attachments_init       (EvJobAttachments      *job);
 static void ev_job_attachments_class_init (EvJobAttachmentsClass *class);
 static void ev_job_annots_init            (EvJobAnnots           *job);
@@ -66,6 +68,8 @@ static void ev_job_save_init              (EvJobSave             *job);
 static void ev_job_save_class_init        (EvJobSaveClass        *class);
 static void ev_job_find_init              (EvJobFind             *job);
 static void ev_job_find_class_init        (EvJobFindClass        *class);
+static void ev_job_text_index_init        (EvJobTextIndex        *job);
+static void ev_job_text_index_class_init  (EvJobTextIndexClass   *class);
 static void ev_job_layers_init            (EvJobLayers           *job);
 static void ev_job_layers_class_init      (EvJobLayersClass      *class);
 static void ev_job_export_init            (EvJobExport           *job);
@@ -89,12 +93,19 @@ enum {
 	FIND_LAST_SIGNAL
 };
 
+enum {
+	ANNOTS_UPDATED,
+	ANNOTS_LAST_SIGNAL
+};
+
 static guint job_signals[LAST_SIGNAL] = { 0 };
 static guint job_fonts_signals[FONTS_LAST_SIGNAL] = { 0 };
 static guint job_find_signals[FIND_LAST_SIGNAL] = { 0 };
+static guint job_annots_signals[ANNOTS_LAST_SIGNAL] = { 0 };
 
 G_DEFINE_ABSTRACT_TYPE (EvJob, ev_job, G_TYPE_OBJECT)
 G_DEFINE_TYPE (EvJobLinks, ev_job_links, EV_TYPE_JOB)
+G_DEFINE_TYPE (EvJobLinksPages, ev_job_links_pages, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobAttachments, ev_job_attachments, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobAnnots, ev_job_annots, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobRender, ev_job_render, EV_TYPE_JOB)
@@ -104,6 +115,7 @@ G_DEFINE_TYPE (EvJobFonts, ev_job_fonts, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobLoad, ev_job_load, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobSave, ev_job_save, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobFind, ev_job_find, EV_TYPE_JOB)
+G_DEFINE_TYPE (EvJobTextIndex, ev_job_text_index, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobLayers, ev_job_layers, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobExport, ev_job_export, EV_TYPE_JOB)
 G_DEFINE_TYPE (EvJobPrint, ev_job_print, EV_TYPE_JOB)
@@ -382,7 +394,9 @@ ev_job_links_run (EvJob *job)
 	job_links->model = ev_document_links_get_links_model (EV_DOCUMENT_LINKS (job->document));
 	ev_document_doc_mutex_unlock ();
 
-	gtk_tree_model_foreach (job_links->model, (GtkTreeModelForeachFunc)fill_page_labels, job);
+	/* Models that aren't tree stores compute the page labels on demand */
+	if (GTK_IS_TREE_STORE (job_links->model))
+		gtk_tree_model_foreach (job_links->model, (GtkTreeModelForeachFunc)fill_page_labels, job);
 
 	ev_job_succeeded (job);
 	
@@ -412,6 +426,181 @@ ev_job_links_new (EvDocument *document)
 	return job;
 }
 
+/* EvJobLinksPages */
+
+/* Rows resolved each time the job runs */
+#define LINKS_PAGES_CHUNK_SIZE 100
+
+static void
+ev_job_links_pages_init (EvJobLinksPages *job)
+{
+	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+}
+
+static void
+ev_job_links_pages_entry_clear (EvJobLinksPagesEntry *entry)
+{
+	gtk_tree_path_free (entry->path);
+}
+
+static void
+ev_job_links_pages_dispose (GObject *object)
+{
+	EvJobLinksPages *job;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = EV_JOB_LINKS_PAGES (object);
+
+	if (job->model) {
+		g_object_unref (job->model);
+		job->model = NULL;
+	}
+
+	if (job->pages) {
+		g_array_free (job->pages, TRUE);
+		job->pages = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_links_pages_parent_class)->dispose) (object);
+}
+
+/* Moves iter to the next row in depth-first order */
+static gboolean
+tree_model_iter_next_preorder (GtkTreeModel *model,
+			       GtkTreeIter  *iter)
+{
+	GtkTreeIter next;
+
+	if (gtk_tree_model_iter_children (model, &next, iter)) {
+		*iter = next;
+		return TRUE;
+	}
+
+	for (;;) {
+		next = *iter;
+		if (gtk_tree_model_iter_next (model, &next)) {
+			*iter = next;
+			return TRUE;
+		}
+
+		if (!gtk_tree_model_iter_parent (model, &next, iter))
+			return FALSE;
+		*iter = next;
+	}
+}
+
+/* Paths compare in depth-first order, so the first row pointing to a
+ * page comes first
+ */
+static gint
+compare_links_pages_entries (const EvJobLinksPagesEntry *a,
+			     const EvJobLinksPagesEntry *b)
+{
+	if (a->page != b->page)
+		return a->page < b->page ? -1 : 1;
+
+	return gtk_tree_path_compare (a->path, b->path);
+}
+
+static gboolean
+ev_job_links_pages_run (EvJob *job)
+{
+	EvJobLinksPages *job_pages = EV_JOB_LINKS_PAGES (job);
+	EvDocumentLinks *document_links = EV_DOCUMENT_LINKS (job->document);
+	gboolean         has_next = TRUE;
+	gint             i;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	/* A model of its own, walked in this thread only. Its rows have
+	 * the same paths as those of the model shown in the sidebar.
+	 */
+	if (!job_pages->model) {
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+
+		ev_document_doc_mutex_lock ();
+		job_pages->model = ev_document_links_get_links_model (document_links);
+		ev_document_doc_mutex_unlock ();
+
+		job_pages->pages = g_array_new (FALSE, FALSE, sizeof (EvJobLinksPagesEntry));
+		g_array_set_clear_func (job_pages->pages,
+					(GDestroyNotify)ev_job_links_pages_entry_clear);
+
+		has_next = job_pages->model &&
+			gtk_tree_model_get_iter_first (job_pages->model, &job_pages->iter);
+	}
+
+	for (i = 0; i < LINKS_PAGES_CHUNK_SIZE && has_next; i++) {
+		EvJobLinksPagesEntry entry;
+		EvLink              *link;
+
+		gtk_tree_model_get (job_pages->model, &job_pages->iter,
+				    EV_DOCUMENT_LINKS_COLUMN_LINK, &link,
+				    -1);
+		if (link) {
+			ev_document_doc_mutex_lock ();
+			entry.page = ev_document_links_get_link_page (document_links, link);
+			ev_document_doc_mutex_unlock ();
+			g_object_unref (link);
+
+			if (entry.page != -1) {
+				entry.path = gtk_tree_model_get_path (job_pages->model,
+								      &job_pages->iter);
+				g_array_append_val (job_pages->pages, entry);
+			}
+		}
+
+		has_next = tree_model_iter_next_preorder (job_pages->model, &job_pages->iter);
+	}
+
+	if (has_next)
+		return TRUE;
+
+	g_array_sort (job_pages->pages, (GCompareFunc)compare_links_pages_entries);
+	if (job_pages->model) {
+		g_object_unref (job_pages->model);
+		job_pages->model = NULL;
+	}
+
+	ev_job_succeeded (job);
+
+	return FALSE;
+}
+
+static void
+ev_job_links_pages_class_init (EvJobLinksPagesClass *class)
+{
+	GObjectClass *oclass = G_OBJECT_CLASS (class);
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+
+	oclass->dispose = ev_job_links_pages_dispose;
+	job_class->run = ev_job_links_pages_run;
+}
+
+/**
+ * ev_job_links_pages_new:
+ * @document: an #EvDocument with links
+ *
+ * Creates a job that resolves the page of every row of the links model
+ * of @document, in a model of its own, and leaves them in the pages
+ * field of the job, sorted by page, with the path of their row.
+ *
+ * Returns: (transfer full): the new job
+ */
+EvJob *
+ev_job_links_pages_new (EvDocument *document)
+{
+	EvJob *job;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = g_object_new (EV_TYPE_JOB_LINKS_PAGES, NULL);
+	job->document = g_object_ref (document);
+
+	return job;
+}
+
 /* EvJobAttachments */
 static void
 ev_job_attachments_init (EvJobAttachments *job)
@@ -479,6 +668,18 @@ ev_job_attachments_new (EvDocument *document)
 }
 
 /* EvJobAnnots */
+
+/* Pages scanned each time the job runs, with the document lock held */
+#define ANNOTS_CHUNK_SIZE 10
+
+/* Annotations of a chunk of pages, handed from the job thread to the
+ * main loop, where they are added to job->annots and reported.
+ */
+typedef struct {
+	EvJobAnnots *job;
+	GList       *annots;
+} EvJobAnnotsUpdate;
+
 static void
 ev_job_annots_init (EvJobAnnots *job)
 {
@@ -503,31 +704,78 @@ ev_job_annots_dispose (GObject *object)
 	G_OBJECT_CLASS (ev_job_annots_parent_class)->dispose (object);
 }
 
+static gboolean
+ev_job_annots_emit_updated (EvJobAnnotsUpdate *update)
+{
+	EvJobAnnots *job = update->job;
+
+	job->annots = g_list_concat (job->annots, update->annots);
+	if (!EV_JOB (job)->cancelled)
+		g_signal_emit (job, job_annots_signals[ANNOTS_UPDATED], 0, update->annots);
+
+	return FALSE;
+}
+
+static void
+ev_job_annots_update_free (EvJobAnnotsUpdate *update)
+{
+	g_object_unref (update->job);
+	g_free (update);
+}
+
 static gboolean
 ev_job_annots_run (EvJob *job)
 {
 	EvJobAnnots *job_annots = EV_JOB_ANNOTS (job);
+	GList       *annots = NULL;
 	gint         i;
 
 	ev_debug_message (DEBUG_JOBS, NULL);
-	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
 
+#ifdef EV_ENABLE_DEBUG
+	/* We use the #ifdef in this case because of the if */
+	if (job_annots->current_page == 0)
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+#endif
+
+	/* The lock is released between chunks, so that the main loop and
+	 * other jobs are not kept waiting for the whole document
+	 */
 	ev_document_doc_mutex_lock ();
-	for (i = 0; i < ev_document_get_n_pages (job->document); i++) {
+
+	for (i = 0; i < ANNOTS_CHUNK_SIZE && job_annots->current_page < job_annots->n_pages; i++) {
 		EvMappingList *mapping_list;
 		EvPage        *page;
 
-		page = ev_document_get_page (job->document, i);
+		page = ev_document_get_page (job->document, job_annots->current_page);
 		mapping_list = ev_document_annotations_get_annotations (EV_DOCUMENT_ANNOTATIONS (job->document),
 									page);
 		g_object_unref (page);
 
 		if (mapping_list)
-			job_annots->annots = g_list_prepend (job_annots->annots, mapping_list);
+			annots = g_list_prepend (annots, mapping_list);
+
+		job_annots->current_page++;
 	}
 	ev_document_doc_mutex_unlock ();
 
-	job_annots->annots = g_list_reverse (job_annots->annots);
+	/* Queued before ev_job_succeeded() queues finished, so "updated"
+	 * is always emitted first
+	 */
+	if (annots) {
+		EvJobAnnotsUpdate *update;
+
+		update = g_new (EvJobAnnotsUpdate, 1);
+		update->job = g_object_ref (job_annots);
+		update->annots = g_list_reverse (annots);
+		g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+				 (GSourceFunc)ev_job_annots_emit_updated,
+				 update,
+				 (GDestroyNotify)ev_job_annots_update_free);
+	}
+
+	if (job_annots->current_page < job_annots->n_pages)
+		return TRUE;
 
 	ev_job_succeeded (job);
 
@@ -542,6 +790,16 @@ ev_job_annots_class_init (EvJobAnnotsClass *class)
 
 	oclass->dispose = ev_job_annots_dispose;
 	job_class->run = ev_job_annots_run;
+
+	job_annots_signals[ANNOTS_UPDATED] =
+		g_signal_new ("updated",
+			      EV_TYPE_JOB_ANNOTS,
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvJobAnnotsClass, updated),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__POINTER,
+			      G_TYPE_NONE,
+			      1, G_TYPE_POINTER);
 }
 
 EvJob *
@@ -553,6 +811,7 @@ ev_job_annots_new (EvDocument *document)
 
 	job = g_object_new (EV_TYPE_JOB_ANNOTS, NULL);
 	job->document = g_object_ref (document);
+	EV_JOB_ANNOTS (job)->n_pages = ev_document_get_n_pages (document);
 
 	return job;
 }
@@ -1095,6 +1354,28 @@ ev_job_save_dispose (GObject *object)
 	(* G_OBJECT_CLASS (ev_job_save_parent_class)->dispose) (object);
 }
 
+static gboolean
+ev_job_save_is_in_place (EvJobSave *job)
+{
+	const gchar *document_uri;
+	GFile       *target;
+	GFile       *source;
+	gboolean     retval;
+
+	/* Compressed documents are loaded from an uncompressed copy */
+	document_uri = ev_document_get_uri (EV_JOB (job)->document);
+	if (!document_uri || g_object_get_data (G_OBJECT (EV_JOB (job)->document), "uri-uncompressed"))
+		return FALSE;
+
+	target = g_file_new_for_uri (job->uri);
+	source = g_file_new_for_uri (document_uri);
+	retval = g_file_equal (target, source);
+	g_object_unref (source);
+	g_object_unref (target);
+
+	return retval;
+}
+
 static gboolean
 ev_job_save_run (EvJob *job)
 {
@@ -1107,6 +1388,30 @@ ev_job_save_run (EvJob *job)
 	ev_debug_message (DEBUG_JOBS, "uri: %s, document_uri: %s", job_save->uri, job_save->document_uri);
 	ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
 
+	/* Saving over the file the document was loaded from only
+	 * needs the changes to be written when the backend supports it
+	 */
+	if (ev_job_save_is_in_place (job_save)) {
+		gboolean saved;
+
+		ev_document_doc_mutex_lock ();
+		saved = ev_document_save_incremental (job->document, job_save->uri, &error);
+		ev_document_doc_mutex_unlock ();
+
+		if (error) {
+			ev_job_failed_from_error (job, error);
+			g_error_free (error);
+
+			return FALSE;
+		}
+
+		if (saved) {
+			ev_job_succeeded (job);
+
+			return FALSE;
+		}
+	}
+
         fd = ev_mkstemp ("saveacopy.XXXXXX", &tmp_filename, &error);
         if (fd == -1) {
                 ev_job_failed_from_error (job, error);
@@ -1216,6 +1521,7 @@ static void
 ev_job_find_init (EvJobFind *job)
 {
 	EV_JOB (job)->run_mode = EV_JOB_RUN_MAIN_LOOP;
+	job->indexed_count = -1;
 }
 
 static void
@@ -1245,10 +1551,18 @@ ev_job_find_dispose (GObject *object)
 	if (job->results) {
 		g_free(job->results);
 	}
+
+	if (job->text_index) {
+		g_object_unref (job->text_index);
+		job->text_index = NULL;
+	}
 	
 	(* G_OBJECT_CLASS (ev_job_find_parent_class)->dispose) (object);
 }
 
+/* Number of pages searched in the text index before giving the main loop back */
+#define FIND_INDEXED_PAGES_PER_RUN 20
+
 static gboolean
 ev_job_find_run (EvJob *job)
 {
@@ -1256,7 +1570,32 @@ ev_job_find_run (EvJob *job)
 	EvDocumentFind *find = EV_DOCUMENT_FIND (job->document);
 	EvPage         *ev_page;
 	GList          *matches = NULL;
+	gint            n_indexed = 0;
 	ev_debug_message (DEBUG_JOBS, NULL);
+
+	/* Indexed pages don't need the backend, search a few of them in every run */
+	while (job_find->text_index &&
+	       ev_text_index_has_page (job_find->text_index, job_find->current_page)) {
+		if (n_indexed++ == FIND_INDEXED_PAGES_PER_RUN)
+			return TRUE;
+
+		matches = ev_text_index_find_text (job_find->text_index,
+						   job_find->current_page,
+						   job_find->text,
+						   job_find->case_sensitive);
+		job_find->has_results |= (matches != NULL);
+		job_find->pages[job_find->current_page] = matches;
+		job_find->total_count += g_list_length (matches);
+
+		g_signal_emit (job_find, job_find_signals[FIND_UPDATED], 0, job_find->current_page);
+
+		job_find->current_page = (job_find->current_page + 1) % job_find->n_pages;
+		if (job_find->current_page == job_find->start_page) {
+			ev_job_succeeded (job);
+
+			return FALSE;
+		}
+	}
 	
 	/* Do not block the main loop */
 	if (!ev_document_doc_mutex_trylock ())
@@ -1409,6 +1748,224 @@ ev_job_find_get_results (EvJobFind *job)
 	return job->pages;
 }
 
+/**
+ * ev_job_find_set_text_index:
+ * @job: an #EvJobFind
+ * @index: a complete #EvTextIndex of the job document
+ *
+ * Makes @job search the pages covered by @index without asking the
+ * backend.  Must be called before the job is scheduled.  The total
+ * number of matches is available right away in the indexed_count
+ * field of @job.
+ */
+void
+ev_job_find_set_text_index (EvJobFind   *job,
+			    EvTextIndex *index)
+{
+	g_return_if_fail (EV_IS_JOB_FIND (job));
+	g_return_if_fail (!EV_JOB (job)->document->iswebdocument);
+
+	if (job->text_index)
+		g_object_unref (job->text_index);
+	job->text_index = index ? g_object_ref (index) : NULL;
+
+	job->indexed_count = index ?
+		(gint) ev_text_index_count_matches (index, job->text, job->case_sensitive) : -1;
+}
+
+/* EvJobTextIndex */
+static void
+ev_job_text_index_init (EvJobTextIndex *job)
+{
+	EV_JOB (job)->run_mode = EV_JOB_RUN_THREAD;
+}
+
+static void
+ev_job_text_index_dispose (GObject *object)
+{
+	EvJobTextIndex *job = EV_JOB_TEXT_INDEX (object);
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	if (job->index) {
+		g_object_unref (job->index);
+		job->index = NULL;
+	}
+
+	if (job->cache_file) {
+		g_free (job->cache_file);
+		job->cache_file = NULL;
+	}
+
+	(* G_OBJECT_CLASS (ev_job_text_index_parent_class)->dispose) (object);
+}
+
+static guint64
+get_document_mtime (EvDocument *document)
+{
+	GFile     *file;
+	GFileInfo *info;
+	guint64    mtime = 0;
+
+	file = g_file_new_for_uri (ev_document_get_uri (document));
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (info) {
+		mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		g_object_unref (info);
+	}
+	g_object_unref (file);
+
+	return mtime;
+}
+
+static void
+ev_job_text_index_start (EvJobTextIndex *job)
+{
+	EvDocument *document = EV_JOB (job)->document;
+	gint        n_pages = ev_document_get_n_pages (document);
+	guint64     mtime;
+
+	mtime = get_document_mtime (document);
+
+	/* The text of password protected documents never goes to disk */
+	if (!job->use_cache ||
+	    (EV_IS_DOCUMENT_SECURITY (document) &&
+	     ev_document_security_has_document_security (EV_DOCUMENT_SECURITY (document)))) {
+		job->index = ev_text_index_new (n_pages, mtime);
+		return;
+	}
+
+	job->cache_file = ev_text_index_get_cache_filename (ev_document_get_uri (document));
+
+	if (mtime != 0)
+		job->index = ev_text_index_new_from_file (job->cache_file, n_pages, mtime, NULL);
+
+	if (!job->index) {
+		job->index = ev_text_index_new (n_pages, mtime);
+
+		/* Nothing to validate a saved index against */
+		if (mtime == 0)
+			g_clear_pointer (&job->cache_file, g_free);
+	} else {
+		g_clear_pointer (&job->cache_file, g_free);
+	}
+}
+
+static gboolean
+ev_job_text_index_run (EvJob *job)
+{
+	EvJobTextIndex *job_index = EV_JOB_TEXT_INDEX (job);
+	EvDocumentText *document_text = EV_DOCUMENT_TEXT (job->document);
+	EvPage         *ev_page;
+	gchar          *text;
+	EvRectangle    *areas = NULL;
+	guint           n_areas = 0;
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	if (!job_index->index) {
+		ev_profiler_start (EV_PROFILE_JOBS, "%s (%p)", EV_GET_TYPE_NAME (job), job);
+		ev_job_text_index_start (job_index);
+	}
+
+	if (job_index->current_page == ev_text_index_get_n_pages (job_index->index) ||
+	    ev_text_index_is_complete (job_index->index)) {
+		if (job_index->cache_file)
+			ev_text_index_save (job_index->index, job_index->cache_file, NULL);
+		ev_job_succeeded (job);
+
+		return FALSE;
+	}
+
+	/* One page at a time, so that other jobs can take the lock in between */
+	ev_document_doc_mutex_lock ();
+
+	ev_page = ev_document_get_page (job->document, job_index->current_page);
+	text = ev_document_text_get_text (document_text, ev_page);
+	ev_document_text_get_text_layout (document_text, ev_page, &areas, &n_areas);
+	g_object_unref (ev_page);
+
+	ev_document_doc_mutex_unlock ();
+
+	ev_text_index_add_page (job_index->index, job_index->current_page,
+				text, areas, n_areas);
+	g_free (text);
+	g_free (areas);
+
+	job_index->current_page++;
+
+	return TRUE;
+}
+
+static void
+ev_job_text_index_class_init (EvJobTextIndexClass *class)
+{
+	EvJobClass   *job_class = EV_JOB_CLASS (class);
+	GObjectClass *gobject_class = G_OBJECT_CLASS (class);
+
+	job_class->run = ev_job_text_index_run;
+	gobject_class->dispose = ev_job_text_index_dispose;
+}
+
+/**
+ * ev_job_text_index_new:
+ * @document: an #EvDocument implementing #EvDocumentText
+ *
+ * Creates a threaded job that builds an #EvTextIndex of @document one
+ * page at a time, or loads it from the user cache when the document
+ * hasn't changed since it was last indexed. It should be scheduled with
+ * a low priority, since it gives way to more urgent jobs between pages.
+ *
+ * Returns: (transfer full): the new job
+ */
+EvJob *
+ev_job_text_index_new (EvDocument *document)
+{
+	EvJobTextIndex *job;
+
+	g_return_val_if_fail (EV_IS_DOCUMENT_TEXT (document), NULL);
+
+	ev_debug_message (DEBUG_JOBS, NULL);
+
+	job = g_object_new (EV_TYPE_JOB_TEXT_INDEX, NULL);
+	EV_JOB (job)->document = g_object_ref (document);
+
+	return EV_JOB (job);
+}
+
+/**
+ * ev_job_text_index_set_use_cache:
+ * @job: an #EvJobTextIndex
+ * @use_cache: whether to load and save the index in the user cache
+ *
+ * Makes @job reuse an index saved by a previous run, and save the one it
+ * builds, which writes the plain text of the document to disk.  Disabled
+ * by default.  Must be called before the job is scheduled.
+ */
+void
+ev_job_text_index_set_use_cache (EvJobTextIndex *job,
+				 gboolean        use_cache)
+{
+	g_return_if_fail (EV_IS_JOB_TEXT_INDEX (job));
+
+	job->use_cache = use_cache;
+}
+
+/**
+ * ev_job_text_index_get_index:
+ * @job: a finished #EvJobTextIndex
+ *
+ * Returns: (transfer none): the text index
+ */
+EvTextIndex *
+ev_job_text_index_get_index (EvJobTextIndex *job)
+{
+	g_return_val_if_fail (EV_IS_JOB_TEXT_INDEX (job), NULL);
+
+	return job->index;
+}
+
 /* EvJobLayers */
 static void
 ev_job_layers_init (EvJobLayers *job)
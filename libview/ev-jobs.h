@@ -31,6 +31,8 @@
 
 #include <xreader-document.h>
 
+#include "ev-text-index.h"
+
 G_BEGIN_DECLS
 
 typedef struct _EvJob EvJob;
@@ -51,6 +53,9 @@ typedef struct _EvJobWebThumbnailClass EvJobWebThumbnailClass;
 typedef struct _EvJobLinks EvJobLinks;
 typedef struct _EvJobLinksClass EvJobLinksClass;
 
+typedef struct _EvJobLinksPages EvJobLinksPages;
+typedef struct _EvJobLinksPagesClass EvJobLinksPagesClass;
+
 typedef struct _EvJobAttachments EvJobAttachments;
 typedef struct _EvJobAttachmentsClass EvJobAttachmentsClass;
 
@@ -69,6 +74,9 @@ typedef struct _EvJobSaveClass EvJobSaveClass;
 typedef struct _EvJobFind EvJobFind;
 typedef struct _EvJobFindClass EvJobFindClass;
 
+typedef struct _EvJobTextIndex EvJobTextIndex;
+typedef struct _EvJobTextIndexClass EvJobTextIndexClass;
+
 typedef struct _EvJobLayers EvJobLayers;
 typedef struct _EvJobLayersClass EvJobLayersClass;
 
@@ -89,6 +97,11 @@ typedef struct _EvJobPrintClass EvJobPrintClass;
 #define EV_JOB_LINKS_CLASS(klass)	     (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_LINKS, EvJobLinksClass))
 #define EV_IS_JOB_LINKS(object)		     (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_LINKS))
 
+#define EV_TYPE_JOB_LINKS_PAGES		     (ev_job_links_pages_get_type())
+#define EV_JOB_LINKS_PAGES(object)	     (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_LINKS_PAGES, EvJobLinksPages))
+#define EV_JOB_LINKS_PAGES_CLASS(klass)	     (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_LINKS_PAGES, EvJobLinksPagesClass))
+#define EV_IS_JOB_LINKS_PAGES(object)	     (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_LINKS_PAGES))
+
 #define EV_TYPE_JOB_ATTACHMENTS		     (ev_job_attachments_get_type())
 #define EV_JOB_ATTACHMENTS(object)	     (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_ATTACHMENTS, EvJobAttachments))
 #define EV_JOB_ATTACHMENTS_CLASS(klass)	     (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_ATTACHMENTS, EvJobAttachmentsClass))
@@ -139,6 +152,11 @@ typedef struct _EvJobPrintClass EvJobPrintClass;
 #define EV_JOB_FIND_CLASS(klass)             (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_FIND, EvJobFindClass))
 #define EV_IS_JOB_FIND(object)               (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_FIND))
 
+#define EV_TYPE_JOB_TEXT_INDEX               (ev_job_text_index_get_type())
+#define EV_JOB_TEXT_INDEX(object)            (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_TEXT_INDEX, EvJobTextIndex))
+#define EV_JOB_TEXT_INDEX_CLASS(klass)       (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_TEXT_INDEX, EvJobTextIndexClass))
+#define EV_IS_JOB_TEXT_INDEX(object)         (G_TYPE_CHECK_INSTANCE_TYPE((object), EV_TYPE_JOB_TEXT_INDEX))
+
 #define EV_TYPE_JOB_LAYERS                   (ev_job_layers_get_type())
 #define EV_JOB_LAYERS(object)                (G_TYPE_CHECK_INSTANCE_CAST((object), EV_TYPE_JOB_LAYERS, EvJobLayers))
 #define EV_JOB_LAYERS_CLASS(klass)           (G_TYPE_CHECK_CLASS_CAST((klass), EV_TYPE_JOB_LAYERS, EvJobLayersClass))
@@ -201,6 +219,27 @@ struct _EvJobLinksClass
 	EvJobClass parent_class;
 };
 
+typedef struct {
+	gint         page;
+	GtkTreePath *path;
+} EvJobLinksPagesEntry;
+
+struct _EvJobLinksPages
+{
+	EvJob parent;
+
+	GArray *pages; /* EvJobLinksPagesEntry, sorted by page */
+
+	/*< private >*/
+	GtkTreeModel *model;
+	GtkTreeIter iter;
+};
+
+struct _EvJobLinksPagesClass
+{
+	EvJobClass parent_class;
+};
+
 struct _EvJobAttachments
 {
 	EvJob parent;
@@ -218,11 +257,17 @@ struct _EvJobAnnots
 	EvJob parent;
 
 	GList *annots;
+	gint current_page;
+	gint n_pages;
 };
 
 struct _EvJobAnnotsClass
 {
 	EvJobClass parent_class;
+
+	/* Signals */
+	void (* updated)  (EvJobAnnots *job,
+			   GList       *annots);
 };
 
 struct _EvJobRender
@@ -355,6 +400,8 @@ struct _EvJobFind
 	gchar *text;
 	gboolean case_sensitive;
 	gboolean has_results;
+	EvTextIndex *text_index;
+	gint indexed_count;
 };
 
 struct _EvJobFindClass
@@ -366,6 +413,21 @@ struct _EvJobFindClass
 			   gint       page);
 };
 
+struct _EvJobTextIndex
+{
+	EvJob parent;
+
+	EvTextIndex *index;
+	gchar *cache_file;
+	gboolean use_cache;
+	gint current_page;
+};
+
+struct _EvJobTextIndexClass
+{
+	EvJobClass parent_class;
+};
+
 struct _EvJobLayers
 {
 	EvJob parent;
@@ -426,6 +488,10 @@ void            ev_job_set_run_mode       (EvJob          *job,
 GType           ev_job_links_get_type     (void) G_GNUC_CONST;
 EvJob          *ev_job_links_new          (EvDocument     *document);
 
+/* EvJobLinksPages */
+GType           ev_job_links_pages_get_type (void) G_GNUC_CONST;
+EvJob          *ev_job_links_pages_new      (EvDocument     *document);
+
 /* EvJobAttachments */
 GType           ev_job_attachments_get_type (void) G_GNUC_CONST;
 EvJob          *ev_job_attachments_new      (EvDocument     *document);
@@ -490,6 +556,15 @@ const gchar    *ev_job_find_get_text	  (EvJobFind       *job);
 gdouble         ev_job_find_get_progress  (EvJobFind       *job);
 gboolean        ev_job_find_has_results   (EvJobFind       *job);
 GList         **ev_job_find_get_results   (EvJobFind       *job);
+void            ev_job_find_set_text_index (EvJobFind      *job,
+					   EvTextIndex     *index);
+
+/* EvJobTextIndex */
+GType           ev_job_text_index_get_type (void) G_GNUC_CONST;
+EvJob          *ev_job_text_index_new      (EvDocument     *document);
+void            ev_job_text_index_set_use_cache (EvJobTextIndex *job,
+						 gboolean        use_cache);
+EvTextIndex    *ev_job_text_index_get_index (EvJobTextIndex *job);
 
 /* EvJobLayers */
 GType           ev_job_layers_get_type    (void) G_GNUC_CONST;
@@ -96,9 +96,8 @@ ev_hyperlink_get_start_index (AtkHyperlink *atk_hyperlink)
         EvLinkAccessiblePrivate *impl_priv;
         GtkWidget               *widget;
         EvView                  *view;
-        EvRectangle             *areas = NULL;
-        guint                    n_areas = 0;
-        guint                    i;
+        EvTextLayout            *layout;
+        guint                    start, end;
 
         if (!hyperlink->link_impl)
                 return -1;
@@ -113,22 +112,11 @@ ev_hyperlink_get_start_index (AtkHyperlink *atk_hyperlink)
         if (!view->page_cache)
                 return -1;
 
-        ev_page_cache_get_text_layout (view->page_cache, view->current_page, &areas, &n_areas);
-        if (!areas)
+        layout = ev_page_cache_get_text_layout (view->page_cache, view->current_page);
+        if (!ev_text_layout_get_range_in_area (layout, &impl_priv->area, &start, &end))
                 return -1;
 
-        for (i = 0; i < n_areas; i++) {
-                EvRectangle *rect = areas + i;
-                gdouble      c_x, c_y;
-
-                c_x = rect->x1 + (rect->x2 - rect->x1) / 2.;
-                c_y = rect->y1 + (rect->y2 - rect->y1) / 2.;
-                if (c_x >= impl_priv->area.x1 && c_x <= impl_priv->area.x2 &&
-                    c_y >= impl_priv->area.y1 && c_y <= impl_priv->area.y2)
-                        return i;
-        }
-
-        return -1;
+        return start;
 }
 
 static gint
@@ -138,9 +126,8 @@ ev_hyperlink_get_end_index (AtkHyperlink *atk_hyperlink)
         EvLinkAccessiblePrivate *impl_priv;
         GtkWidget               *widget;
         EvView                  *view;
-        EvRectangle             *areas = NULL;
-        guint                    n_areas = 0;
-        guint                    i;
+        EvTextLayout            *layout;
+        guint                    start, end;
 
         if (!hyperlink->link_impl)
                 return -1;
@@ -155,22 +142,11 @@ ev_hyperlink_get_end_index (AtkHyperlink *atk_hyperlink)
         if (!view->page_cache)
                 return -1;
 
-        ev_page_cache_get_text_layout (view->page_cache, view->current_page, &areas, &n_areas);
-        if (!areas)
+        layout = ev_page_cache_get_text_layout (view->page_cache, view->current_page);
+        if (!ev_text_layout_get_range_in_area (layout, &impl_priv->area, &start, &end))
                 return -1;
 
-        for (i = n_areas - 1; i >= 0; i--) {
-                EvRectangle *rect = areas + i;
-                gdouble      c_x, c_y;
-
-                c_x = rect->x1 + (rect->x2 - rect->x1) / 2.;
-                c_y = rect->y1 + (rect->y2 - rect->y1) / 2.;
-                if (c_x >= impl_priv->area.x1 && c_x <= impl_priv->area.x2 &&
-                    c_y >= impl_priv->area.y1 && c_y <= impl_priv->area.y2)
-                        return i;
-        }
-
-        return -1;
+        return end;
 }
 
 static void
@@ -19,6 +19,7 @@
 
 #include <config.h>
 
+#include <string.h>
 #include <glib.h>
 #include "ev-jobs.h"
 #include "ev-job-scheduler.h"
@@ -29,21 +30,23 @@
 #include "ev-document-images.h"
 #include "ev-document-annotations.h"
 #include "ev-document-text.h"
+#include "ev-text-layout.h"
 #include "ev-page-cache.h"
 
 typedef struct _EvPageCacheData {
 	EvJob             *job;
-	gboolean           done : 1;
-	gboolean           dirty : 1;
-	EvJobPageDataFlags flags;
+	EvJobPageDataFlags loaded;  /* Fields already fetched */
+	EvJobPageDataFlags pending; /* Fields to fetch when job finishes */
+	EvJobPageDataFlags requested; /* Fields asked for before being fetched */
+	GList             *lru_link;
+	gsize              size;
 
 	EvMappingList     *link_mapping;
 	EvMappingList     *image_mapping;
 	EvMappingList     *form_field_mapping;
 	EvMappingList     *annot_mapping;
 	cairo_region_t    *text_mapping;
-	EvRectangle       *text_layout;
-	guint              text_layout_length;
+	EvTextLayout      *text_layout;
 	gchar             *text;
 } EvPageCacheData;
 
@@ -59,12 +62,28 @@ struct _EvPageCache {
 	gint               end_page;
 
 	EvJobPageDataFlags flags;
+
+	/* Pages holding data, most recently used first */
+	GQueue             lru;
+	gsize              size;
+	gsize              max_size;
 };
 
 struct _EvPageCacheClass {
 	GObjectClass parent_class;
+
+	void (* page_data_loaded) (EvPageCache       *cache,
+				   gint               page,
+				   EvJobPageDataFlags flags);
+};
+
+enum {
+	PAGE_DATA_LOADED,
+	N_SIGNALS
 };
 
+static guint signals[N_SIGNALS] = { 0, };
+
 #define EV_PAGE_DATA_FLAGS_DEFAULT (        \
 	EV_PAGE_DATA_INCLUDE_LINKS        | \
 	EV_PAGE_DATA_INCLUDE_TEXT_MAPPING | \
@@ -72,6 +91,17 @@ struct _EvPageCacheClass {
 	EV_PAGE_DATA_INCLUDE_FORMS        | \
 	EV_PAGE_DATA_INCLUDE_ANNOTS)
 
+/* Fields fetched first when a page enters the range */
+#define EV_PAGE_DATA_FLAGS_FIRST (          \
+	EV_PAGE_DATA_INCLUDE_LINKS        | \
+	EV_PAGE_DATA_INCLUDE_ANNOTS)
+
+/* Fields only fetched the first time they are asked for */
+#define EV_PAGE_DATA_FLAGS_LAZY (           \
+	EV_PAGE_DATA_INCLUDE_TEXT         | \
+	EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT)
+
+#define EV_PAGE_CACHE_MAX_SIZE (16 * 1024 * 1024)
 
 static void job_page_data_finished_cb (EvJob       *job,
 				       EvPageCache *cache);
@@ -114,15 +144,19 @@ ev_page_cache_data_free (EvPageCacheData *data)
 	}
 
 	if (data->text_layout) {
-		g_free (data->text_layout);
+		ev_text_layout_free (data->text_layout);
 		data->text_layout = NULL;
-		data->text_layout_length = 0;
 	}
 
 	if (data->text) {
 		g_free (data->text);
 		data->text = NULL;
 	}
+
+	data->loaded = EV_PAGE_DATA_INCLUDE_NONE;
+	data->pending = EV_PAGE_DATA_INCLUDE_NONE;
+	data->requested = EV_PAGE_DATA_INCLUDE_NONE;
+	data->size = 0;
 }
 
 static void
@@ -153,6 +187,8 @@ ev_page_cache_finalize (GObject *object)
 		cache->n_pages = 0;
 	}
 
+	g_queue_clear (&cache->lru);
+
 	if (cache->document) {
 		g_object_unref (cache->document);
 		cache->document = NULL;
@@ -164,6 +200,8 @@ ev_page_cache_finalize (GObject *object)
 static void
 ev_page_cache_init (EvPageCache *cache)
 {
+	g_queue_init (&cache->lru);
+	cache->max_size = EV_PAGE_CACHE_MAX_SIZE;
 }
 
 static void
@@ -172,61 +210,129 @@ ev_page_cache_class_init (EvPageCacheClass *klass)
 	GObjectClass *g_object_class = G_OBJECT_CLASS (klass);
 
 	g_object_class->finalize = ev_page_cache_finalize;
+
+	/* Emitted when fields asked for with one of the getters before
+	 * they were fetched are available
+	 */
+	signals[PAGE_DATA_LOADED] =
+		g_signal_new ("page-data-loaded",
+			      G_OBJECT_CLASS_TYPE (g_object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvPageCacheClass, page_data_loaded),
+			      NULL, NULL,
+			      NULL,
+			      G_TYPE_NONE, 2,
+			      G_TYPE_INT,
+			      G_TYPE_UINT);
 }
 
-static EvJobPageDataFlags
-ev_page_cache_get_flags_for_data (EvPageCache     *cache,
-				  EvPageCacheData *data)
+static gsize
+mapping_list_get_size (EvMappingList *mapping_list)
 {
-	EvJobPageDataFlags flags = EV_PAGE_DATA_INCLUDE_NONE;
+	if (!mapping_list)
+		return 0;
 
-	if (data->flags == cache->flags && !data->dirty)
-		return cache->flags;
+	/* Rough estimate: the mapping, its list node and the mapped object */
+	return ev_mapping_list_length (mapping_list) *
+		(sizeof (EvMapping) + sizeof (GList) + 64);
+}
 
-	/* Flags changed or data is dirty */
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_LINKS) {
-		flags = (data->link_mapping) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_LINKS :
-			flags | EV_PAGE_DATA_INCLUDE_LINKS;
-	}
+static gsize
+ev_page_cache_data_get_size (EvPageCacheData *data)
+{
+	gsize size = 0;
+
+	size += mapping_list_get_size (data->link_mapping);
+	size += mapping_list_get_size (data->image_mapping);
+	size += mapping_list_get_size (data->form_field_mapping);
+	size += mapping_list_get_size (data->annot_mapping);
+	if (data->text_mapping)
+		size += cairo_region_num_rectangles (data->text_mapping) * sizeof (cairo_rectangle_int_t);
+	size += ev_text_layout_get_size (data->text_layout);
+	if (data->text)
+		size += strlen (data->text) + 1;
+
+	return size;
+}
 
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_IMAGES) {
-		flags = (data->image_mapping) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_IMAGES :
-			flags | EV_PAGE_DATA_INCLUDE_IMAGES;
+static void
+ev_page_cache_touch (EvPageCache *cache,
+		     gint         page)
+{
+	EvPageCacheData *data = &cache->page_list[page];
+
+	if (data->lru_link) {
+		if (data->lru_link == cache->lru.head)
+			return;
+		g_queue_unlink (&cache->lru, data->lru_link);
+		g_queue_push_head_link (&cache->lru, data->lru_link);
+	} else {
+		g_queue_push_head (&cache->lru, GINT_TO_POINTER (page));
+		data->lru_link = cache->lru.head;
 	}
+}
 
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_FORMS) {
-		flags = (data->form_field_mapping) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_FORMS :
-			flags | EV_PAGE_DATA_INCLUDE_FORMS;
-	}
+static void
+ev_page_cache_update_size (EvPageCache *cache,
+			   gint         page)
+{
+	EvPageCacheData *data = &cache->page_list[page];
+	gsize            size;
 
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_ANNOTS) {
-		flags = (data->annot_mapping) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_ANNOTS :
-			flags | EV_PAGE_DATA_INCLUDE_ANNOTS;
-	}
+	size = ev_page_cache_data_get_size (data);
+	cache->size = cache->size - data->size + size;
+	data->size = size;
+}
 
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING) {
-		flags = (data->text_mapping) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_TEXT_MAPPING :
-			flags | EV_PAGE_DATA_INCLUDE_TEXT_MAPPING;
-	}
+static void
+ev_page_cache_evict (EvPageCache *cache)
+{
+	GList *l = cache->lru.tail;
+
+	while (l && cache->size > cache->max_size) {
+		GList           *prev = l->prev;
+		gint             page = GPOINTER_TO_INT (l->data);
+		EvPageCacheData *data = &cache->page_list[page];
+
+		/* Never drop the current range or data still being fetched */
+		if ((page < cache->start_page || page > cache->end_page) && !data->job) {
+			cache->size -= data->size;
+			ev_page_cache_data_free (data);
+			g_queue_delete_link (&cache->lru, l);
+			data->lru_link = NULL;
+		}
 
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_TEXT) {
-		flags = (data->text) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_TEXT :
-			flags | EV_PAGE_DATA_INCLUDE_TEXT;
+		l = prev;
 	}
+}
+
+static void
+ev_page_cache_schedule (EvPageCache       *cache,
+			gint               page,
+			EvJobPageDataFlags flags)
+{
+	EvPageCacheData *data = &cache->page_list[page];
 
-	if (cache->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) {
-		flags = (data->text_layout_length > 0) ?
-			flags & ~EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT :
-			flags | EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT;
+	flags &= cache->flags & ~data->loaded;
+	if (flags == EV_PAGE_DATA_INCLUDE_NONE)
+		return;
+
+	if (data->job) {
+		/* Fetch what the running job doesn't include afterwards */
+		data->pending |= flags & ~EV_JOB_PAGE_DATA (data->job)->flags;
+		return;
 	}
 
-	return flags;
+	ev_page_cache_touch (cache, page);
+
+	data->job = ev_job_page_data_new (cache->document, page, flags);
+	g_signal_connect (data->job, "finished",
+			  G_CALLBACK (job_page_data_finished_cb),
+			  cache);
+	g_signal_connect (data->job, "cancelled",
+			  G_CALLBACK (job_page_data_cancelled_cb),
+			  data);
+	ev_job_scheduler_push_job (data->job, EV_JOB_PRIORITY_NONE);
 }
 
 EvPageCache *
@@ -249,32 +355,67 @@ static void
 job_page_data_finished_cb (EvJob       *job,
 			   EvPageCache *cache)
 {
-	EvJobPageData   *job_data = EV_JOB_PAGE_DATA (job);
-	EvPageCacheData *data;
+	EvJobPageData     *job_data = EV_JOB_PAGE_DATA (job);
+	EvPageCacheData   *data;
+	EvJobPageDataFlags pending;
+	EvJobPageDataFlags requested;
+	gint               page = job_data->page;
 
-	data = &cache->page_list[job_data->page];
+	data = &cache->page_list[page];
 
-	if (job_data->flags & EV_PAGE_DATA_INCLUDE_LINKS)
+	if (job_data->flags & EV_PAGE_DATA_INCLUDE_LINKS) {
+		if (data->link_mapping)
+			ev_mapping_list_unref (data->link_mapping);
 		data->link_mapping = job_data->link_mapping;
-	if (job_data->flags & EV_PAGE_DATA_INCLUDE_IMAGES)
+	}
+	if (job_data->flags & EV_PAGE_DATA_INCLUDE_IMAGES) {
+		if (data->image_mapping)
+			ev_mapping_list_unref (data->image_mapping);
 		data->image_mapping = job_data->image_mapping;
-	if (job_data->flags & EV_PAGE_DATA_INCLUDE_FORMS)
+	}
+	if (job_data->flags & EV_PAGE_DATA_INCLUDE_FORMS) {
+		if (data->form_field_mapping)
+			ev_mapping_list_unref (data->form_field_mapping);
 		data->form_field_mapping = job_data->form_field_mapping;
-	if (job_data->flags & EV_PAGE_DATA_INCLUDE_ANNOTS)
+	}
+	if (job_data->flags & EV_PAGE_DATA_INCLUDE_ANNOTS) {
+		if (data->annot_mapping)
+			ev_mapping_list_unref (data->annot_mapping);
 		data->annot_mapping = job_data->annot_mapping;
-	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING)
+	}
+	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING) {
+		if (data->text_mapping)
+			cairo_region_destroy (data->text_mapping);
 		data->text_mapping = job_data->text_mapping;
+	}
 	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) {
-		data->text_layout = job_data->text_layout;
-		data->text_layout_length = job_data->text_layout_length;
+		ev_text_layout_free (data->text_layout);
+		data->text_layout = ev_text_layout_new (job_data->text_layout,
+							job_data->text_layout_length);
+		g_clear_pointer (&job_data->text_layout, g_free);
+		job_data->text_layout_length = 0;
 	}
-	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT)
+	if (job_data->flags & EV_PAGE_DATA_INCLUDE_TEXT) {
+		g_free (data->text);
 		data->text = job_data->text;
-	data->done = TRUE;
-	data->dirty = FALSE;
+	}
+	/* Fields marked dirty while the job was running are still stale */
+	pending = data->pending;
+	data->pending = EV_PAGE_DATA_INCLUDE_NONE;
+	data->loaded = (data->loaded | job_data->flags) & ~pending;
+
+	requested = data->requested & data->loaded;
+	data->requested &= ~requested;
 
 	g_object_unref (data->job);
 	data->job = NULL;
+
+	ev_page_cache_update_size (cache, page);
+	ev_page_cache_schedule (cache, page, pending);
+	ev_page_cache_evict (cache);
+
+	if (requested != EV_PAGE_DATA_INCLUDE_NONE)
+		g_signal_emit (cache, signals[PAGE_DATA_LOADED], 0, page, requested);
 }
 
 static void
@@ -283,6 +424,8 @@ job_page_data_cancelled_cb (EvJob           *job,
 {
 	g_object_unref (data->job);
 	data->job = NULL;
+	data->pending = EV_PAGE_DATA_INCLUDE_NONE;
+	data->requested = EV_PAGE_DATA_INCLUDE_NONE;
 }
 
 void
@@ -290,7 +433,8 @@ ev_page_cache_set_page_range (EvPageCache *cache,
 			      gint         start,
 			      gint         end)
 {
-	gint i;
+	EvJobPageDataFlags flags;
+	gint               i;
 
 	if (cache->flags == EV_PAGE_DATA_INCLUDE_NONE)
 		return;
@@ -298,28 +442,29 @@ ev_page_cache_set_page_range (EvPageCache *cache,
 	cache->start_page = start;
 	cache->end_page = end;
 
+	flags = cache->flags & ~EV_PAGE_DATA_FLAGS_LAZY;
+
 	for (i = start; i <= end; i++) {
 		EvPageCacheData   *data = &cache->page_list[i];
-		EvJobPageDataFlags flags;
+		EvJobPageDataFlags missing;
 
-		if (data->flags == cache->flags && !data->dirty && (data->done || data->job))
+		missing = flags & ~data->loaded;
+		if (data->lru_link)
+			ev_page_cache_touch (cache, i);
+		if (missing == EV_PAGE_DATA_INCLUDE_NONE)
 			continue;
 
-		if (data->job)
-			ev_job_cancel (data->job);
-
-		flags = ev_page_cache_get_flags_for_data (cache, data);
-
-		data->flags = cache->flags;
-		data->job = ev_job_page_data_new (cache->document, i, flags);
-		g_signal_connect (data->job, "finished",
-				  G_CALLBACK (job_page_data_finished_cb),
-				  cache);
-		g_signal_connect (data->job, "cancelled",
-				  G_CALLBACK (job_page_data_cancelled_cb),
-				  data);
-		ev_job_scheduler_push_job (data->job, EV_JOB_PRIORITY_NONE);
+		/* Links and annotations first, the rest in a second job */
+		if (missing & EV_PAGE_DATA_FLAGS_FIRST) {
+			ev_page_cache_schedule (cache, i, missing & EV_PAGE_DATA_FLAGS_FIRST);
+			if (data->job)
+				data->pending |= missing & ~EV_PAGE_DATA_FLAGS_FIRST;
+		} else {
+			ev_page_cache_schedule (cache, i, missing);
+		}
 	}
+
+	ev_page_cache_evict (cache);
 }
 
 EvJobPageDataFlags
@@ -351,7 +496,7 @@ ev_page_cache_mark_dirty (EvPageCache       *cache,
 	g_return_if_fail (EV_IS_PAGE_CACHE (cache));
 
 	data = &cache->page_list[page];
-	data->dirty = TRUE;
+	data->loaded &= ~flags;
 
 	if (flags & EV_PAGE_DATA_INCLUDE_LINKS)
 		g_clear_pointer (&data->link_mapping, ev_mapping_list_unref);
@@ -371,15 +516,90 @@ ev_page_cache_mark_dirty (EvPageCache       *cache,
 	if (flags & EV_PAGE_DATA_INCLUDE_TEXT)
 		g_clear_pointer (&data->text, g_free);
 
-	if (flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT) {
-		g_clear_pointer (&data->text_layout, g_free);
-		data->text_layout_length = 0;
-	}
+	if (flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT)
+		g_clear_pointer (&data->text_layout, ev_text_layout_free);
+
+	ev_page_cache_update_size (cache, page);
+
+	/* A running job may have read the stale data, fetch it again */
+	if (data->job)
+		data->pending |= flags & EV_JOB_PAGE_DATA (data->job)->flags;
 
 	/* Update the current range */
 	ev_page_cache_set_page_range (cache, cache->start_page, cache->end_page);
 }
 
+/**
+ * ev_page_cache_set_annot_mapping:
+ * @cache: an #EvPageCache
+ * @page: the page index
+ * @annot_mapping: (allow-none): the annotations of @page, already
+ *   fetched by someone else
+ *
+ * Stores @annot_mapping for @page unless the annotations of the page
+ * have already been fetched or are being fetched.
+ */
+void
+ev_page_cache_set_annot_mapping (EvPageCache   *cache,
+				 gint           page,
+				 EvMappingList *annot_mapping)
+{
+	EvPageCacheData   *data;
+	EvJobPageDataFlags requested;
+
+	g_return_if_fail (EV_IS_PAGE_CACHE (cache));
+	g_return_if_fail (page >= 0 && page < cache->n_pages);
+
+	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_ANNOTS))
+		return;
+
+	data = &cache->page_list[page];
+	if (data->loaded & EV_PAGE_DATA_INCLUDE_ANNOTS)
+		return;
+	if (data->job && (EV_JOB_PAGE_DATA (data->job)->flags & EV_PAGE_DATA_INCLUDE_ANNOTS))
+		return;
+
+	data->annot_mapping = annot_mapping ? ev_mapping_list_ref (annot_mapping) : NULL;
+	data->loaded |= EV_PAGE_DATA_INCLUDE_ANNOTS;
+	data->pending &= ~EV_PAGE_DATA_INCLUDE_ANNOTS;
+
+	requested = data->requested & EV_PAGE_DATA_INCLUDE_ANNOTS;
+	data->requested &= ~requested;
+
+	ev_page_cache_touch (cache, page);
+	ev_page_cache_update_size (cache, page);
+	ev_page_cache_evict (cache);
+
+	if (requested != EV_PAGE_DATA_INCLUDE_NONE)
+		g_signal_emit (cache, signals[PAGE_DATA_LOADED], 0, page, requested);
+}
+
+/* Returns the cache data for @page if @field has been fetched,
+ * scheduling its fetch otherwise. ::page-data-loaded is emitted
+ * once it has been fetched.
+ */
+static EvPageCacheData *
+ev_page_cache_lookup (EvPageCache       *cache,
+		      gint               page,
+		      EvJobPageDataFlags field)
+{
+	EvPageCacheData *data;
+
+	if (!(cache->flags & field))
+		return NULL;
+
+	data = &cache->page_list[page];
+	if (!(data->loaded & field)) {
+		data->requested |= field;
+		ev_page_cache_schedule (cache, page, field);
+		return NULL;
+	}
+
+	ev_page_cache_touch (cache, page);
+
+	return data;
+}
+
 EvMappingList *
 ev_page_cache_get_link_mapping (EvPageCache *cache,
 				gint         page)
@@ -389,17 +609,9 @@ ev_page_cache_get_link_mapping (EvPageCache *cache,
 	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
 	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_LINKS))
-		return NULL;
-
-	data = &cache->page_list[page];
-	if (data->done)
-		return data->link_mapping;
-
-	if (data->job)
-		return EV_JOB_PAGE_DATA (data->job)->link_mapping;
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_LINKS);
 
-	return data->link_mapping;
+	return data ? data->link_mapping : NULL;
 }
 
 EvMappingList *
@@ -411,17 +623,9 @@ ev_page_cache_get_image_mapping (EvPageCache *cache,
 	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
 	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_IMAGES))
-		return NULL;
-
-	data = &cache->page_list[page];
-	if (data->done)
-		return data->image_mapping;
-
-	if (data->job)
-		return EV_JOB_PAGE_DATA (data->job)->image_mapping;
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_IMAGES);
 
-	return data->image_mapping;
+	return data ? data->image_mapping : NULL;
 }
 
 EvMappingList *
@@ -433,17 +637,9 @@ ev_page_cache_get_form_field_mapping (EvPageCache *cache,
 	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
 	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_FORMS))
-		return NULL;
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_FORMS);
 
-	data = &cache->page_list[page];
-	if (data->done)
-		return data->form_field_mapping;
-
-	if (data->job)
-		return EV_JOB_PAGE_DATA (data->job)->form_field_mapping;
-
-	return data->form_field_mapping;
+	return data ? data->form_field_mapping : NULL;
 }
 
 EvMappingList *
@@ -455,17 +651,9 @@ ev_page_cache_get_annot_mapping (EvPageCache *cache,
 	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
 	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_ANNOTS))
-		return NULL;
-
-	data = &cache->page_list[page];
-	if (data->done)
-		return data->annot_mapping;
-
-	if (data->job)
-		return EV_JOB_PAGE_DATA (data->job)->annot_mapping;
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_ANNOTS);
 
-	return data->annot_mapping;
+	return data ? data->annot_mapping : NULL;
 }
 
 cairo_region_t *
@@ -477,17 +665,9 @@ ev_page_cache_get_text_mapping (EvPageCache *cache,
 	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
 	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_TEXT_MAPPING))
-		return NULL;
-
-	data = &cache->page_list[page];
-	if (data->done)
-		return data->text_mapping;
-
-	if (data->job)
-		return EV_JOB_PAGE_DATA (data->job)->text_mapping;
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_TEXT_MAPPING);
 
-	return data->text_mapping;
+	return data ? data->text_mapping : NULL;
 }
 
 const gchar *
@@ -499,47 +679,21 @@ ev_page_cache_get_text (EvPageCache *cache,
 	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
 	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_TEXT))
-		return NULL;
-
-	data = &cache->page_list[page];
-	if (data->done)
-		return data->text;
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_TEXT);
 
-	if (data->job)
-		return EV_JOB_PAGE_DATA (data->job)->text;
-
-	return data->text;
+	return data ? data->text : NULL;
 }
 
-gboolean
-ev_page_cache_get_text_layout (EvPageCache  *cache,
-			       gint          page,
-			       EvRectangle **areas,
-			       guint        *n_areas)
+EvTextLayout *
+ev_page_cache_get_text_layout (EvPageCache *cache,
+			       gint         page)
 {
 	EvPageCacheData *data;
 
-	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), FALSE);
-	g_return_val_if_fail (page >= 0 && page < cache->n_pages, FALSE);
-
-	if (!(cache->flags & EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT))
-		return FALSE;
-
-	data = &cache->page_list[page];
-	if (data->done)	{
-		*areas = data->text_layout;
-		*n_areas = data->text_layout_length;
-
-		return TRUE;
-	}
-
-	if (data->job) {
-		*areas = EV_JOB_PAGE_DATA (data->job)->text_layout;
-		*n_areas = EV_JOB_PAGE_DATA (data->job)->text_layout_length;
+	g_return_val_if_fail (EV_IS_PAGE_CACHE (cache), NULL);
+	g_return_val_if_fail (page >= 0 && page < cache->n_pages, NULL);
 
-		return TRUE;
-	}
+	data = ev_page_cache_lookup (cache, page, EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT);
 
-	return FALSE;
+	return data ? data->text_layout : NULL;
 }
@@ -29,6 +29,8 @@
 #include <xreader-document.h>
 #include <xreader-view.h>
 
+#include "ev-text-layout.h"
+
 G_BEGIN_DECLS
 
 #define EV_TYPE_PAGE_CACHE    (ev_page_cache_get_type ())
@@ -50,6 +52,9 @@ void               ev_page_cache_set_flags              (EvPageCache       *cach
 void               ev_page_cache_mark_dirty             (EvPageCache       *cache,
 							 gint               page,
                                                          EvJobPageDataFlags flags);
+void               ev_page_cache_set_annot_mapping      (EvPageCache       *cache,
+							 gint               page,
+							 EvMappingList     *annot_mapping);
 EvMappingList     *ev_page_cache_get_link_mapping       (EvPageCache       *cache,
 							 gint               page);
 EvMappingList     *ev_page_cache_get_image_mapping      (EvPageCache       *cache,
@@ -62,10 +67,8 @@ cairo_region_t    *ev_page_cache_get_text_mapping       (EvPageCache       *cach
 							 gint               page);
 const gchar       *ev_page_cache_get_text               (EvPageCache       *cache,
 							 gint               page);
-gboolean           ev_page_cache_get_text_layout        (EvPageCache       *cache,
-							 gint               page,
-							 EvRectangle      **areas,
-							 guint             *n_areas);
+EvTextLayout      *ev_page_cache_get_text_layout        (EvPageCache       *cache,
+							 gint               page);
 
 G_END_DECLS
 
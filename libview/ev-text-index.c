@@ -0,0 +1,655 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "ev-text-index.h"
+
+/* In-memory full text index of a document.  For every page it keeps the
+ * text returned by ev_document_text_get_text() decoded to UCS-4, a
+ * lower-cased copy for case insensitive searches and the area of every
+ * character, so that matches and their rectangles can be computed
+ * without going back to the backend.
+ */
+
+#define EV_TEXT_INDEX_MAGIC   "XRTI"
+#define EV_TEXT_INDEX_VERSION 1
+
+/* Saved indexes are evicted, least recently used first, to keep
+ * the cache directory under this size
+ */
+#define EV_TEXT_INDEX_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+typedef enum {
+	PAGE_PENDING,
+	PAGE_INDEXED,
+	PAGE_UNINDEXABLE
+} EvTextIndexPageState;
+
+typedef struct {
+	EvTextIndexPageState state;
+	gchar               *text;
+	gunichar            *chars;
+	gunichar            *folded;
+	gfloat              *boxes; /* x1, y1, x2, y2 for every character */
+	guint                n_chars;
+} EvTextIndexPage;
+
+struct _EvTextIndex {
+	GObject parent;
+
+	EvTextIndexPage *pages;
+	gint             n_pages;
+	gint             n_done;
+	guint64          mtime;
+};
+
+struct _EvTextIndexClass {
+	GObjectClass parent_class;
+};
+
+G_DEFINE_TYPE (EvTextIndex, ev_text_index, G_TYPE_OBJECT)
+
+static void
+ev_text_index_page_free (EvTextIndexPage *page)
+{
+	g_clear_pointer (&page->text, g_free);
+	g_clear_pointer (&page->chars, g_free);
+	g_clear_pointer (&page->folded, g_free);
+	g_clear_pointer (&page->boxes, g_free);
+	page->n_chars = 0;
+}
+
+static void
+ev_text_index_finalize (GObject *object)
+{
+	EvTextIndex *index = EV_TEXT_INDEX (object);
+	gint         i;
+
+	for (i = 0; i < index->n_pages; i++)
+		ev_text_index_page_free (&index->pages[i]);
+	g_free (index->pages);
+
+	G_OBJECT_CLASS (ev_text_index_parent_class)->finalize (object);
+}
+
+static void
+ev_text_index_init (EvTextIndex *index)
+{
+}
+
+static void
+ev_text_index_class_init (EvTextIndexClass *klass)
+{
+	GObjectClass *g_object_class = G_OBJECT_CLASS (klass);
+
+	g_object_class->finalize = ev_text_index_finalize;
+}
+
+/**
+ * ev_text_index_new:
+ * @n_pages: number of pages of the document
+ * @mtime: modification time of the indexed file, used to validate
+ *   the persisted index
+ *
+ * Returns: (transfer full): a new empty #EvTextIndex
+ */
+EvTextIndex *
+ev_text_index_new (gint    n_pages,
+		   guint64 mtime)
+{
+	EvTextIndex *index;
+
+	g_return_val_if_fail (n_pages >= 0, NULL);
+
+	index = EV_TEXT_INDEX (g_object_new (EV_TYPE_TEXT_INDEX, NULL));
+	index->n_pages = n_pages;
+	index->mtime = mtime;
+	index->pages = g_new0 (EvTextIndexPage, n_pages);
+
+	return index;
+}
+
+static gboolean
+ev_text_index_page_set_text (EvTextIndexPage *page,
+			     gchar           *text,
+			     gfloat          *boxes,
+			     guint            n_boxes)
+{
+	glong n_chars, i;
+
+	page->chars = g_utf8_to_ucs4_fast (text, -1, &n_chars);
+	if ((guint)n_chars != n_boxes) {
+		/* Characters and areas don't pair up, let the backend
+		 * search this page rather than highlight the wrong glyphs.
+		 */
+		g_free (page->chars);
+		page->chars = NULL;
+		g_free (text);
+		g_free (boxes);
+		page->state = PAGE_UNINDEXABLE;
+
+		return FALSE;
+	}
+
+	page->text = text;
+	page->boxes = boxes;
+	page->n_chars = n_chars;
+	page->folded = g_new (gunichar, n_chars + 1);
+	for (i = 0; i < n_chars; i++)
+		page->folded[i] = g_unichar_tolower (page->chars[i]);
+	page->folded[n_chars] = 0;
+	page->state = PAGE_INDEXED;
+
+	return TRUE;
+}
+
+/**
+ * ev_text_index_add_page:
+ * @index: an #EvTextIndex
+ * @page: the page number
+ * @text: (allow-none): the page text
+ * @areas: (allow-none): the area of every character of @text
+ * @n_areas: the number of elements in @areas
+ *
+ * Adds the text of @page to @index.  Pages whose text does not match
+ * their layout are recorded as not indexed.
+ */
+void
+ev_text_index_add_page (EvTextIndex *index,
+			gint         page,
+			const gchar *text,
+			EvRectangle *areas,
+			guint        n_areas)
+{
+	EvTextIndexPage *index_page;
+	gfloat          *boxes;
+	guint            i;
+
+	g_return_if_fail (EV_IS_TEXT_INDEX (index));
+	g_return_if_fail (page >= 0 && page < index->n_pages);
+
+	index_page = &index->pages[page];
+	if (index_page->state != PAGE_PENDING)
+		return;
+
+	index->n_done++;
+
+	if (!text || !g_utf8_validate (text, -1, NULL)) {
+		index_page->state = PAGE_UNINDEXABLE;
+		return;
+	}
+
+	boxes = g_new (gfloat, 4 * n_areas);
+	for (i = 0; i < n_areas; i++) {
+		boxes[4 * i] = areas[i].x1;
+		boxes[4 * i + 1] = areas[i].y1;
+		boxes[4 * i + 2] = areas[i].x2;
+		boxes[4 * i + 3] = areas[i].y2;
+	}
+
+	ev_text_index_page_set_text (index_page, g_strdup (text), boxes, n_areas);
+}
+
+gint
+ev_text_index_get_n_pages (EvTextIndex *index)
+{
+	g_return_val_if_fail (EV_IS_TEXT_INDEX (index), 0);
+
+	return index->n_pages;
+}
+
+/**
+ * ev_text_index_has_page:
+ * @index: an #EvTextIndex
+ * @page: the page number
+ *
+ * Returns: %TRUE if @page can be searched with @index
+ */
+gboolean
+ev_text_index_has_page (EvTextIndex *index,
+			gint         page)
+{
+	g_return_val_if_fail (EV_IS_TEXT_INDEX (index), FALSE);
+	g_return_val_if_fail (page >= 0 && page < index->n_pages, FALSE);
+
+	return index->pages[page].state == PAGE_INDEXED;
+}
+
+gboolean
+ev_text_index_is_complete (EvTextIndex *index)
+{
+	g_return_val_if_fail (EV_IS_TEXT_INDEX (index), FALSE);
+
+	return index->n_done == index->n_pages;
+}
+
+static gunichar *
+ev_text_index_prepare_needle (const gchar *text,
+			      gboolean     case_sensitive,
+			      glong       *len)
+{
+	gunichar *needle;
+	glong     i;
+
+	needle = g_utf8_to_ucs4_fast (text, -1, len);
+	if (!case_sensitive) {
+		for (i = 0; i < *len; i++)
+			needle[i] = g_unichar_tolower (needle[i]);
+	}
+
+	return needle;
+}
+
+static guint
+ev_text_index_page_find (EvTextIndexPage *page,
+			 const gunichar  *needle,
+			 glong            len,
+			 gboolean         case_sensitive,
+			 GList          **matches)
+{
+	const gunichar *haystack;
+	guint           n_matches = 0;
+	guint           i, j;
+
+	if (page->state != PAGE_INDEXED || len == 0 || page->n_chars < (guint)len)
+		return 0;
+
+	haystack = case_sensitive ? page->chars : page->folded;
+
+	for (i = 0; i <= page->n_chars - len; i++) {
+		EvRectangle *rect;
+		gfloat      *box;
+
+		if (haystack[i] != needle[0] ||
+		    memcmp (haystack + i, needle, len * sizeof (gunichar)) != 0)
+			continue;
+
+		n_matches++;
+
+		if (matches) {
+			box = page->boxes + 4 * i;
+			rect = ev_rectangle_new ();
+			rect->x1 = box[0];
+			rect->y1 = box[1];
+			rect->x2 = box[2];
+			rect->y2 = box[3];
+			for (j = i + 1; j < i + len; j++) {
+				box = page->boxes + 4 * j;
+				rect->x1 = MIN (rect->x1, box[0]);
+				rect->y1 = MIN (rect->y1, box[1]);
+				rect->x2 = MAX (rect->x2, box[2]);
+				rect->y2 = MAX (rect->y2, box[3]);
+			}
+			*matches = g_list_prepend (*matches, rect);
+		}
+
+		/* Matches don't overlap */
+		i += len - 1;
+	}
+
+	return n_matches;
+}
+
+/**
+ * ev_text_index_find_text:
+ * @index: an #EvTextIndex
+ * @page: the page number
+ * @text: the text to find
+ * @case_sensitive: whether the search is case sensitive
+ *
+ * Returns: (transfer full) (element-type EvRectangle): the areas of the
+ *   matches on @page, in the same format as ev_document_find_find_text()
+ */
+GList *
+ev_text_index_find_text (EvTextIndex *index,
+			 gint         page,
+			 const gchar *text,
+			 gboolean     case_sensitive)
+{
+	gunichar *needle;
+	glong     len;
+	GList    *matches = NULL;
+
+	g_return_val_if_fail (EV_IS_TEXT_INDEX (index), NULL);
+	g_return_val_if_fail (page >= 0 && page < index->n_pages, NULL);
+	g_return_val_if_fail (text != NULL, NULL);
+
+	needle = ev_text_index_prepare_needle (text, case_sensitive, &len);
+	ev_text_index_page_find (&index->pages[page], needle, len, case_sensitive, &matches);
+	g_free (needle);
+
+	return g_list_reverse (matches);
+}
+
+/**
+ * ev_text_index_count_matches:
+ * @index: an #EvTextIndex
+ * @text: the text to find
+ * @case_sensitive: whether the search is case sensitive
+ *
+ * Returns: the number of matches of @text in all the indexed pages
+ */
+guint
+ev_text_index_count_matches (EvTextIndex *index,
+			     const gchar *text,
+			     gboolean     case_sensitive)
+{
+	gunichar *needle;
+	glong     len;
+	guint     n_matches = 0;
+	gint      i;
+
+	g_return_val_if_fail (EV_IS_TEXT_INDEX (index), 0);
+	g_return_val_if_fail (text != NULL, 0);
+
+	needle = ev_text_index_prepare_needle (text, case_sensitive, &len);
+	for (i = 0; i < index->n_pages; i++)
+		n_matches += ev_text_index_page_find (&index->pages[i], needle, len, case_sensitive, NULL);
+	g_free (needle);
+
+	return n_matches;
+}
+
+/* Persistence */
+
+/**
+ * ev_text_index_get_cache_filename:
+ * @uri: the document URI
+ *
+ * Returns: (transfer full): the path where the index of @uri is stored
+ */
+gchar *
+ev_text_index_get_cache_filename (const gchar *uri)
+{
+	gchar *checksum;
+	gchar *basename;
+	gchar *filename;
+
+	checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+	basename = g_strconcat (checksum, ".index", NULL);
+	filename = g_build_filename (g_get_user_cache_dir (), "xreader",
+				     "text-index", basename, NULL);
+	g_free (checksum);
+	g_free (basename);
+
+	return filename;
+}
+
+typedef struct {
+	gchar  *filename;
+	time_t  mtime;
+	goffset size;
+} CacheEntry;
+
+static gint
+compare_cache_entries (gconstpointer a,
+		       gconstpointer b)
+{
+	const CacheEntry *entry_a = a;
+	const CacheEntry *entry_b = b;
+
+	if (entry_a->mtime == entry_b->mtime)
+		return 0;
+
+	return entry_a->mtime < entry_b->mtime ? -1 : 1;
+}
+
+static void
+ev_text_index_prune_cache (const gchar *dirname)
+{
+	GDir        *dir;
+	const gchar *name;
+	GArray      *entries;
+	goffset      total_size = 0;
+	guint        i;
+
+	dir = g_dir_open (dirname, 0, NULL);
+	if (!dir)
+		return;
+
+	entries = g_array_new (FALSE, FALSE, sizeof (CacheEntry));
+	while ((name = g_dir_read_name (dir))) {
+		CacheEntry entry;
+		GStatBuf   buf;
+
+		if (!g_str_has_suffix (name, ".index"))
+			continue;
+
+		entry.filename = g_build_filename (dirname, name, NULL);
+		if (g_stat (entry.filename, &buf) != 0) {
+			g_free (entry.filename);
+			continue;
+		}
+
+		entry.mtime = buf.st_mtime;
+		entry.size = buf.st_size;
+		total_size += entry.size;
+		g_array_append_val (entries, entry);
+	}
+	g_dir_close (dir);
+
+	g_array_sort (entries, compare_cache_entries);
+
+	for (i = 0; i < entries->len; i++) {
+		CacheEntry *entry = &g_array_index (entries, CacheEntry, i);
+
+		if (total_size > EV_TEXT_INDEX_CACHE_MAX_SIZE &&
+		    g_unlink (entry->filename) == 0)
+			total_size -= entry->size;
+		g_free (entry->filename);
+	}
+	g_array_free (entries, TRUE);
+}
+
+static void
+append_uint32 (GByteArray *data,
+	       guint32     value)
+{
+	g_byte_array_append (data, (const guint8 *)&value, sizeof (value));
+}
+
+/**
+ * ev_text_index_save:
+ * @index: a complete #EvTextIndex
+ * @filename: the file to save @index to
+ * @error: (allow-none): return location for an error
+ *
+ * Saves @index in the text index cache directory, evicting the least
+ * recently used indexes so that the cache stays within its size limit.
+ * Indexes that are too large to be cached are not saved.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+ev_text_index_save (EvTextIndex *index,
+		    const gchar *filename,
+		    GError     **error)
+{
+	GByteArray *data;
+	gchar      *dirname;
+	gboolean    retval;
+	gint        i;
+
+	g_return_val_if_fail (EV_IS_TEXT_INDEX (index), FALSE);
+	g_return_val_if_fail (ev_text_index_is_complete (index), FALSE);
+
+	data = g_byte_array_new ();
+	g_byte_array_append (data, (const guint8 *)EV_TEXT_INDEX_MAGIC, 4);
+	append_uint32 (data, EV_TEXT_INDEX_VERSION);
+	g_byte_array_append (data, (const guint8 *)&index->mtime, sizeof (guint64));
+	append_uint32 (data, index->n_pages);
+
+	for (i = 0; i < index->n_pages; i++) {
+		EvTextIndexPage *page = &index->pages[i];
+		guint32          text_len;
+
+		if (page->state != PAGE_INDEXED) {
+			append_uint32 (data, PAGE_UNINDEXABLE);
+			continue;
+		}
+
+		text_len = strlen (page->text);
+		append_uint32 (data, PAGE_INDEXED);
+		append_uint32 (data, text_len);
+		g_byte_array_append (data, (const guint8 *)page->text, text_len);
+		append_uint32 (data, page->n_chars);
+		g_byte_array_append (data, (const guint8 *)page->boxes,
+				     4 * page->n_chars * sizeof (gfloat));
+	}
+
+	if (data->len > EV_TEXT_INDEX_CACHE_MAX_SIZE) {
+		g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_FBIG,
+				     "Text index is too large to be cached");
+		g_byte_array_free (data, TRUE);
+
+		return FALSE;
+	}
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	retval = g_file_set_contents (filename, (const gchar *)data->data, data->len, error);
+	g_byte_array_free (data, TRUE);
+
+	if (retval)
+		ev_text_index_prune_cache (dirname);
+	g_free (dirname);
+
+	return retval;
+}
+
+static gboolean
+read_bytes (const guint8 **cursor,
+	    const guint8  *end,
+	    gpointer       dest,
+	    gsize          len)
+{
+	if ((gsize)(end - *cursor) < len)
+		return FALSE;
+
+	memcpy (dest, *cursor, len);
+	*cursor += len;
+
+	return TRUE;
+}
+
+/**
+ * ev_text_index_new_from_file:
+ * @filename: the file to load the index from
+ * @n_pages: number of pages of the document
+ * @mtime: modification time of the document
+ * @error: (allow-none): return location for an error
+ *
+ * Loads an index saved with ev_text_index_save().  The index is only
+ * returned if it was built for a document with the same number of
+ * pages and modification time.
+ *
+ * Returns: (transfer full): a complete #EvTextIndex, or %NULL
+ */
+EvTextIndex *
+ev_text_index_new_from_file (const gchar *filename,
+			     gint         n_pages,
+			     guint64      mtime,
+			     GError     **error)
+{
+	EvTextIndex  *index;
+	gchar        *contents;
+	gsize         length;
+	const guint8 *cursor, *end;
+	gchar         magic[4];
+	guint32       version, file_n_pages;
+	guint64       file_mtime;
+	gint          i;
+
+	if (!g_file_get_contents (filename, &contents, &length, error))
+		return NULL;
+
+	cursor = (const guint8 *)contents;
+	end = cursor + length;
+
+	if (!read_bytes (&cursor, end, magic, 4) ||
+	    memcmp (magic, EV_TEXT_INDEX_MAGIC, 4) != 0 ||
+	    !read_bytes (&cursor, end, &version, sizeof (version)) ||
+	    version != EV_TEXT_INDEX_VERSION ||
+	    !read_bytes (&cursor, end, &file_mtime, sizeof (file_mtime)) ||
+	    file_mtime != mtime ||
+	    !read_bytes (&cursor, end, &file_n_pages, sizeof (file_n_pages)) ||
+	    file_n_pages != (guint32)n_pages) {
+		g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				     "Text index is outdated");
+		g_free (contents);
+
+		return NULL;
+	}
+
+	index = ev_text_index_new (n_pages, mtime);
+
+	for (i = 0; i < n_pages; i++) {
+		EvTextIndexPage *page = &index->pages[i];
+		guint32          state, text_len, n_chars;
+		gchar           *text;
+		gfloat          *boxes;
+
+		if (!read_bytes (&cursor, end, &state, sizeof (state)))
+			break;
+
+		index->n_done++;
+		if (state != PAGE_INDEXED) {
+			page->state = PAGE_UNINDEXABLE;
+			continue;
+		}
+
+		if (!read_bytes (&cursor, end, &text_len, sizeof (text_len)) ||
+		    (gsize)(end - cursor) < text_len)
+			break;
+
+		text = g_strndup ((const gchar *)cursor, text_len);
+		cursor += text_len;
+
+		if (!read_bytes (&cursor, end, &n_chars, sizeof (n_chars)) ||
+		    (gsize)(end - cursor) / (4 * sizeof (gfloat)) < n_chars ||
+		    !g_utf8_validate (text, -1, NULL)) {
+			g_free (text);
+			break;
+		}
+
+		boxes = g_malloc (4 * n_chars * sizeof (gfloat));
+		memcpy (boxes, cursor, 4 * n_chars * sizeof (gfloat));
+		cursor += 4 * n_chars * sizeof (gfloat);
+
+		ev_text_index_page_set_text (page, text, boxes, n_chars);
+	}
+
+	g_free (contents);
+
+	if (i < n_pages) {
+		g_set_error_literal (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+				     "Text index is corrupted");
+		g_object_unref (index);
+
+		return NULL;
+	}
+
+	/* Mark it as recently used for the cache eviction */
+	g_utime (filename, NULL);
+
+	return index;
+}
@@ -0,0 +1,68 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (__EV_XREADER_VIEW_H_INSIDE__) && !defined (XREADER_COMPILATION)
+#error "Only <xreader-view.h> can be included directly."
+#endif
+
+#ifndef __EV_TEXT_INDEX_H__
+#define __EV_TEXT_INDEX_H__
+
+#include <glib-object.h>
+#include <xreader-document.h>
+
+G_BEGIN_DECLS
+
+#define EV_TYPE_TEXT_INDEX            (ev_text_index_get_type ())
+#define EV_TEXT_INDEX(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), EV_TYPE_TEXT_INDEX, EvTextIndex))
+#define EV_IS_TEXT_INDEX(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EV_TYPE_TEXT_INDEX))
+
+typedef struct _EvTextIndex        EvTextIndex;
+typedef struct _EvTextIndexClass   EvTextIndexClass;
+
+GType        ev_text_index_get_type           (void) G_GNUC_CONST;
+EvTextIndex *ev_text_index_new                (gint          n_pages,
+					       guint64       mtime);
+EvTextIndex *ev_text_index_new_from_file      (const gchar  *filename,
+					       gint          n_pages,
+					       guint64       mtime,
+					       GError      **error);
+gboolean     ev_text_index_save               (EvTextIndex  *index,
+					       const gchar  *filename,
+					       GError      **error);
+gchar       *ev_text_index_get_cache_filename (const gchar  *uri);
+
+void         ev_text_index_add_page           (EvTextIndex  *index,
+					       gint          page,
+					       const gchar  *text,
+					       EvRectangle  *areas,
+					       guint         n_areas);
+gint         ev_text_index_get_n_pages        (EvTextIndex  *index);
+gboolean     ev_text_index_has_page           (EvTextIndex  *index,
+					       gint          page);
+gboolean     ev_text_index_is_complete        (EvTextIndex  *index);
+GList       *ev_text_index_find_text          (EvTextIndex  *index,
+					       gint          page,
+					       const gchar  *text,
+					       gboolean      case_sensitive);
+guint        ev_text_index_count_matches      (EvTextIndex  *index,
+					       const gchar  *text,
+					       gboolean      case_sensitive);
+
+G_END_DECLS
+
+#endif /* __EV_TEXT_INDEX_H__ */
@@ -0,0 +1,387 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include "ev-text-layout.h"
+
+/* Compact, indexed copy of the per-character layout returned by
+ * ev_document_text_get_text_layout().  Glyph boxes are stored as floats
+ * and grouped into lines; lines are additionally sorted by their top
+ * edge so that a point can be mapped to a glyph offset with a binary
+ * search instead of walking every character of the page.
+ */
+
+typedef struct {
+	gfloat x1;
+	gfloat y1;
+	gfloat x2;
+	gfloat y2;
+} EvTextLayoutBox;
+
+typedef struct {
+	EvTextLayoutBox bbox;
+	guint           first;
+	guint           last;      /* One past the last glyph of the line */
+	gfloat          max_width; /* Widest glyph in the line */
+	gboolean        sorted;    /* Glyph x1 is non-decreasing */
+} EvTextLayoutLine;
+
+struct _EvTextLayout {
+	EvTextLayoutBox  *glyphs;
+	guint             n_glyphs;
+
+	EvTextLayoutLine *lines;
+	guint             n_lines;
+
+	/* Lines ordered by bbox.y1, and the running maximum of their y2 */
+	guint            *lines_by_y;
+	gfloat           *max_y2;
+};
+
+static inline gboolean
+box_contains_point (const EvTextLayoutBox *box,
+		    gdouble                x,
+		    gdouble                y)
+{
+	return x >= box->x1 && x <= box->x2 && y >= box->y1 && y <= box->y2;
+}
+
+static inline void
+box_union (EvTextLayoutBox       *box,
+	   const EvTextLayoutBox *other)
+{
+	box->x1 = MIN (box->x1, other->x1);
+	box->y1 = MIN (box->y1, other->y1);
+	box->x2 = MAX (box->x2, other->x2);
+	box->y2 = MAX (box->y2, other->y2);
+}
+
+static gboolean
+glyph_starts_line (const EvTextLayoutLine *line,
+		   const EvTextLayoutBox  *prev,
+		   const EvTextLayoutBox  *glyph)
+{
+	gfloat center_y = glyph->y1 + (glyph->y2 - glyph->y1) / 2.;
+
+	if (center_y < line->bbox.y1 || center_y > line->bbox.y2)
+		return TRUE;
+
+	/* Text flowing back to the left on the same baseline is a new
+	 * line (e.g. the next column of a multi-column layout).
+	 */
+	return glyph->x2 < prev->x1;
+}
+
+static gint
+compare_lines_by_y (gconstpointer a,
+		    gconstpointer b,
+		    gpointer      user_data)
+{
+	EvTextLayout           *layout = user_data;
+	const EvTextLayoutLine *line_a = &layout->lines[*(const guint *)a];
+	const EvTextLayoutLine *line_b = &layout->lines[*(const guint *)b];
+
+	if (line_a->bbox.y1 < line_b->bbox.y1)
+		return -1;
+	if (line_a->bbox.y1 > line_b->bbox.y1)
+		return 1;
+
+	return (gint)line_a->first - (gint)line_b->first;
+}
+
+static void
+ev_text_layout_build_index (EvTextLayout *layout)
+{
+	GArray           *lines;
+	EvTextLayoutLine  line;
+	guint             i;
+
+	lines = g_array_new (FALSE, FALSE, sizeof (EvTextLayoutLine));
+
+	line.bbox = layout->glyphs[0];
+	line.first = 0;
+	line.max_width = layout->glyphs[0].x2 - layout->glyphs[0].x1;
+	line.sorted = TRUE;
+
+	for (i = 1; i < layout->n_glyphs; i++) {
+		EvTextLayoutBox *glyph = &layout->glyphs[i];
+		EvTextLayoutBox *prev = &layout->glyphs[i - 1];
+
+		if (glyph_starts_line (&line, prev, glyph)) {
+			line.last = i;
+			g_array_append_val (lines, line);
+
+			line.bbox = *glyph;
+			line.first = i;
+			line.max_width = 0;
+			line.sorted = TRUE;
+		} else {
+			box_union (&line.bbox, glyph);
+			if (glyph->x1 < prev->x1)
+				line.sorted = FALSE;
+		}
+
+		line.max_width = MAX (line.max_width, glyph->x2 - glyph->x1);
+	}
+	line.last = layout->n_glyphs;
+	g_array_append_val (lines, line);
+
+	layout->n_lines = lines->len;
+	layout->lines = (EvTextLayoutLine *)g_array_free (lines, FALSE);
+
+	layout->lines_by_y = g_new (guint, layout->n_lines);
+	for (i = 0; i < layout->n_lines; i++)
+		layout->lines_by_y[i] = i;
+
+	g_qsort_with_data (layout->lines_by_y, layout->n_lines, sizeof (guint),
+			   compare_lines_by_y, layout);
+
+	layout->max_y2 = g_new (gfloat, layout->n_lines);
+	for (i = 0; i < layout->n_lines; i++) {
+		gfloat y2 = layout->lines[layout->lines_by_y[i]].bbox.y2;
+
+		layout->max_y2[i] = i > 0 ? MAX (layout->max_y2[i - 1], y2) : y2;
+	}
+}
+
+/**
+ * ev_text_layout_new:
+ * @areas: the character areas of a page, as returned by
+ *   ev_document_text_get_text_layout()
+ * @n_areas: the number of elements in @areas
+ *
+ * Returns: (transfer full): a new #EvTextLayout, or %NULL if @n_areas is 0
+ */
+EvTextLayout *
+ev_text_layout_new (const EvRectangle *areas,
+		    guint              n_areas)
+{
+	EvTextLayout *layout;
+	guint         i;
+
+	if (!areas || n_areas == 0)
+		return NULL;
+
+	layout = g_slice_new0 (EvTextLayout);
+	layout->n_glyphs = n_areas;
+	layout->glyphs = g_new (EvTextLayoutBox, n_areas);
+	for (i = 0; i < n_areas; i++) {
+		layout->glyphs[i].x1 = areas[i].x1;
+		layout->glyphs[i].y1 = areas[i].y1;
+		layout->glyphs[i].x2 = areas[i].x2;
+		layout->glyphs[i].y2 = areas[i].y2;
+	}
+
+	ev_text_layout_build_index (layout);
+
+	return layout;
+}
+
+void
+ev_text_layout_free (EvTextLayout *layout)
+{
+	if (!layout)
+		return;
+
+	g_free (layout->glyphs);
+	g_free (layout->lines);
+	g_free (layout->lines_by_y);
+	g_free (layout->max_y2);
+	g_slice_free (EvTextLayout, layout);
+}
+
+guint
+ev_text_layout_get_length (EvTextLayout *layout)
+{
+	return layout ? layout->n_glyphs : 0;
+}
+
+/**
+ * ev_text_layout_get_size:
+ * @layout: an #EvTextLayout
+ *
+ * Returns: the approximate number of bytes used by @layout
+ */
+gsize
+ev_text_layout_get_size (EvTextLayout *layout)
+{
+	if (!layout)
+		return 0;
+
+	return sizeof (EvTextLayout) +
+		layout->n_glyphs * sizeof (EvTextLayoutBox) +
+		layout->n_lines * (sizeof (EvTextLayoutLine) + sizeof (guint) + sizeof (gfloat));
+}
+
+gboolean
+ev_text_layout_get_area (EvTextLayout *layout,
+			 guint         offset,
+			 EvRectangle  *area)
+{
+	EvTextLayoutBox *glyph;
+
+	if (!layout || offset >= layout->n_glyphs)
+		return FALSE;
+
+	glyph = &layout->glyphs[offset];
+	area->x1 = glyph->x1;
+	area->y1 = glyph->y1;
+	area->x2 = glyph->x2;
+	area->y2 = glyph->y2;
+
+	return TRUE;
+}
+
+static gint
+ev_text_layout_line_get_offset_at_point (EvTextLayout     *layout,
+					 EvTextLayoutLine *line,
+					 gdouble           x,
+					 gdouble           y)
+{
+	guint lo, hi, i;
+
+	if (!line->sorted) {
+		for (i = line->last; i > line->first; i--) {
+			if (box_contains_point (&layout->glyphs[i - 1], x, y))
+				return i - 1;
+		}
+
+		return -1;
+	}
+
+	/* Find the first glyph whose x1 is past the point; every glyph
+	 * that may contain it lies before that one, within max_width.
+	 */
+	lo = line->first;
+	hi = line->last;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (layout->glyphs[mid].x1 <= x)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = lo; i > line->first; i--) {
+		EvTextLayoutBox *glyph = &layout->glyphs[i - 1];
+
+		if (glyph->x1 < x - line->max_width)
+			break;
+		if (box_contains_point (glyph, x, y))
+			return i - 1;
+	}
+
+	return -1;
+}
+
+/**
+ * ev_text_layout_get_offset_at_point:
+ * @layout: an #EvTextLayout
+ * @x: x coordinate in document units
+ * @y: y coordinate in document units
+ *
+ * Returns: the offset of the last character whose area contains the
+ *   given point, or -1 if there isn't any
+ */
+gint
+ev_text_layout_get_offset_at_point (EvTextLayout *layout,
+				    gdouble       x,
+				    gdouble       y)
+{
+	guint lo, hi, i;
+	gint  offset = -1;
+
+	if (!layout)
+		return -1;
+
+	/* Number of lines starting above the point */
+	lo = 0;
+	hi = layout->n_lines;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (layout->lines[layout->lines_by_y[mid]].bbox.y1 <= y)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = lo; i > 0 && layout->max_y2[i - 1] >= y; i--) {
+		EvTextLayoutLine *line = &layout->lines[layout->lines_by_y[i - 1]];
+		gint              line_offset;
+
+		if (!box_contains_point (&line->bbox, x, y))
+			continue;
+
+		line_offset = ev_text_layout_line_get_offset_at_point (layout, line, x, y);
+		offset = MAX (offset, line_offset);
+	}
+
+	return offset;
+}
+
+/**
+ * ev_text_layout_get_range_in_area:
+ * @layout: an #EvTextLayout
+ * @area: an area in document units
+ * @start: (out): return location for the first offset
+ * @end: (out): return location for the last offset
+ *
+ * Finds the first and last characters whose center lies within @area.
+ *
+ * Returns: %TRUE if at least one character was found
+ */
+gboolean
+ev_text_layout_get_range_in_area (EvTextLayout      *layout,
+				  const EvRectangle *area,
+				  guint             *start,
+				  guint             *end)
+{
+	gboolean found = FALSE;
+	guint    i, j;
+
+	if (!layout)
+		return FALSE;
+
+	for (i = 0; i < layout->n_lines; i++) {
+		EvTextLayoutLine *line = &layout->lines[i];
+
+		if (line->bbox.x2 < area->x1 || line->bbox.x1 > area->x2 ||
+		    line->bbox.y2 < area->y1 || line->bbox.y1 > area->y2)
+			continue;
+
+		for (j = line->first; j < line->last; j++) {
+			EvTextLayoutBox *glyph = &layout->glyphs[j];
+			gdouble          c_x, c_y;
+
+			c_x = glyph->x1 + (glyph->x2 - glyph->x1) / 2.;
+			c_y = glyph->y1 + (glyph->y2 - glyph->y1) / 2.;
+			if (c_x < area->x1 || c_x > area->x2 ||
+			    c_y < area->y1 || c_y > area->y2)
+				continue;
+
+			if (!found)
+				*start = j;
+			*end = j;
+			found = TRUE;
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,51 @@
+/* this file is part of xreader, a mate document viewer
+ *
+ * Xreader is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Xreader is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#if !defined (XREADER_COMPILATION)
+#error "This is a private header."
+#endif
+
+#ifndef EV_TEXT_LAYOUT_H
+#define EV_TEXT_LAYOUT_H
+
+#include <glib.h>
+#include <xreader-document.h>
+
+G_BEGIN_DECLS
+
+typedef struct _EvTextLayout EvTextLayout;
+
+EvTextLayout *ev_text_layout_new                (const EvRectangle *areas,
+						 guint              n_areas);
+void          ev_text_layout_free               (EvTextLayout      *layout);
+
+guint         ev_text_layout_get_length         (EvTextLayout      *layout);
+gsize         ev_text_layout_get_size           (EvTextLayout      *layout);
+gboolean      ev_text_layout_get_area           (EvTextLayout      *layout,
+						 guint              offset,
+						 EvRectangle       *area);
+gint          ev_text_layout_get_offset_at_point (EvTextLayout     *layout,
+						 gdouble            x,
+						 gdouble            y);
+gboolean      ev_text_layout_get_range_in_area  (EvTextLayout      *layout,
+						 const EvRectangle *area,
+						 guint             *start,
+						 guint             *end);
+
+G_END_DECLS
+
+#endif /* EV_TEXT_LAYOUT_H */
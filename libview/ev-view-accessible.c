@@ -145,13 +145,43 @@ ev_view_accessible_get_text_buffer (EvViewAccessible *accessible, EvView *view)
 		priv->buffer = gtk_text_buffer_new (NULL);
 	}
 
+	/* When the text hasn't been fetched yet the buffer is filled
+	 * in by ev_view_accessible_page_data_loaded()
+	 */
 	retval = ev_page_cache_get_text (page_cache, view->current_page);
-	if (retval)
-		gtk_text_buffer_set_text (priv->buffer, retval, -1);
+	gtk_text_buffer_set_text (priv->buffer, retval ? retval : "", -1);
 
 	return priv->buffer;
 }
 
+void
+ev_view_accessible_page_data_loaded (EvViewAccessible *accessible,
+				     gint              page,
+				     guint             flags)
+{
+	EvViewAccessiblePrivate *priv = accessible->priv;
+	GtkWidget               *widget;
+	const gchar             *text;
+
+	if (!(flags & EV_PAGE_DATA_INCLUDE_TEXT))
+		return;
+
+	if (!priv->buffer || page != (gint) priv->current_page)
+		return;
+
+	widget = gtk_accessible_get_widget (GTK_ACCESSIBLE (accessible));
+	if (!widget)
+		return;
+
+	text = ev_page_cache_get_text (EV_VIEW (widget)->page_cache, page);
+	if (!text)
+		return;
+
+	gtk_text_buffer_set_text (priv->buffer, text, -1);
+	g_signal_emit_by_name (accessible, "text-insert", 0,
+			       g_utf8_strlen (text, -1), text);
+}
+
 static gchar *
 ev_view_accessible_get_text (AtkText *text,
 			     gint     start_pos,
@@ -396,9 +426,8 @@ ev_view_accessible_get_character_extents (AtkText      *text,
 {
 	GtkWidget *widget, *toplevel;
 	EvView *view;
-	EvRectangle *areas = NULL;
-	EvRectangle *doc_rect;
-	guint n_areas = 0;
+	EvTextLayout *layout;
+	EvRectangle doc_rect;
 	gint x_widget, y_widget;
 	GdkRectangle view_rect;
 
@@ -411,12 +440,11 @@ ev_view_accessible_get_character_extents (AtkText      *text,
 	if (!view->page_cache)
 		return;
 
-	ev_page_cache_get_text_layout (view->page_cache, view->current_page, &areas, &n_areas);
-	if (!areas || offset >= n_areas)
+	layout = ev_page_cache_get_text_layout (view->page_cache, view->current_page);
+	if (!ev_text_layout_get_area (layout, offset, &doc_rect))
 		return;
 
-	doc_rect = areas + offset;
-	_ev_view_transform_doc_rect_to_view_rect (view, view->current_page, doc_rect, &view_rect);
+	_ev_view_transform_doc_rect_to_view_rect (view, view->current_page, &doc_rect, &view_rect);
 	view_rect.x -= view->scroll_x;
 	view_rect.y -= view->scroll_y;
 
@@ -447,12 +475,8 @@ ev_view_accessible_get_offset_at_point (AtkText      *text,
 {
 	GtkWidget *widget, *toplevel;
 	EvView *view;
-	EvRectangle *areas = NULL;
-	EvRectangle *rect = NULL;
-	guint n_areas = 0;
-	guint i;
+	EvTextLayout *layout;
 	gint x_widget, y_widget;
-	gint offset=-1;
 	GdkPoint view_point;
 	gdouble doc_x, doc_y;
 	GtkBorder border;
@@ -467,8 +491,8 @@ ev_view_accessible_get_offset_at_point (AtkText      *text,
 	if (!view->page_cache)
 		return -1;
 
-	ev_page_cache_get_text_layout (view->page_cache, view->current_page, &areas, &n_areas);
-	if (!areas)
+	layout = ev_page_cache_get_text_layout (view->page_cache, view->current_page);
+	if (!layout)
 		return -1;
 
 	view_point.x = x;
@@ -489,14 +513,7 @@ ev_view_accessible_get_offset_at_point (AtkText      *text,
 	ev_view_get_page_extents (view, view->current_page, &page_area, &border);
 	_ev_view_transform_view_point_to_doc_point (view, &view_point, &page_area, &border, &doc_x, &doc_y);
 
-	for (i = 0; i < n_areas; i++) {
-		rect = areas + i;
-		if (doc_x >= rect->x1 && doc_x <= rect->x2 &&
-		    doc_y >= rect->y1 && doc_y <= rect->y2)
-			offset = i;
-	}
-
-	return offset;
+	return ev_text_layout_get_offset_at_point (layout, doc_x, doc_y);
 }
 
 static gint
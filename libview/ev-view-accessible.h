@@ -49,6 +49,9 @@ struct _EvViewAccessibleClass
 
 GType      ev_view_accessible_get_type (void);
 AtkObject *ev_view_accessible_new      (GtkWidget *widget);
+void       ev_view_accessible_page_data_loaded (EvViewAccessible *accessible,
+						gint              page,
+						guint             flags);
 
 #endif  /* __EV_VIEW_ACCESSIBLE_H__ */
 
@@ -123,6 +123,12 @@ typedef struct {
 	EvAnnotation    *annot;
 } AddingAnnotInfo;
 
+/* Find results of a page, packed from the list given by the find job */
+typedef struct {
+	EvRectangle *areas;
+	guint        n_areas;
+} EvViewFindPage;
+
 struct _EvView {
 	GtkLayout layout;
 
@@ -133,6 +139,10 @@ struct _EvView {
 
 	/* Find */
 	GList **find_pages;
+	EvViewFindPage *find_results;
+	guint *find_offsets;
+	gint find_n_pages;
+	gboolean find_offsets_dirty;
 	gint find_result;
 	gboolean jump_to_find_result;
 	gboolean highlight_find_results;
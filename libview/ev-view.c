@@ -196,7 +196,8 @@ static AtkObject *ev_view_get_accessible                     (GtkWidget *widget)
 /*** Drawing ***/
 static void       highlight_find_results                     (EvView             *view,
 							      cairo_t            *cr,
-							      int                 page);
+							      int                 page,
+							      GdkRectangle       *clip);
 static void       highlight_forward_search_results           (EvView             *view,
 							      cairo_t            *cr,
 							      int                 page);
@@ -277,6 +278,7 @@ static void       ev_view_handle_cursor_over_xy              (EvView *view,
 							      gint y);
 
 /*** Find ***/
+static void       ev_view_find_clear_results                 (EvView             *view);
 static gint         ev_view_find_get_n_results               (EvView             *view,
 							      gint                page);
 static EvRectangle *ev_view_find_get_result                  (EvView             *view,
@@ -2986,6 +2988,19 @@ ev_view_annotation_show_popup_window (EvView    *view,
 	}
 }
 
+static void
+annotation_attachment_open_ready_cb (EvAttachment *attachment,
+				     GAsyncResult *result,
+				     gpointer      user_data)
+{
+	GError *error = NULL;
+
+	if (!ev_attachment_open_finish (attachment, result, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+	}
+}
+
 static void
 ev_view_handle_annotation (EvView       *view,
 			   EvAnnotation *annot,
@@ -3028,17 +3043,12 @@ ev_view_handle_annotation (EvView       *view,
 
 		attachment = ev_annotation_attachment_get_attachment (EV_ANNOTATION_ATTACHMENT (annot));
 		if (attachment) {
-			GError *error = NULL;
-
-			ev_attachment_open (attachment,
-					    gtk_widget_get_screen (GTK_WIDGET (view)),
-					    timestamp,
-					    &error);
-
-			if (error) {
-				g_warning ("%s", error->message);
-				g_error_free (error);
-			}
+			ev_attachment_open_async (attachment,
+						  gtk_widget_get_screen (GTK_WIDGET (view)),
+						  timestamp,
+						  NULL,
+						  (GAsyncReadyCallback) annotation_attachment_open_ready_cb,
+						  NULL);
 		}
 	}
 }
@@ -3223,6 +3233,30 @@ ev_view_remove_annotation (EvView       *view,
 	g_signal_emit (view, signals[SIGNAL_ANNOT_REMOVED], 0, annot);
 	g_object_unref (annot);
 }
+
+/**
+ * ev_view_set_page_annotations:
+ * @view: an #EvView
+ * @annots: the annotations of a page
+ *
+ * Hands annotations already fetched from the document, for instance to
+ * fill the annotations sidebar, to @view so that it doesn't need to
+ * fetch them again.
+ */
+void
+ev_view_set_page_annotations (EvView        *view,
+			      EvMappingList *annots)
+{
+	g_return_if_fail (EV_IS_VIEW (view));
+
+	if (!view->page_cache)
+		return;
+
+	ev_page_cache_set_annot_mapping (view->page_cache,
+					 ev_mapping_list_get_page (annots),
+					 annots);
+}
+
 static gboolean
 ev_view_synctex_backward_search (EvView *view,
 				 gdouble x,
@@ -3780,8 +3814,8 @@ ev_view_draw (GtkWidget      *widget,
 
 		draw_one_page (view, i, cr, &page_area, &border, &clip_rect, &page_ready);
 
-		if (page_ready && view->find_pages && view->highlight_find_results)
-			highlight_find_results (view, cr, i);
+		if (page_ready && view->find_results && view->highlight_find_results)
+			highlight_find_results (view, cr, i, &clip_rect);
 		if (page_ready && EV_IS_DOCUMENT_ANNOTATIONS (view->document))
 			show_annotation_windows (view, i);
 		if (page_ready && view->focus_annotation)
@@ -4776,7 +4810,10 @@ draw_rubberband (EvView             *view,
 
 
 static void
-highlight_find_results (EvView *view, cairo_t *cr, int page)
+highlight_find_results (EvView       *view,
+			cairo_t      *cr,
+			int           page,
+			GdkRectangle *clip)
 {
 	gint       i, n_results = 0;
 
@@ -4785,16 +4822,25 @@ highlight_find_results (EvView *view, cairo_t *cr, int page)
 	for (i = 0; i < n_results; i++) {
 		EvRectangle *rectangle;
 		GdkRectangle view_rectangle;
+		GdkRectangle draw_rectangle;
 		gdouble      alpha;
 
+		rectangle = ev_view_find_get_result (view, page, i);
+		_ev_view_transform_doc_rect_to_view_rect (view, page, rectangle, &view_rectangle);
+
+		/* Skip results outside of the exposed area */
+		draw_rectangle = view_rectangle;
+		draw_rectangle.x -= view->scroll_x;
+		draw_rectangle.y -= view->scroll_y;
+		if (!gdk_rectangle_intersect (&draw_rectangle, clip, NULL))
+			continue;
+
 		if (i == view->find_result && page == view->current_page) {
 			alpha = 0.6;
 		} else {
 			alpha = 0.3;
 		}
 
-		rectangle = ev_view_find_get_result (view, page, i);
-		_ev_view_transform_doc_rect_to_view_rect (view, page, rectangle, &view_rectangle);
 		draw_rubberband (view, cr, &view_rectangle, alpha);
         }
 }
@@ -5113,6 +5159,7 @@ ev_view_finalize (GObject *object)
 
 	clear_selection (view);
 	clear_link_selected (view);
+	ev_view_find_clear_results (view);
 
 	if (view->synctex_result) {
 		g_free (view->synctex_result);
@@ -5996,6 +6043,17 @@ ev_view_new (void)
 	return view;
 }
 
+static void
+page_cache_page_data_loaded_cb (EvPageCache *page_cache,
+				gint         page,
+				guint        flags,
+				EvView      *view)
+{
+	if (view->accessible)
+		ev_view_accessible_page_data_loaded (EV_VIEW_ACCESSIBLE (view->accessible),
+						     page, flags);
+}
+
 static void
 setup_caches (EvView *view)
 {
@@ -6009,6 +6067,8 @@ setup_caches (EvView *view)
 				 ev_page_cache_get_flags (view->page_cache) |
 				 EV_PAGE_DATA_INCLUDE_TEXT_LAYOUT |
 				 EV_PAGE_DATA_INCLUDE_TEXT);
+	g_signal_connect (view->page_cache, "page-data-loaded",
+			  G_CALLBACK (page_cache_page_data_loaded_cb), view);
 
 	inverted_colors = ev_document_model_get_inverted_colors (view->model);
 	ev_pixbuf_cache_set_inverted_colors (view->pixbuf_cache, inverted_colors);
@@ -6665,16 +6725,78 @@ ev_view_zoom_for_size (EvView *view,
 }
 
 /*** Find ***/
+static void
+ev_view_find_clear_results (EvView *view)
+{
+	gint i;
+
+	if (view->find_results) {
+		for (i = 0; i < view->find_n_pages; i++)
+			g_free (view->find_results[i].areas);
+		g_free (view->find_results);
+		view->find_results = NULL;
+	}
+
+	g_free (view->find_offsets);
+	view->find_offsets = NULL;
+	view->find_n_pages = 0;
+	view->find_offsets_dirty = FALSE;
+}
+
+static void
+ev_view_find_pack_page (EvView *view, gint page)
+{
+	EvViewFindPage *find_page = &view->find_results[page];
+	GList          *l;
+	guint           i;
+
+	g_free (find_page->areas);
+	find_page->areas = NULL;
+	find_page->n_areas = g_list_length (view->find_pages[page]);
+	if (find_page->n_areas == 0)
+		return;
+
+	find_page->areas = g_new (EvRectangle, find_page->n_areas);
+	for (l = view->find_pages[page], i = 0; l; l = g_list_next (l), i++)
+		find_page->areas[i] = *(EvRectangle *)l->data;
+}
+
 static gint
 ev_view_find_get_n_results (EvView *view, gint page)
 {
-	return view->find_pages ? g_list_length (view->find_pages[page]) : 0;
+	if (!view->find_results || page < 0 || page >= view->find_n_pages)
+		return 0;
+
+	return view->find_results[page].n_areas;
 }
 
 static EvRectangle *
 ev_view_find_get_result (EvView *view, gint page, gint result)
 {
-	return view->find_pages ? (EvRectangle *) g_list_nth_data (view->find_pages[page], result) : NULL;
+	if (result < 0 || result >= ev_view_find_get_n_results (view, page))
+		return NULL;
+
+	return &view->find_results[page].areas[result];
+}
+
+/* find_offsets[i] is the number of results in the pages before i */
+static guint *
+ev_view_find_get_offsets (EvView *view)
+{
+	gint i;
+
+	if (!view->find_offsets_dirty)
+		return view->find_offsets;
+
+	if (!view->find_offsets)
+		view->find_offsets = g_new (guint, view->find_n_pages + 1);
+
+	view->find_offsets[0] = 0;
+	for (i = 0; i < view->find_n_pages; i++)
+		view->find_offsets[i + 1] = view->find_offsets[i] + view->find_results[i].n_areas;
+	view->find_offsets_dirty = FALSE;
+
+	return view->find_offsets;
 }
 
 static void
@@ -6696,38 +6818,99 @@ jump_to_find_result (EvView *view)
 	}
 }
 
-static void
-jump_to_find_page (EvView *view, EvViewFindDirection direction, gint shift)
+/* First page in [from, n_pages) with results, or -1 */
+static gint
+find_next_page_with_results (const guint *offsets, gint n_pages, gint from)
 {
-	int n_pages, i;
+	gint lo = from, hi = n_pages;
 
-	n_pages = ev_document_get_n_pages (view->document);
+	if (from >= n_pages || offsets[n_pages] == offsets[from])
+		return -1;
 
-	for (i = 0; i < n_pages; i++) {
-		int page;
+	while (lo < hi) {
+		gint mid = lo + (hi - lo) / 2;
 
-		if (direction == EV_VIEW_FIND_NEXT)
-			page = view->current_page + i;
+		if (offsets[mid + 1] > offsets[from])
+			hi = mid;
 		else
-			page = view->current_page - i;
-		page += shift;
+			lo = mid + 1;
+	}
 
-		if (page >= n_pages) {
-			page = page - n_pages;
-		} else if (page < 0)
-			page = page + n_pages;
+	return lo;
+}
 
-		if (ev_view_find_get_n_results (view, page) > 0) {
-			ev_document_model_set_page (view->model, page);
-			break;
-		}
+/* Last page in [0, to] with results, or -1 */
+static gint
+find_prev_page_with_results (const guint *offsets, gint to)
+{
+	gint lo = 0, hi = to + 1;
+
+	if (to < 0 || offsets[to + 1] == 0)
+		return -1;
+
+	while (lo < hi) {
+		gint mid = lo + (hi - lo) / 2;
+
+		if (offsets[mid] < offsets[to + 1])
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo - 1;
+}
+
+static void
+jump_to_find_page (EvView *view, EvViewFindDirection direction, gint shift)
+{
+	guint *offsets;
+	gint   n_pages, page, start;
+
+	if (!view->find_results)
+		return;
+
+	n_pages = view->find_n_pages;
+	offsets = ev_view_find_get_offsets (view);
+	if (offsets[n_pages] == 0)
+		return;
+
+	start = (view->current_page + shift) % n_pages;
+	if (start < 0)
+		start += n_pages;
+
+	if (direction == EV_VIEW_FIND_NEXT) {
+		page = find_next_page_with_results (offsets, n_pages, start);
+		if (page == -1)
+			page = find_next_page_with_results (offsets, n_pages, 0);
+	} else {
+		page = find_prev_page_with_results (offsets, start);
+		if (page == -1)
+			page = find_prev_page_with_results (offsets, n_pages - 1);
 	}
+
+	if (page != -1)
+		ev_document_model_set_page (view->model, page);
 }
 
 void
 ev_view_find_changed (EvView *view, GList **results, gint page)
 {
-	view->find_pages = results;
+	gint n_pages = ev_document_get_n_pages (view->document);
+
+	if (results != view->find_pages || !view->find_results ||
+	    view->find_n_pages != n_pages) {
+		gint i;
+
+		ev_view_find_clear_results (view);
+		view->find_pages = results;
+		view->find_n_pages = n_pages;
+		view->find_results = g_new0 (EvViewFindPage, n_pages);
+		for (i = 0; i < n_pages; i++)
+			ev_view_find_pack_page (view, i);
+	} else if (page >= 0 && page < n_pages) {
+		ev_view_find_pack_page (view, page);
+	}
+	view->find_offsets_dirty = TRUE;
 
 	if (view->jump_to_find_result == TRUE) {
 		jump_to_find_page (view, EV_VIEW_FIND_NEXT, 0);
@@ -6777,6 +6960,7 @@ ev_view_find_search_changed (EvView *view)
 	/* search string has changed, focus on new search result */
 	view->jump_to_find_result = TRUE;
 	view->find_pages = NULL;
+	ev_view_find_clear_results (view);
 }
 
 void
@@ -6790,6 +6974,7 @@ void
 ev_view_find_cancel (EvView *view)
 {
 	view->find_pages = NULL;
+	ev_view_find_clear_results (view);
 }
 
 /*** Synctex ***/
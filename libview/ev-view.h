@@ -112,6 +112,8 @@ void               ev_view_begin_add_annotation      (EvView          *view,
 void               ev_view_cancel_add_annotation     (EvView          *view);
 void               ev_view_remove_annotation         (EvView          *view,
                                                       EvAnnotation    *annot);
+void               ev_view_set_page_annotations      (EvView          *view,
+                                                      EvMappingList   *annots);
 
 /*For epub*/
 void               ev_view_disconnect_handlers       (EvView          *view);
@@ -35,6 +35,18 @@
 #define EV_IS_WEB_VIEW_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), EV_TYPE_WEB_VIEW))
 #define EV_WEB_VIEW_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), EV_TYPE_WEB_VIEW, EvWebViewClass))
 
+/* Scheme of the URIs used by the pages of web based documents. Their
+ * resources are read from the document, see ev_document_get_resource().
+ */
+#define EV_WEB_VIEW_RESOURCE_SCHEME "epub"
+
+#define EV_WEB_VIEW_NIGHT_STYLESHEET \
+	"html, body { color: #ffffff !important; background-color: #000000 !important; }\n" \
+	"body * { color: inherit !important; background-color: transparent !important;" \
+	" border-color: #808080 !important; }\n" \
+	"a:link, a:link * { color: #8ab4f8 !important; }\n" \
+	"a:visited, a:visited * { color: #c58af9 !important; }\n"
+
  typedef enum {
  	EV_WEB_VIEW_FIND_NEXT,
  	EV_WEB_VIEW_FIND_PREV
@@ -55,7 +67,6 @@ struct _EvWebView
 	EvDocument *document;
 	EvDocumentModel *model;
 	gint current_page;
-	gboolean inverted_stylesheet ;
 	gboolean fullscreen;
 	SearchParams *search;
 	WebKitFindController *findcontroller;
@@ -128,11 +139,57 @@ ev_web_view_dispose (GObject *object)
 	G_OBJECT_CLASS (ev_web_view_parent_class)->dispose (object);
 }
 
+static void
+ev_web_view_resource_request_cb (WebKitURISchemeRequest *request,
+				 gpointer                user_data)
+{
+	WebKitWebView *web_view = webkit_uri_scheme_request_get_web_view (request);
+	EvDocument    *document = NULL;
+	GInputStream  *stream;
+	GBytes        *bytes = NULL;
+	gchar         *mime_type = NULL;
+	GError        *error = NULL;
+
+	if (EV_IS_WEB_VIEW (web_view))
+		document = EV_WEB_VIEW (web_view)->document;
+
+	if (document)
+		bytes = ev_document_get_resource (document,
+						  webkit_uri_scheme_request_get_uri (request),
+						  &mime_type, &error);
+	else
+		g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+				     "No document loaded");
+
+	if (!bytes) {
+		webkit_uri_scheme_request_finish_error (request, error);
+		g_error_free (error);
+		return;
+	}
+
+	stream = g_memory_input_stream_new_from_bytes (bytes);
+	webkit_uri_scheme_request_finish (request, stream,
+					  g_bytes_get_size (bytes),
+					  mime_type);
+	g_object_unref (stream);
+	g_bytes_unref (bytes);
+	g_free (mime_type);
+}
+
 static void
 ev_web_view_class_init (EvWebViewClass *klass)
 {
+	WebKitWebContext *context = webkit_web_context_get_default ();
+
 	G_OBJECT_CLASS(klass)->finalize = ev_web_view_finalize;
 	G_OBJECT_CLASS(klass)->dispose = ev_web_view_dispose;
+
+	webkit_web_context_register_uri_scheme (context, EV_WEB_VIEW_RESOURCE_SCHEME,
+						ev_web_view_resource_request_cb,
+						NULL, NULL);
+	/* Pages may use scripts installed locally, such as MathJax */
+	webkit_security_manager_register_uri_scheme_as_local (webkit_web_context_get_security_manager (context),
+							      EV_WEB_VIEW_RESOURCE_SCHEME);
 }
 
 static void
@@ -152,7 +209,6 @@ ev_web_view_init (EvWebView *webview)
 	webview->search->search_jump = TRUE ;
 	
 	webview->fullscreen = FALSE;
-	webview->inverted_stylesheet = FALSE;
 	webview->hlink = NULL;
 }
 
@@ -239,7 +295,6 @@ ev_web_view_document_changed_cb (EvDocumentModel *model,
 		if(webview->document) {
 			g_object_ref(webview->document);
 		}
-		webview->inverted_stylesheet = FALSE;
 		gint current_page = ev_document_model_get_page(model);
 		
 		ev_web_view_change_page (webview, current_page);
@@ -252,29 +307,42 @@ ev_web_view_inverted_colors_changed_cb (EvDocumentModel *model,
 				        GParamSpec      *pspec,
 				        EvWebView       *webview)
 {
-	EvDocument *document = ev_document_model_get_document(model);
+	if (ev_document_model_get_inverted_colors (model))
+		ev_web_view_set_user_stylesheet (webview, EV_WEB_VIEW_NIGHT_STYLESHEET);
+	else
+		ev_web_view_set_user_stylesheet (webview, NULL);
+}
 
-	if (!document || !document->iswebdocument)
-	    return;
+/**
+ * ev_web_view_set_user_stylesheet:
+ * @webview: an #EvWebView
+ * @css: (allow-none): a CSS style sheet, or %NULL
+ *
+ * Applies @css on top of the style sheets of the document, replacing the
+ * one previously set. The document itself is left untouched, so this is
+ * cheap enough to switch reader themes, such as night mode, at any time.
+ */
+void
+ev_web_view_set_user_stylesheet (EvWebView   *webview,
+				 const gchar *css)
+{
+	WebKitUserContentManager *manager;
+	WebKitUserStyleSheet     *style_sheet;
 
-	if (ev_document_model_get_inverted_colors(model) == TRUE) {
-		if (document == NULL) {
-			ev_document_model_set_inverted_colors(model,FALSE);
-			return;
-		}		
-		if (webview->inverted_stylesheet == FALSE) {
-			ev_document_check_add_night_sheet(document);
-			webview->inverted_stylesheet = TRUE;
-		}
-		ev_document_toggle_night_mode(document,TRUE);
-		webkit_web_view_reload(WEBKIT_WEB_VIEW(webview));
-	}
-	else {
-		if (document != NULL) {
-			ev_document_toggle_night_mode(document,FALSE);
-			webkit_web_view_reload(WEBKIT_WEB_VIEW(webview));
-		}
-	}
+	g_return_if_fail (EV_IS_WEB_VIEW (webview));
+
+	manager = webkit_web_view_get_user_content_manager (WEBKIT_WEB_VIEW (webview));
+	webkit_user_content_manager_remove_all_style_sheets (manager);
+
+	if (!css)
+		return;
+
+	style_sheet = webkit_user_style_sheet_new (css,
+						   WEBKIT_USER_CONTENT_INJECT_ALL_FRAMES,
+						   WEBKIT_USER_STYLE_LEVEL_USER,
+						   NULL, NULL);
+	webkit_user_content_manager_add_style_sheet (manager, style_sheet);
+	webkit_user_style_sheet_unref (style_sheet);
 }
 
 void
@@ -294,6 +362,9 @@ ev_web_view_set_model (EvWebView          *webview,
 		g_signal_handlers_disconnect_by_func (webview->model,
 						      ev_web_view_page_changed_cb,
 						      webview);
+		g_signal_handlers_disconnect_by_func (webview->model,
+						      ev_web_view_inverted_colors_changed_cb,
+						      webview);
 		g_object_unref (webview->model);
 	}
 	webview->model = g_object_ref (model);
@@ -303,6 +374,7 @@ ev_web_view_set_model (EvWebView          *webview,
 	webview->document = ev_document_model_get_document(webview->model);
 
 	ev_web_view_document_changed_cb (webview->model, NULL, webview);
+	ev_web_view_inverted_colors_changed_cb (webview->model, NULL, webview);
 
 	g_signal_connect (webview->model, "notify::document",
 			  G_CALLBACK (ev_web_view_document_changed_cb),
@@ -52,6 +52,9 @@ void		ev_web_view_set_model	        (EvWebView          *webview,
 
 void       ev_web_view_reload               (EvWebView          *webview);
 
+void       ev_web_view_set_user_stylesheet  (EvWebView          *webview,
+                                             const gchar        *css);
+
 void       ev_web_view_reload_page			(EvWebView         *webview,
   		    								 gint               page);
 	
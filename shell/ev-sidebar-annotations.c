@@ -44,6 +44,7 @@ enum {
 
 enum {
 	ANNOT_ACTIVATED,
+	ANNOTS_LOADED,
 	N_SIGNALS
 };
 
@@ -54,11 +55,13 @@ struct _EvSidebarAnnotationsPrivate {
 	GtkWidget *toolbar;
 
 	EvJob *job;
+	GtkTreeStore *model;
 	guint selection_changed_id;
 };
 
 static void ev_sidebar_annotations_page_iface_init (EvSidebarPageInterface *iface);
 static void ev_sidebar_annotations_load            (EvSidebarAnnotations   *sidebar_annots);
+static void ev_sidebar_annotations_cancel_job      (EvSidebarAnnotations   *sidebar_annots);
 
 static guint signals[N_SIGNALS] = { 0 };
 
@@ -76,6 +79,13 @@ ev_sidebar_annotations_dispose (GObject *object)
 	EvSidebarAnnotations *sidebar_annots = EV_SIDEBAR_ANNOTATIONS (object);
 	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
 
+	ev_sidebar_annotations_cancel_job (sidebar_annots);
+
+	if (priv->model) {
+		g_object_unref (priv->model);
+		priv->model = NULL;
+	}
+
 	if (priv->document) {
 		g_object_unref (priv->document);
 		priv->document = NULL;
@@ -219,6 +229,15 @@ ev_sidebar_annotations_class_init (EvSidebarAnnotationsClass *klass)
 			      g_cclosure_marshal_VOID__POINTER,
 			      G_TYPE_NONE, 1,
 			      G_TYPE_POINTER);
+	signals[ANNOTS_LOADED] =
+		g_signal_new ("annots-loaded",
+			      G_TYPE_FROM_CLASS (g_object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (EvSidebarAnnotationsClass, annots_loaded),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__POINTER,
+			      G_TYPE_NONE, 1,
+			      G_TYPE_POINTER);
 }
 
 GtkWidget *
@@ -268,11 +287,10 @@ selection_changed_cb (GtkTreeSelection     *selection,
 }
 
 static void
-job_finished_callback (EvJobAnnots          *job,
-		       EvSidebarAnnotations *sidebar_annots)
+ev_sidebar_annotations_add_annots (EvSidebarAnnotations *sidebar_annots,
+				   GList                *annots)
 {
 	EvSidebarAnnotationsPrivate *priv;
-	GtkTreeStore *model;
 	GtkTreeSelection *selection;
 	GList *l;
 	GtkIconTheme *icon_theme;
@@ -286,34 +304,25 @@ job_finished_callback (EvJobAnnots          *job,
 
 	priv = sidebar_annots->priv;
 
-	if (!job->annots) {
-		GtkTreeModel *list;
-
-		list = ev_sidebar_annotations_create_simple_model (_("Document contains no annotations"));
-		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), list);
-		g_object_unref (list);
-
-		g_object_unref (job);
-		priv->job = NULL;
-
-		return;
-	}
+	if (!priv->model) {
+		selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
+		gtk_tree_selection_set_mode (selection, GTK_SELECTION_SINGLE);
+		if (priv->selection_changed_id == 0) {
+			priv->selection_changed_id =
+				g_signal_connect (selection, "changed",
+						  G_CALLBACK (selection_changed_cb),
+						  sidebar_annots);
+		}
 
-	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
-	gtk_tree_selection_set_mode (selection, GTK_SELECTION_SINGLE);
-	if (priv->selection_changed_id == 0) {
-		priv->selection_changed_id =
-			g_signal_connect (selection, "changed",
-					  G_CALLBACK (selection_changed_cb),
-					  sidebar_annots);
+		priv->model = gtk_tree_store_new (N_COLUMNS,
+						  G_TYPE_STRING,
+						  GDK_TYPE_PIXBUF,
+						  G_TYPE_POINTER);
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
+					 GTK_TREE_MODEL (priv->model));
 	}
 
-	model = gtk_tree_store_new (N_COLUMNS,
-				    G_TYPE_STRING,
-				    GDK_TYPE_PIXBUF,
-				    G_TYPE_POINTER);
-
-	for (l = job->annots; l; l = g_list_next (l)) {
+	for (l = annots; l; l = g_list_next (l)) {
 		EvMappingList *mapping_list;
 		GList         *ll;
 		gchar         *page_label;
@@ -323,8 +332,8 @@ job_finished_callback (EvJobAnnots          *job,
 		mapping_list = (EvMappingList *)l->data;
 		page_label = g_strdup_printf (_("Page %d"),
 					      ev_mapping_list_get_page (mapping_list) + 1);
-		gtk_tree_store_append (model, &iter, NULL);
-		gtk_tree_store_set (model, &iter,
+		gtk_tree_store_append (priv->model, &iter, NULL);
+		gtk_tree_store_set (priv->model, &iter,
 				    COLUMN_MARKUP, page_label,
 				    -1);
 		g_free (page_label);
@@ -411,8 +420,8 @@ job_finished_callback (EvJobAnnots          *job,
                                 }
                         }
 
-			gtk_tree_store_append (model, &child_iter, &iter);
-			gtk_tree_store_set (model, &child_iter,
+			gtk_tree_store_append (priv->model, &child_iter, &iter);
+			gtk_tree_store_set (priv->model, &child_iter,
 					    COLUMN_MARKUP, markup,
 					    COLUMN_ICON, pixbuf,
 					    COLUMN_ANNOT_MAPPING, ll->data,
@@ -422,13 +431,9 @@ job_finished_callback (EvJobAnnots          *job,
 		}
 
 		if (!found)
-			gtk_tree_store_remove (model, &iter);
+			gtk_tree_store_remove (priv->model, &iter);
 	}
 
-	gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view),
-				 GTK_TREE_MODEL (model));
-	g_object_unref (model);
-
 	if (text_icon)
 		g_object_unref (text_icon);
 	if (attachment_icon)
@@ -441,24 +446,75 @@ job_finished_callback (EvJobAnnots          *job,
                 g_object_unref (underline_icon);
         if (squiggly_icon)
                 g_object_unref (squiggly_icon);
+}
 
+static void
+job_updated_callback (EvJobAnnots          *job,
+		      GList                *annots,
+		      EvSidebarAnnotations *sidebar_annots)
+{
+	ev_sidebar_annotations_add_annots (sidebar_annots, annots);
+
+	g_signal_emit (sidebar_annots, signals[ANNOTS_LOADED], 0, annots);
+}
+
+static void
+job_finished_callback (EvJobAnnots          *job,
+		       EvSidebarAnnotations *sidebar_annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+
+	if (!priv->model) {
+		GtkTreeModel *list;
+
+		list = ev_sidebar_annotations_create_simple_model (_("Document contains no annotations"));
+		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), list);
+		g_object_unref (list);
+	}
+
+	g_signal_handlers_disconnect_by_func (job,
+					      job_updated_callback,
+					      sidebar_annots);
 	g_object_unref (job);
 	priv->job = NULL;
 }
 
+static void
+ev_sidebar_annotations_cancel_job (EvSidebarAnnotations *sidebar_annots)
+{
+	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
+
+	if (!priv->job)
+		return;
+
+	g_signal_handlers_disconnect_by_func (priv->job,
+					      job_updated_callback,
+					      sidebar_annots);
+	g_signal_handlers_disconnect_by_func (priv->job,
+					      job_finished_callback,
+					      sidebar_annots);
+	ev_job_cancel (priv->job);
+	g_object_unref (priv->job);
+	priv->job = NULL;
+}
+
 static void
 ev_sidebar_annotations_load (EvSidebarAnnotations *sidebar_annots)
 {
 	EvSidebarAnnotationsPrivate *priv = sidebar_annots->priv;
 
-	if (priv->job) {
-		g_signal_handlers_disconnect_by_func (priv->job,
-						      job_finished_callback,
-						      sidebar_annots);
-		g_object_unref (priv->job);
+	ev_sidebar_annotations_cancel_job (sidebar_annots);
+
+	/* The current rows stay visible until the new ones arrive */
+	if (priv->model) {
+		g_object_unref (priv->model);
+		priv->model = NULL;
 	}
 
 	priv->job = ev_job_annots_new (priv->document);
+	g_signal_connect (priv->job, "updated",
+			  G_CALLBACK (job_updated_callback),
+			  sidebar_annots);
 	g_signal_connect (priv->job, "finished",
 			  G_CALLBACK (job_finished_callback),
 			  sidebar_annots);
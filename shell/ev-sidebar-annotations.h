@@ -50,6 +50,8 @@ struct _EvSidebarAnnotationsClass {
 
 	void    (* annot_activated)     (EvSidebarAnnotations *sidebar_annots,
 					 EvMapping            *mapping);
+	void    (* annots_loaded)       (EvSidebarAnnotations *sidebar_annots,
+					 GList                *annots);
 };
 
 GType      ev_sidebar_annotations_get_type    (void) G_GNUC_CONST;
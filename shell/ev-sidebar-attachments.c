@@ -267,6 +267,19 @@ ev_sidebar_attachments_popup_menu (GtkWidget *widget)
 	return ev_sidebar_attachments_popup_menu_show (ev_attachbar, x, y);
 }
 
+static void
+attachment_open_ready_cb (EvAttachment *attachment,
+			  GAsyncResult *result,
+			  gpointer      user_data)
+{
+	GError *error = NULL;
+
+	if (!ev_attachment_open_finish (attachment, result, &error)) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+	}
+}
+
 static gboolean
 ev_sidebar_attachments_button_press (EvSidebarAttachments *ev_attachbar,
 				     GdkEventButton       *event,
@@ -282,7 +295,6 @@ ev_sidebar_attachments_button_press (EvSidebarAttachments *ev_attachbar,
 	switch (event->button) {
 	        case 1:
 			if (event->type == GDK_2BUTTON_PRESS) {
-				GError *error = NULL;
 				EvAttachment *attachment;
 				
 				attachment = ev_sidebar_attachments_get_attachment_at_pos (ev_attachbar,
@@ -291,15 +303,12 @@ ev_sidebar_attachments_button_press (EvSidebarAttachments *ev_attachbar,
 				if (!attachment)
 					return FALSE;
 				
-				ev_attachment_open (attachment,
-						    gtk_widget_get_screen (GTK_WIDGET (ev_attachbar)),
-						    event->time,
-						    &error);
-				
-				if (error) {
-					g_warning ("%s", error->message);
-					g_error_free (error);
-				}
+				ev_attachment_open_async (attachment,
+							  gtk_widget_get_screen (GTK_WIDGET (ev_attachbar)),
+							  event->time,
+							  NULL,
+							  (GAsyncReadyCallback) attachment_open_ready_cb,
+							  NULL);
 				
 				g_object_unref (attachment);
 				
@@ -385,6 +394,30 @@ ev_sidebar_attachments_screen_changed (GtkWidget *widget,
 	}
 }
 
+typedef struct {
+	GFile     *file;
+	gboolean   saved;
+	guint     *pending;
+	GMainLoop *loop;
+} DragSaveData;
+
+static void
+drag_attachment_saved_cb (EvAttachment *attachment,
+			  GAsyncResult *result,
+			  DragSaveData *save_data)
+{
+	GError *error = NULL;
+
+	save_data->saved = ev_attachment_save_finish (attachment, result, &error);
+	if (error) {
+		g_warning ("%s", error->message);
+		g_error_free (error);
+	}
+
+	if (--(*save_data->pending) == 0)
+		g_main_loop_quit (save_data->loop);
+}
+
 static void
 ev_sidebar_attachments_drag_data_get (GtkWidget        *widget,
 				      GdkDragContext   *drag_context,
@@ -395,6 +428,9 @@ ev_sidebar_attachments_drag_data_get (GtkWidget        *widget,
 {
 	EvSidebarAttachments *ev_attachbar = EV_SIDEBAR_ATTACHMENTS (user_data);
 	GList                *selected = NULL, *l;
+	GList                *saves = NULL;
+	GMainLoop            *loop;
+	guint                 pending = 0;
         GPtrArray            *uris;
         char                **uri_list;
 
@@ -403,6 +439,7 @@ ev_sidebar_attachments_drag_data_get (GtkWidget        *widget,
 		return;
 
         uris = g_ptr_array_new ();
+	loop = g_main_loop_new (NULL, FALSE);
 	
 	for (l = selected; l && l->data; l = g_list_next (l)) {
 		EvAttachment *attachment;
@@ -425,11 +462,19 @@ ev_sidebar_attachments_drag_data_get (GtkWidget        *widget,
                 file = ev_mkstemp_file (template, &error);
                 g_free (template);
 		
-		if (file != NULL && ev_attachment_save (attachment, file, &error)) {
-			gchar *uri;
-
-			uri = g_file_get_uri (file);
-                        g_ptr_array_add (uris, uri);
+		if (file != NULL) {
+			DragSaveData *save_data;
+
+			save_data = g_slice_new0 (DragSaveData);
+			save_data->file = file;
+			save_data->pending = &pending;
+			save_data->loop = loop;
+			saves = g_list_prepend (saves, save_data);
+
+			pending++;
+			ev_attachment_save_async (attachment, file, NULL,
+						  (GAsyncReadyCallback) drag_attachment_saved_cb,
+						  save_data);
 		}
 	
 		if (error) {
@@ -438,10 +483,27 @@ ev_sidebar_attachments_drag_data_get (GtkWidget        *widget,
 		}
 
 		gtk_tree_path_free (path);
-		g_object_unref (file);
 		g_object_unref (attachment);
 	}
 
+	/* The drop target wants the files now, but keep the window
+	 * drawing while the contents are read back from the document.
+	 */
+	if (pending > 0)
+		g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+
+	saves = g_list_reverse (saves);
+	for (l = saves; l; l = g_list_next (l)) {
+		DragSaveData *save_data = (DragSaveData *) l->data;
+
+		if (save_data->saved)
+			g_ptr_array_add (uris, g_file_get_uri (save_data->file));
+		g_object_unref (save_data->file);
+		g_slice_free (DragSaveData, save_data);
+	}
+	g_list_free (saves);
+
         g_ptr_array_add (uris, NULL); /* NULL-terminate */
         uri_list = (char **) g_ptr_array_free (uris, FALSE);
         gtk_selection_data_set_uris (data, uri_list);
@@ -47,6 +47,10 @@ struct _EvSidebarLinksPrivate {
 	GtkTreeModel *model;
 	EvDocument *document;
 	EvDocumentModel *doc_model;
+
+	/* Outline rows sorted by destination page, EvJobLinksPagesEntry */
+	GArray *page_index;
+	EvJob *page_index_job;
 };
 
 enum {
@@ -73,6 +77,8 @@ static void job_finished_callback 			(EvJobLinks     *job,
 				    		         EvSidebarLinks *sidebar_links);
 static void ev_sidebar_links_set_current_page           (EvSidebarLinks *sidebar_links,
 							 gint            current_page);
+static void ev_sidebar_links_clear_page_index           (EvSidebarLinks *sidebar_links);
+static void ev_sidebar_links_build_page_index           (EvSidebarLinks *sidebar_links);
 static void ev_sidebar_links_page_iface_init 		(EvSidebarPageInterface *iface);
 static gboolean ev_sidebar_links_support_document	(EvSidebarPage  *sidebar_page,
 						         EvDocument     *document);
@@ -145,6 +151,8 @@ ev_sidebar_links_dispose (GObject *object)
 		sidebar->priv->job = NULL;
 	}
 
+	ev_sidebar_links_clear_page_index (sidebar);
+
 	if (sidebar->priv->model) {
 		g_object_unref (sidebar->priv->model);
 		sidebar->priv->model = NULL;
@@ -169,6 +177,7 @@ ev_sidebar_links_map (GtkWidget *widget)
 	GTK_WIDGET_CLASS (ev_sidebar_links_parent_class)->map (widget);
 
 	if (links->priv->model) {
+		ev_sidebar_links_build_page_index (links);
 		ev_sidebar_links_set_current_page (links,
 						   ev_document_model_get_page (links->priv->doc_model));
 	}
@@ -466,88 +475,146 @@ ev_sidebar_links_new (void)
 	return ev_sidebar_links;
 }
 
-static gboolean
-update_page_callback_foreach (GtkTreeModel *model,
-			      GtkTreePath  *path,
-			      GtkTreeIter  *iter,
-			      gpointer      data)
+static void
+ev_sidebar_links_clear_page_index (EvSidebarLinks *sidebar_links)
 {
-	EvSidebarLinks *sidebar_links = (data);
-	EvLink *link;
+	EvSidebarLinksPrivate *priv = sidebar_links->priv;
 
-	gtk_tree_model_get (model, iter,
-			    EV_DOCUMENT_LINKS_COLUMN_LINK, &link,
-			    -1);
+	if (priv->page_index_job) {
+		g_signal_handlers_disconnect_by_data (priv->page_index_job, sidebar_links);
+		ev_job_cancel (priv->page_index_job);
+		g_object_unref (priv->page_index_job);
+		priv->page_index_job = NULL;
+	}
 
-	if (link) {
-		int current_page;
-		int dest_page;
-		EvDocumentLinks *document_links = EV_DOCUMENT_LINKS (sidebar_links->priv->document);
+	if (priv->page_index) {
+		g_array_free (priv->page_index, TRUE);
+		priv->page_index = NULL;
+	}
+}
 
-		dest_page = ev_document_links_get_link_page (document_links, link);
-		g_object_unref (link);
+static void
+page_index_job_finished_cb (EvJobLinksPages *job,
+			    EvSidebarLinks  *sidebar_links)
+{
+	EvSidebarLinksPrivate *priv = sidebar_links->priv;
 
-		current_page = ev_document_model_get_page (sidebar_links->priv->doc_model);
+	priv->page_index = job->pages;
+	job->pages = NULL;
 
-		if (dest_page == current_page) {
-			gtk_tree_view_expand_to_path (GTK_TREE_VIEW (sidebar_links->priv->tree_view),
-						      path);
-			gtk_tree_view_set_cursor (GTK_TREE_VIEW (sidebar_links->priv->tree_view),
-						  path, NULL, FALSE);
+	g_object_unref (priv->page_index_job);
+	priv->page_index_job = NULL;
 
-			return TRUE;
-		}
+	ev_sidebar_links_set_current_page (sidebar_links,
+					   ev_document_model_get_page (priv->doc_model));
+}
+
+/* Resolving the destination of every row would load the whole outline,
+ * so it's done in a job, on a model of its own, and only once the
+ * sidebar is shown, since the index is only needed to follow the
+ * current page.
+ */
+static void
+ev_sidebar_links_build_page_index (EvSidebarLinks *sidebar_links)
+{
+	EvSidebarLinksPrivate *priv = sidebar_links->priv;
+
+	if (priv->page_index || priv->page_index_job)
+		return;
+
+	if (!gtk_widget_get_mapped (GTK_WIDGET (sidebar_links)))
+		return;
+
+	priv->page_index_job = ev_job_links_pages_new (priv->document);
+	g_signal_connect (priv->page_index_job, "finished",
+			  G_CALLBACK (page_index_job_finished_cb),
+			  sidebar_links);
+	ev_job_scheduler_push_job (priv->page_index_job, EV_JOB_PRIORITY_NONE);
+}
+
+/* Index of the first row, in outline order, pointing to @page, or -1 */
+static gint
+ev_sidebar_links_find_page (EvSidebarLinks *sidebar_links,
+			    gint            page)
+{
+	EvSidebarLinksPrivate *priv = sidebar_links->priv;
+	guint lo, hi;
+
+	if (!priv->page_index)
+		return -1;
+
+	lo = 0;
+	hi = priv->page_index->len;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		if (g_array_index (priv->page_index, EvJobLinksPagesEntry, mid).page < page)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	return FALSE;
+	if (lo == priv->page_index->len ||
+	    g_array_index (priv->page_index, EvJobLinksPagesEntry, lo).page != page)
+		return -1;
+
+	return lo;
 }
 
 static void
 ev_sidebar_links_set_current_page (EvSidebarLinks *sidebar_links,
 				   gint            current_page)
 {
+	EvSidebarLinksPrivate *priv = sidebar_links->priv;
 	GtkTreeSelection *selection;
 	GtkTreeModel *model;
 	GtkTreeIter iter;
+	GtkTreePath *path;
+	gint index;
 
 	/* Widget is not currently visible */
 	if (!gtk_widget_get_mapped (GTK_WIDGET (sidebar_links)))
 		return;
 
-	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (sidebar_links->priv->tree_view));
+	index = ev_sidebar_links_find_page (sidebar_links, current_page);
+	if (index == -1)
+		return;
+
+	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
 
+	/* Keep the selected row if it points to the page too */
 	if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
-		EvLink *link;
+		GtkTreePath *selected;
+		guint i;
 
-		gtk_tree_model_get (model, &iter,
-				    EV_DOCUMENT_LINKS_COLUMN_LINK, &link,
-				    -1);
-		if (link) {
-			gint dest_page;
-			EvDocumentLinks *document_links = EV_DOCUMENT_LINKS (sidebar_links->priv->document);
+		selected = gtk_tree_model_get_path (model, &iter);
+		for (i = index; i < priv->page_index->len; i++) {
+			EvJobLinksPagesEntry *entry;
 
-			dest_page = ev_document_links_get_link_page (document_links, link);
-			g_object_unref (link);
+			entry = &g_array_index (priv->page_index, EvJobLinksPagesEntry, i);
+			if (entry->page != current_page)
+				break;
 
-			if (dest_page == current_page)
+			if (gtk_tree_path_compare (entry->path, selected) == 0) {
+				gtk_tree_path_free (selected);
 				return;
+			}
 		}
+		gtk_tree_path_free (selected);
 	}
 
-	/* We go through the tree linearly looking for the first page that
-	 * matches.  This is pretty inefficient.  We can do something neat with
-	 * a GtkTreeModelSort here to make it faster, if it turns out to be
-	 * slow.
-	 */
-	g_signal_handler_block (selection, sidebar_links->priv->selection_id);
-	g_signal_handler_block (sidebar_links->priv->tree_view, sidebar_links->priv->row_activated_id);
+	path = g_array_index (priv->page_index, EvJobLinksPagesEntry, index).path;
+
+	g_signal_handler_block (selection, priv->selection_id);
+	g_signal_handler_block (priv->tree_view, priv->row_activated_id);
 
-	gtk_tree_model_foreach (model,
-				update_page_callback_foreach,
-				sidebar_links);
+	gtk_tree_view_expand_to_path (GTK_TREE_VIEW (priv->tree_view),
+				      path);
+	gtk_tree_view_set_cursor (GTK_TREE_VIEW (priv->tree_view),
+				  path, NULL, FALSE);
 
-	g_signal_handler_unblock (selection, sidebar_links->priv->selection_id);
-	g_signal_handler_unblock (sidebar_links->priv->tree_view, sidebar_links->priv->row_activated_id);
+	g_signal_handler_unblock (selection, priv->selection_id);
+	g_signal_handler_unblock (priv->tree_view, priv->row_activated_id);
 }
 
 static void
@@ -588,9 +655,12 @@ expand_open_links (GtkTreeView *tree_view, GtkTreeModel *model, GtkTreeIter *par
 				path = gtk_tree_model_get_path (model, &iter);
 				gtk_tree_view_expand_row (tree_view, path, FALSE);
 				gtk_tree_path_free (path);
-			}
 
-			expand_open_links (tree_view, model, &iter);
+				/* Rows below a collapsed one can't be expanded,
+				 * so don't walk (and load) those subtrees.
+				 */
+				expand_open_links (tree_view, model, &iter);
+			}
 		} while (gtk_tree_model_iter_next (model, &iter));
 	}
 }
@@ -628,6 +698,9 @@ job_finished_callback (EvJobLinks     *job,
 	expand_open_links (GTK_TREE_VIEW (priv->tree_view), priv->model, NULL);
 	gtk_tree_view_collapse_all (GTK_TREE_VIEW (priv->tree_view));
 
+	ev_sidebar_links_clear_page_index (sidebar_links);
+	ev_sidebar_links_build_page_index (sidebar_links);
+
 	selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (priv->tree_view));
 	gtk_tree_selection_set_mode (selection, GTK_SELECTION_SINGLE);
 
@@ -667,6 +740,7 @@ ev_sidebar_links_document_changed_cb (EvDocumentModel *model,
 		return;
 
 	if (priv->document) {
+		ev_sidebar_links_clear_page_index (sidebar_links);
 		gtk_tree_view_set_model (GTK_TREE_VIEW (priv->tree_view), NULL);
 		g_object_unref (priv->document);
 	}
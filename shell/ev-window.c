@@ -53,8 +53,10 @@
 #include "ev-document-fonts.h"
 #include "ev-document-images.h"
 #include "ev-document-links.h"
+#include "ev-document-security.h"
 #include "ev-document-thumbnails.h"
 #include "ev-document-annotations.h"
+#include "ev-document-text.h"
 #include "ev-document-type-builtins.h"
 #include "ev-document-misc.h"
 #include "ev-file-exporter.h"
@@ -222,6 +224,8 @@ struct _EvWindowPrivate {
     EvJob            *thumbnail_job;
     EvJob            *save_job;
     EvJob            *find_job;
+    EvJob            *text_index_job;
+    EvTextIndex      *text_index;
 
     /* Printing */
     GQueue           *print_queue;
@@ -358,6 +362,7 @@ static void     ev_window_emit_closed                        (EvWindow         *
 static void     ev_window_emit_doc_loaded                    (EvWindow      *window);
 #endif
 static void     ev_window_setup_bookmarks                    (EvWindow         *window);
+static void     ev_window_start_text_index                   (EvWindow         *ev_window);
 
 static void    zoom_control_changed_cb                       (EphyZoomAction *action,
                                                               float           zoom,
@@ -1549,12 +1554,65 @@ ev_window_set_document (EvWindow *ev_window,
         ev_window_warning_message (ev_window, "%s", _("Presentation mode is not supported for ePub documents."));
     }
 
+    ev_window_start_text_index (ev_window);
+
     if (ev_window->priv->setup_document_idle > 0)
         g_source_remove (ev_window->priv->setup_document_idle);
 
     ev_window->priv->setup_document_idle = g_idle_add ((GSourceFunc)ev_window_setup_document, ev_window);
 }
 
+static void
+ev_window_text_index_job_cb (EvJobTextIndex *job,
+                             EvWindow       *ev_window)
+{
+    g_clear_object (&ev_window->priv->text_index);
+    ev_window->priv->text_index = g_object_ref (ev_job_text_index_get_index (job));
+}
+
+static void
+ev_window_clear_text_index_job (EvWindow *ev_window)
+{
+    if (ev_window->priv->text_index_job != NULL) {
+        if (!ev_job_is_finished (ev_window->priv->text_index_job))
+            ev_job_cancel (ev_window->priv->text_index_job);
+
+        g_signal_handlers_disconnect_by_func (ev_window->priv->text_index_job,
+                ev_window_text_index_job_cb,
+                ev_window);
+        g_object_unref (ev_window->priv->text_index_job);
+        ev_window->priv->text_index_job = NULL;
+    }
+
+    g_clear_object (&ev_window->priv->text_index);
+}
+
+static void
+ev_window_start_text_index (EvWindow *ev_window)
+{
+    EvDocument *document = ev_window->priv->document;
+
+    ev_window_clear_text_index_job (ev_window);
+
+    /* Don't keep the decrypted text of protected documents around */
+    if (document->iswebdocument ||
+            !EV_IS_DOCUMENT_TEXT (document) ||
+            !EV_IS_DOCUMENT_FIND (document) ||
+            (EV_IS_DOCUMENT_SECURITY (document) &&
+             ev_document_security_has_document_security (EV_DOCUMENT_SECURITY (document))) ||
+            !g_settings_get_boolean (ev_window_ensure_settings (ev_window), GS_INDEX_DOCUMENT_TEXT))
+        return;
+
+    ev_window->priv->text_index_job = ev_job_text_index_new (document);
+    ev_job_text_index_set_use_cache (EV_JOB_TEXT_INDEX (ev_window->priv->text_index_job),
+                                     g_settings_get_boolean (ev_window->priv->settings,
+                                                             GS_CACHE_DOCUMENT_TEXT));
+    g_signal_connect (ev_window->priv->text_index_job, "finished",
+                      G_CALLBACK (ev_window_text_index_job_cb),
+                      ev_window);
+    ev_job_scheduler_push_job (ev_window->priv->text_index_job, EV_JOB_PRIORITY_NONE);
+}
+
 static void
 ev_window_document_changed (EvWindow *ev_window,
                             gpointer  user_data)
@@ -5445,6 +5503,17 @@ ev_window_update_find_status_message (EvWindow *ev_window)
         } else {
             message = g_strdup (_("Not found"));
         }
+    } else if (EV_JOB_FIND (ev_window->priv->find_job)->indexed_count >= 0) {
+        gint n_results = EV_JOB_FIND (ev_window->priv->find_job)->indexed_count;
+
+        /* The text index knows the total before the pages are searched */
+        if (n_results > 0)
+            message = g_strdup_printf (ngettext ("%d found in the document",
+                             "%d found in the document",
+                             n_results),
+                             n_results);
+        else
+            message = g_strdup (_("Not found"));
     } else {
         gdouble percent;
 
@@ -5579,6 +5648,9 @@ ev_window_search_start (EvWindow *ev_window)
                                                      ev_document_get_n_pages (ev_window->priv->document),
                                                      search_string,
                                                      egg_find_bar_get_case_sensitive (find_bar));
+        if (ev_window->priv->text_index)
+            ev_job_find_set_text_index (EV_JOB_FIND (ev_window->priv->find_job),
+                                        ev_window->priv->text_index);
 
         g_signal_connect (ev_window->priv->find_job, "finished",
                           G_CALLBACK (ev_window_find_job_finished_cb),
@@ -5918,6 +5990,8 @@ ev_window_dispose (GObject *object)
         ev_window_clear_find_job (window);
     }
 
+    ev_window_clear_text_index_job (window);
+
     if (priv->local_uri) {
         ev_window_clear_local_uri (window);
         priv->local_uri = NULL;
@@ -6551,6 +6625,20 @@ sidebar_annots_annot_activated_cb (EvSidebarAnnotations *sidebar_annots,
     ev_view_focus_annotation (EV_VIEW (window->priv->view), annot_mapping);
 }
 
+static void
+sidebar_annots_annots_loaded_cb (EvSidebarAnnotations *sidebar_annots,
+                                 GList                *annots,
+                                 EvWindow             *window)
+{
+    GList *l;
+
+    if (window->priv->document->iswebdocument == TRUE ) return;
+
+    /* Share them with the view so the pages aren't queried again */
+    for (l = annots; l; l = g_list_next (l))
+        ev_view_set_page_annotations (EV_VIEW (window->priv->view), l->data);
+}
+
 static void
 ev_window_begin_add_annot (EvSidebarAnnotations *sidebar_annots,
 		EvAnnotationType annot_type,
@@ -7307,6 +7395,59 @@ ev_view_popup_cmd_annot_properties (GtkAction *action,
     gtk_widget_destroy (GTK_WIDGET (dialog));
 }
 
+typedef struct {
+    EvWindow *window;
+    GFile    *save_to;
+    GFile    *dest_file;
+} AttachmentTaskData;
+
+static AttachmentTaskData *
+attachment_task_data_new (EvWindow *window,
+                          GFile    *save_to,
+                          GFile    *dest_file)
+{
+    AttachmentTaskData *data;
+
+    data = g_slice_new0 (AttachmentTaskData);
+    data->window = window;
+    g_object_add_weak_pointer (G_OBJECT (window), (gpointer *) &data->window);
+    data->save_to = save_to ? g_object_ref (save_to) : NULL;
+    data->dest_file = dest_file ? g_object_ref (dest_file) : NULL;
+
+    return data;
+}
+
+static void
+attachment_task_data_free (AttachmentTaskData *data)
+{
+    if (data->window)
+        g_object_remove_weak_pointer (G_OBJECT (data->window),
+                (gpointer *) &data->window);
+    if (data->save_to)
+        g_object_unref (data->save_to);
+    if (data->dest_file)
+        g_object_unref (data->dest_file);
+    g_slice_free (AttachmentTaskData, data);
+}
+
+static void
+attachment_open_ready_cb (EvAttachment       *attachment,
+                          GAsyncResult       *result,
+                          AttachmentTaskData *data)
+{
+    GError *error = NULL;
+
+    if (!ev_attachment_open_finish (attachment, result, &error)) {
+        if (data->window) {
+            ev_window_error_message (data->window, error,
+                    "%s", _("Unable to open attachment"));
+        }
+        g_error_free (error);
+    }
+
+    attachment_task_data_free (data);
+}
+
 static void
 ev_attachment_popup_cmd_open_attachment (GtkAction *action,
                                          EvWindow  *window)
@@ -7321,18 +7462,41 @@ ev_attachment_popup_cmd_open_attachment (GtkAction *action,
 
     for (l = window->priv->attach_list; l && l->data; l = g_list_next (l)) {
         EvAttachment *attachment;
-        GError       *error = NULL;
 
         attachment = (EvAttachment *) l->data;
 
-        ev_attachment_open (attachment, screen, gtk_get_current_event_time (), &error);
+        ev_attachment_open_async (attachment, screen,
+                gtk_get_current_event_time (), NULL,
+                (GAsyncReadyCallback) attachment_open_ready_cb,
+                attachment_task_data_new (window, NULL, NULL));
+    }
+}
 
-        if (error) {
-            ev_window_error_message (window, error,
-                    "%s", _("Unable to open attachment"));
-            g_error_free (error);
+static void
+attachment_save_ready_cb (EvAttachment       *attachment,
+                          GAsyncResult       *result,
+                          AttachmentTaskData *data)
+{
+    GError *error = NULL;
+
+    if (!ev_attachment_save_finish (attachment, result, &error)) {
+        if (data->window) {
+            ev_window_error_message (data->window, error,
+                    "%s", _("The attachment could not be saved."));
+        }
+        if (data->dest_file)
+            ev_tmp_file_unlink (data->save_to);
+        g_error_free (error);
+    } else if (data->dest_file) {
+        if (data->window) {
+            ev_window_save_remote (data->window, EV_SAVE_ATTACHMENT,
+                    data->save_to, data->dest_file);
+        } else {
+            ev_tmp_file_unlink (data->save_to);
         }
     }
+
+    attachment_task_data_free (data);
 }
 
 static void
@@ -7365,6 +7529,7 @@ attachment_save_dialog_response_cb (GtkWidget *fc,
     for (l = ev_window->priv->attach_list; l && l->data; l = g_list_next (l)) {
         EvAttachment *attachment;
         GFile        *save_to = NULL;
+        GFile        *dest_file = NULL;
         GError       *error = NULL;
 
         attachment = (EvAttachment *) l->data;
@@ -7381,34 +7546,30 @@ attachment_save_dialog_response_cb (GtkWidget *fc,
             save_to = ev_mkstemp_file ("saveattachment.XXXXXX", &error);
         }
 
-        if (save_to)
-            ev_attachment_save (attachment, save_to, &error);
-
         if (error) {
             ev_window_error_message (ev_window, error,
                     "%s", _("The attachment could not be saved."));
             g_error_free (error);
-            g_object_unref (save_to);
 
             continue;
         }
 
         if (!is_native) {
-            GFile *dest_file;
-
             if (is_dir) {
                 dest_file = g_file_get_child (target_file,
                         ev_attachment_get_name (attachment));
             } else {
                 dest_file = g_object_ref (target_file);
             }
+        }
 
-            ev_window_save_remote (ev_window, EV_SAVE_ATTACHMENT,
-                    save_to, dest_file);
+        /* The remote copy, if any, starts once the contents are saved */
+        ev_attachment_save_async (attachment, save_to, NULL,
+                (GAsyncReadyCallback) attachment_save_ready_cb,
+                attachment_task_data_new (ev_window, save_to, dest_file));
 
+        if (dest_file)
             g_object_unref (dest_file);
-        }
-
         g_object_unref (save_to);
     }
 
@@ -7828,6 +7989,10 @@ ev_window_init (EvWindow *ev_window)
             "annot_activated",
             G_CALLBACK (sidebar_annots_annot_activated_cb),
             ev_window);
+    g_signal_connect (sidebar_widget,
+            "annots-loaded",
+            G_CALLBACK (sidebar_annots_annots_loaded_cb),
+            ev_window);
     g_signal_connect (annot_toolbar,
             "begin-add-annot",
             G_CALLBACK (ev_window_begin_add_annot),
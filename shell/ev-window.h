@@ -40,6 +40,8 @@ G_BEGIN_DECLS
 #define GS_OVERRIDE_RESTRICTIONS   "override-restrictions"
 #define GS_PAGE_CACHE_SIZE         "page-cache-size"
 #define GS_AUTO_RELOAD             "auto-reload"
+#define GS_INDEX_DOCUMENT_TEXT     "index-document-text"
+#define GS_CACHE_DOCUMENT_TEXT     "cache-document-text"
 #define GS_LAST_DOCUMENT_DIRECTORY "document-directory"
 #define GS_LAST_PICTURES_DIRECTORY "pictures-directory"
 
@@ -25,6 +25,7 @@
 #include <libview/ev-jobs.h>
 #include <libview/ev-document-model.h>
 #include <libview/ev-print-operation.h>
+#include <libview/ev-text-index.h>
 #include <libview/ev-view.h>
 #include <libview/ev-web-view.h>
 #include <libview/ev-view-type-builtins.h>